@@ -83,6 +83,23 @@ const char *getCommandName(unsigned char command) {
       "CMD_USBDM_SET_VPP"                       , // 42,
       "CMD_USBDM_JTAG_READ_WRITE"               , // 43,
       "CMD_USBDM_JTAG_EXECUTE_SEQUENCE"         , // 44,
+      "CMD_USBDM_DAP_TRANSFER"                  , // 45,
+      "CMD_USBDM_TARGET_FLASH"                  , // 46,
+      "CMD_USBDM_FLASH_LOADER"                  , // 47,
+      "CMD_USBDM_VERIFY_MEM"                    , // 48,
+      "CMD_USBDM_CRC_MEM"                       , // 49,
+      "CMD_USBDM_WRITE_MEM_COMPRESSED"          , // 50,
+      "CMD_USBDM_FILL_MEM"                      , // 51,
+      "CMD_USBDM_EVENT_MONITOR"                 , // 52,
+      "CMD_USBDM_WRITE_ALL_CORE_REGS"           , // 53,
+      "CMD_USBDM_MEM_CACHE"                     , // 54,
+      "CMD_USBDM_RANGE_STEP"                    , // 55,
+      "CMD_USBDM_PC_SAMPLE"                     , // 56,
+      "CMD_USBDM_RTT"                           , // 57,
+      "CMD_USBDM_LIVE_WATCH"                    , // 58,
+      "CMD_USBDM_SWD_AUTOTUNE"                  , // 59,
+      "CMD_USBDM_SWD_LINK_OPTIONS"              , // 60,
+      "CMD_USBDM_ACCESS_PORT"                   , // 61,
    };
 
    char const *commandName = NULL;
@@ -17,15 +17,57 @@
 #include "swd.h"
 
 #include "Names.h"
+#include "eventMonitor.h"
+#include "memoryCache.h"
+#include "pcSampler.h"
+#include "targetRtt.h"
+#include "liveWatch.h"
+#include "linkTuner.h"
 
 using namespace USBDM;
 
-/** Buffer for USB command in, result out */
-uint8_t commandBuffer[MAX_COMMAND_SIZE+4];
+static_assert(EXTENDED_COMMAND_SIZE >= (MAX_COMMAND_SIZE+4), "EXTENDED_COMMAND_SIZE too small");
+static_assert(COMMAND_RECEIVE_SIZE >= (EXTENDED_FRAME_HEADER_SIZE+MAX_COMMAND_SIZE), "COMMAND_RECEIVE_SIZE too small");
+static_assert((COMMAND_RECEIVE_SIZE%BULK_OUT_EP_MAXSIZE) == 0, "COMMAND_RECEIVE_SIZE must be a multiple of the bulk OUT endpoint size");
+
+/**
+ * USB frame buffer - command in, result out.\n
+ * Extended framing places a length prefix before the command.\n
+ * Located in ram_high beside the stack as ram_low holds all other static data.
+ */
+__attribute__((section(".frame_ram")))
+static uint8_t commandFrame[EXTENDED_FRAME_HEADER_SIZE+EXTENDED_COMMAND_SIZE];
+
+/**
+ * Buffer for reception of the next command while the current command executes.\n
+ * Longer extended frames are completed directly in commandFrame.
+ */
+static uint8_t receiveBuffer[COMMAND_RECEIVE_SIZE];
+
+/** Buffer for USB command in, result out (points into command frame buffer) */
+uint8_t *commandBuffer = commandFrame+EXTENDED_FRAME_HEADER_SIZE;
+
+/** Size of current command (excluding any extended framing prefix) */
+unsigned commandSize;
 
 /** Size of command return result */
 int returnSize;
 
+/** Indicates extended framing is in use */
+static bool extendedFraming = false;
+
+/** Framing to adopt after current command response is sent */
+static bool requestedExtendedFraming = false;
+
+/**
+ * Get maximum size of command or response for the current framing
+ *
+ * @return MAX_COMMAND_SIZE for legacy framing, EXTENDED_COMMAND_SIZE for extended framing
+ */
+unsigned getMaxCommandSize(void) {
+   return extendedFraming?EXTENDED_COMMAND_SIZE:MAX_COMMAND_SIZE;
+}
+
 /**
  *  Status of the BDM
  */
@@ -50,6 +92,39 @@ BDM_Option_t bdm_option = {
 /** Error code from last/current command */
 static USBDM_ErrorCode commandStatus;
 
+/** Number of command codes that are timed (command byte is masked to 6 bits) */
+static constexpr unsigned LATENCY_COMMANDS = 64;
+
+/** Number of buckets in each command execution time histogram */
+static constexpr unsigned LATENCY_BUCKETS  = 8;
+
+/**
+ *  Execution time histogram for each command code.\n
+ *  Bucket 0 counts commands taking < 16us, each following bucket is 4 times wider
+ *  i.e. <16us, <64us, <256us, <1ms, <4ms, <16ms, <64ms, >=64ms
+ */
+static uint16_t commandLatency[LATENCY_COMMANDS][LATENCY_BUCKETS];
+
+/**
+ * Add command execution time to histogram
+ *
+ * @param command Command code
+ * @param cycles  Execution time in processor cycles
+ */
+static void recordCommandLatency(uint8_t command, uint32_t cycles) {
+   uint32_t us     = cycles/(SystemCoreClock/1000000);
+   uint32_t limit  = 16;
+   unsigned bucket = 0;
+   while ((bucket < (LATENCY_BUCKETS-1)) && (us >= limit)) {
+      limit <<= 2;
+      bucket++;
+   }
+   uint16_t &count = commandLatency[command&(LATENCY_COMMANDS-1)][bucket];
+   if (count != 0xFFFF) {
+      count++;
+   }
+}
+
 /**
  *  Creates status byte
  *
@@ -179,6 +254,34 @@ USBDM_ErrorCode f_CMD_DEBUG(void) {
          Usb0::setDiscardCharacters(true);
          return BDM_RC_OK;
 
+      case BDM_DBG_SWD_STATISTICS: //!< - Read & clear SWD link statistics
+      {
+         Swd::SwdStatistics stats;
+         Swd::getStatistics(stats);
+         Swd::clearStatistics();
+         unpack32BE(stats.waitRetries,  commandBuffer+1);
+         unpack32BE(stats.faults,       commandBuffer+5);
+         unpack32BE(stats.parityErrors, commandBuffer+9);
+         unpack32BE(stats.noAcks,       commandBuffer+13);
+         unpack32BE(stats.reconnects,   commandBuffer+17);
+         unpack32BE(stats.drwWords,     commandBuffer+21);
+         returnSize = 25;
+         return BDM_RC_OK;
+      }
+      case BDM_DBG_COMMAND_LATENCY: //!< - Read & clear command execution time histogram
+      {
+         if ((commandSize < 4) || (commandBuffer[3] >= LATENCY_COMMANDS)) {
+            return BDM_RC_ILLEGAL_PARAMS;
+         }
+         uint16_t *histogram = commandLatency[commandBuffer[3]];
+         for (unsigned bucket=0; bucket<LATENCY_BUCKETS; bucket++) {
+            unpack16BE(histogram[bucket], commandBuffer+1+2*bucket);
+            histogram[bucket] = 0;
+         }
+         returnSize = 1+2*LATENCY_BUCKETS;
+         return BDM_RC_OK;
+      }
+
    } // switch
    return BDM_RC_ILLEGAL_PARAMS;
 }
@@ -223,20 +326,49 @@ static const uint8_t capabilities[] = {
       VERSION_MAJOR,             // Extended firmware version number nn.nn.nn
       VERSION_MINOR,
       VERSION_MICRO,
+      (uint8_t)(EXTENDED_COMMAND_SIZE>>8),
+      (uint8_t)EXTENDED_COMMAND_SIZE,
 };
 
+/**
+ * Optional firmware features, see \ref FirmwareFeatures_t
+ */
+static constexpr uint16_t firmwareFeatures =
+      FEATURE_COMPRESSED_WRITE|
+      FEATURE_FILL_MEM|
+      FEATURE_EVENT_MONITOR|
+      FEATURE_MEM_CACHE|
+      FEATURE_RANGE_STEP|
+      FEATURE_PC_SAMPLE|
+      FEATURE_RTT|
+      FEATURE_LIVE_WATCH|
+      FEATURE_SWD_AUTOTUNE|
+      FEATURE_SWD_LINK_OPTIONS|
+      FEATURE_ACCESS_PORT;
+
 /**
  *  Returns capability vector for hardware
  *
+ *  @note
+ *   commandBuffer                                                \n
+ *    - [2]    = Requested framing, see \ref FramingOptions_t (optional, defaults to legacy)
+ *
  *  @return
  *   commandBuffer                                                \n
- *    - [1..2] = BDM capability, see \ref HardwareCapabilities_t  \n
- *    - [3..4] = Maximum command buffer size
+ *    - [1..2]  = BDM capability, see \ref HardwareCapabilities_t \n
+ *    - [3..4]  = Maximum command buffer size (legacy framing)    \n
+ *    - [5..7]  = Firmware version nn.nn.nn                       \n
+ *    - [8..9]  = Maximum command buffer size (extended framing)  \n
+ *    - [10]    = Framing in effect for following commands     \n
+ *    - [11..12]= Optional firmware features, see \ref FirmwareFeatures_t
  */
 USBDM_ErrorCode f_CMD_GET_CAPABILITIES(void) {
+   requestedExtendedFraming = (commandSize > 2) && (commandBuffer[2] & FRAMING_EXTENDED);
    // Copy BDM Options
    (void)memcpy(commandBuffer+1, capabilities, sizeof(capabilities));
-   returnSize = sizeof(capabilities) + 1;
+   commandBuffer[sizeof(capabilities)+1] = requestedExtendedFraming?FRAMING_EXTENDED:FRAMING_LEGACY;
+   unpack16BE(firmwareFeatures, commandBuffer+sizeof(capabilities)+2);
+   returnSize = sizeof(capabilities) + 4;
    return BDM_RC_OK;
 }
 
@@ -331,6 +463,10 @@ USBDM_ErrorCode f_CMD_CONTROL_PINS(void) {
          break;
       case PIN_RESET_LOW :
          ResetInterface::low();
+#if (HW_CAPABILITY & CAP_SWD_HW)
+         Swd::invalidateCoreRegisterCache();
+         MemoryCache::invalidate();
+#endif
          break;
    }
 #endif // (HW_CAPABILITY&CAP_RST_OUT)
@@ -439,7 +575,36 @@ static const FunctionPtr commonFunctionPtrs[] = {
          Swd::f_CMD_READ_MEM               ,//= 33  CMD_USBDM_READ_MEM
 #if HW_CAPABILITY&CAP_CORE_REGS
          Swd::f_CMD_READ_ALL_CORE_REGS     ,//= 34  CMD_USBDM_READ_ALL_REGS - Block read ARM-SWD core registers
+#else
+         f_CMD_ILLEGAL                     ,//= 34  CMD_USBDM_READ_ALL_REGS
 #endif
+         f_CMD_ILLEGAL                     ,//= 35  Reserved
+         f_CMD_ILLEGAL                     ,//= 36  Reserved
+         f_CMD_ILLEGAL                     ,//= 37  Reserved
+         f_CMD_ILLEGAL                     ,//= 38  CMD_USBDM_JTAG_GOTORESET
+         f_CMD_ILLEGAL                     ,//= 39  CMD_USBDM_JTAG_GOTOSHIFT
+         f_CMD_ILLEGAL                     ,//= 40  CMD_USBDM_JTAG_WRITE
+         f_CMD_ILLEGAL                     ,//= 41  CMD_USBDM_JTAG_READ
+         f_CMD_ILLEGAL                     ,//= 42  CMD_USBDM_SET_VPP
+         f_CMD_ILLEGAL                     ,//= 43  CMD_USBDM_JTAG_READ_WRITE
+         f_CMD_ILLEGAL                     ,//= 44  CMD_USBDM_JTAG_EXECUTE_SEQUENCE
+         Swd::f_CMD_DAP_TRANSFER           ,//= 45  CMD_USBDM_DAP_TRANSFER  - Execute list of DP/AP register operations
+         Swd::f_CMD_TARGET_FLASH           ,//= 46  CMD_USBDM_TARGET_FLASH  - Kinetis target Flash programming
+         Swd::f_CMD_FLASH_LOADER           ,//= 47  CMD_USBDM_FLASH_LOADER  - Target RAM Flash loader programming
+         Swd::f_CMD_VERIFY_MEM             ,//= 48  CMD_USBDM_VERIFY_MEM    - Compare target memory with data
+         Swd::f_CMD_CRC_MEM                ,//= 49  CMD_USBDM_CRC_MEM       - Calculate CRC of target memory
+         Swd::f_CMD_WRITE_MEM_COMPRESSED   ,//= 50  CMD_USBDM_WRITE_MEM_COMPRESSED - Write compressed data to target memory
+         Swd::f_CMD_FILL_MEM               ,//= 51  CMD_USBDM_FILL_MEM      - Fill target memory with pattern
+         Swd::f_CMD_EVENT_MONITOR          ,//= 52  CMD_USBDM_EVENT_MONITOR - Configure target event monitor
+         Swd::f_CMD_WRITE_ALL_CORE_REGS    ,//= 53  CMD_USBDM_WRITE_ALL_CORE_REGS - Write range of core registers
+         Swd::f_CMD_MEM_CACHE              ,//= 54  CMD_USBDM_MEM_CACHE     - Control target memory read cache
+         Swd::f_CMD_RANGE_STEP             ,//= 55  CMD_USBDM_RANGE_STEP    - Step until PC leaves address range
+         Swd::f_CMD_PC_SAMPLE              ,//= 56  CMD_USBDM_PC_SAMPLE     - PC sampling profiler
+         Swd::f_CMD_RTT                    ,//= 57  CMD_USBDM_RTT           - Stream target RTT buffers over CDC
+         Swd::f_CMD_LIVE_WATCH             ,//= 58  CMD_USBDM_LIVE_WATCH    - Periodic sampling of target variables
+         Swd::f_CMD_SWD_AUTOTUNE           ,//= 59  CMD_USBDM_SWD_AUTOTUNE  - Select fastest reliable SWD clock
+         Swd::f_CMD_SWD_LINK_OPTIONS       ,//= 60  CMD_USBDM_SWD_LINK_OPTIONS - Set WAIT handling and streaming writes
+         Swd::f_CMD_ACCESS_PORT            ,//= 61  CMD_USBDM_ACCESS_PORT   - Enumerate and select Access Ports
    };
    /** Information about command functions for ARM-SWD targets */
    static const FunctionPtrs SWDFunctionPointers   = {CMD_USBDM_CONNECT,
@@ -469,6 +634,31 @@ USBDM_ErrorCode f_CMD_SET_TARGET(void) {
    return setTarget(target);
 }
 
+/**
+ * Indicates the last target command was a raw DP/AP register access.
+ * Background target accesses are suspended until a higher level command
+ * so they don't disturb DP/AP state set up by the host.
+ */
+static bool rawDapAccess = false;
+
+/**
+ * Check if command is a raw DP/AP register access
+ *
+ * @param command Command to check
+ */
+static bool isRawDapCommand(BDMCommands command) {
+   switch(command) {
+      case CMD_USBDM_WRITE_CREG:
+      case CMD_USBDM_READ_CREG:
+      case CMD_USBDM_WRITE_DREG:
+      case CMD_USBDM_READ_DREG:
+      case CMD_USBDM_DAP_TRANSFER:
+         return true;
+      default:
+         return false;
+   }
+}
+
 /*
  *   Processes all commands received over USB
  *
@@ -509,12 +699,17 @@ static void commandExec(void) {
    //       On error, returnSize is forced to 1 (error code return only)
    returnSize    = 1;
    commandStatus = BDM_RC_OK;
+   if (command >= CMD_USBDM_CONNECT) {
+      rawDapAccess = isRawDapCommand(command);
+   }
    if (command >= CMD_USBDM_READ_STATUS_REG) {
       // Check if re-connect needed before most commands (always)
       commandStatus = optionalReconnect(AUTOCONNECT_ALWAYS);
    }
    if (commandStatus == BDM_RC_OK) {
+      uint32_t startTime = DWT->CYCCNT;
       commandStatus = commandPtr();   // Execute command & update command status
+      recordCommandLatency((uint8_t)command, DWT->CYCCNT-startTime);
    }
    commandBuffer[0] = commandStatus;  // Return command status
    if (commandStatus != BDM_RC_OK) {
@@ -527,7 +722,7 @@ static void commandExec(void) {
 #if (TARGET_CAPABILITY&CAP_ARM_SWD)
          if (cable_status.target_type == T_ARM_SWD) {
             // Re-connect in case synchronisation lost
-            (void)Swd::connect();
+            (void)Swd::reconnect();
             if (commandStatus == BDM_RC_ACK_TIMEOUT) {
                // Abort AP transactions as they are the usual cause of WAIT timeouts
                (void)Swd::abortAP();
@@ -541,6 +736,86 @@ static void commandExec(void) {
 //   Debug::low();
 }
 
+/**
+ * Decode command frame received from USB device
+ *
+ * @param frame         Frame buffer containing data received
+ * @param receivedSize  Number of bytes received
+ *
+ * @return true  => Command available in commandBuffer, commandSize updated
+ * @return false => No valid command received
+ *
+ * @note When extended framing is in use a legacy frame causes reversion to legacy framing
+ */
+static bool decodeFrame(uint8_t *frame, int receivedSize) {
+   if (receivedSize <= 0) {
+      return false;
+   }
+   if (extendedFraming) {
+      if ((receivedSize >= EXTENDED_FRAME_HEADER_SIZE+2) &&
+          (pack16BE(frame) == (unsigned)(receivedSize-EXTENDED_FRAME_HEADER_SIZE))) {
+         commandBuffer = frame+EXTENDED_FRAME_HEADER_SIZE;
+         commandSize   = receivedSize-EXTENDED_FRAME_HEADER_SIZE;
+         return true;
+      }
+      if (receivedSize > MAX_COMMAND_SIZE) {
+         // Neither extended nor legacy frame - discard
+         return false;
+      }
+      // Legacy frame e.g. host has re-opened the BDM - revert to legacy framing
+      extendedFraming = false;
+   }
+   if (receivedSize > MAX_COMMAND_SIZE) {
+      // Excess is discarded
+      receivedSize = MAX_COMMAND_SIZE;
+   }
+   commandBuffer = frame;
+   commandSize   = receivedSize;
+   return true;
+}
+
+/**
+ * Background tasks done while waiting for a command
+ */
+static void idleTasks() {
+   if (rawDapAccess) {
+      return;
+   }
+   EventMonitor::poll();
+   PcSampler::poll();
+   TargetRtt::poll();
+   LiveWatch::poll();
+   LinkTuner::poll();
+}
+
+/**
+ * Copy received command to the command frame buffer
+ *
+ * A long extended frame fills the reception buffer and its remainder is
+ * received directly into the command frame buffer.
+ *
+ * @param receivedSize  Number of bytes in receiveBuffer
+ *
+ * @return Size of frame in commandFrame
+ *
+ * @note The previous response must have been transmitted from commandFrame
+ */
+static int loadFrame(int receivedSize) {
+   if (receivedSize <= 0) {
+      return receivedSize;
+   }
+   memcpy(commandFrame, receiveBuffer, receivedSize);
+   if (extendedFraming && ((unsigned)receivedSize == sizeof(receiveBuffer))) {
+      unsigned frameSize = EXTENDED_FRAME_HEADER_SIZE+pack16BE(commandFrame);
+      if ((frameSize > sizeof(receiveBuffer)) && (frameSize <= sizeof(commandFrame))) {
+         // Receive remainder of frame in place
+         USBDM::UsbImplementation::startBulkReceive(frameSize-receivedSize, commandFrame+receivedSize);
+         receivedSize += USBDM::UsbImplementation::waitBulkReceive();
+      }
+   }
+   return receivedSize;
+}
+
 /**
  * Process commands from USB device
  *
@@ -552,19 +827,47 @@ static void commandExec(void) {
  *   @note : Response                                   \n
  *       commandBuffer[0]    = error code               \n
  *       commandBuffer[1..N] = response/data
+ *
+ *   @note When extended framing is in use, command and response are
+ *         preceded by a 16-bit BIG-ENDIAN length (see \ref FramingOptions_t)
+ *
+ *   @note Commands are pipelined.
+ *         Reception of the next command into receiveBuffer is started before the current command
+ *         executes and the response is transmitted while the next command is being received.
+ *         Responses are returned in command order with the command sequence number.
  */
 void commandLoop() {
    static uint8_t commandSequence = 0;
 
+   // Start reception of first command
+   USBDM::UsbImplementation::startBulkReceive(sizeof(receiveBuffer), receiveBuffer);
    for(;;) {
-      int receivedSize = USBDM::UsbImplementation::receiveBulkData(MAX_COMMAND_SIZE, commandBuffer);
-      if (receivedSize <= 0) {
+      // Monitor and sample target while idle
+      int receivedSize = USBDM::UsbImplementation::waitBulkReceive(idleTasks);
+
+      // Command frame holds the previous response which may still be in transmission
+      USBDM::UsbImplementation::waitBulkTransmit();
+      receivedSize = loadFrame(receivedSize);
+
+      // Receive next command while executing this one
+      USBDM::UsbImplementation::startBulkReceive(sizeof(receiveBuffer), receiveBuffer);
+
+      if (!decodeFrame(commandFrame, receivedSize)) {
          continue;
       }
+      requestedExtendedFraming = extendedFraming;
       commandSequence = commandBuffer[1] & 0xC0;
       commandBuffer[1] &= 0x3F;
       commandExec();
       commandBuffer[0] |= commandSequence;
-      USBDM::UsbImplementation::sendBulkData(returnSize, commandBuffer);
+      if (extendedFraming) {
+         unpack16BE(returnSize, commandFrame);
+         USBDM::UsbImplementation::sendBulkData(returnSize+EXTENDED_FRAME_HEADER_SIZE, commandFrame, true);
+      }
+      else {
+         USBDM::UsbImplementation::sendBulkData(returnSize, commandBuffer);
+      }
+      // Change framing after response (if requested)
+      extendedFraming = requestedExtendedFraming;
    }
 }
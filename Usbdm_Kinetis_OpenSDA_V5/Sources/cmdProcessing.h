@@ -6,12 +6,22 @@
 #include <stdint.h>
 #include "commands.h"
 
-/** Buffer for USB command in, result out */
-extern uint8_t   commandBuffer[MAX_COMMAND_SIZE+4];
+/** Buffer for USB command in, result out (points into command frame buffer) */
+extern uint8_t *commandBuffer;
+
+/** Size of current command (excluding any extended framing prefix) */
+extern unsigned commandSize;
 
 /** Size of command return result */
 extern int returnSize;
 
+/**
+ * Get maximum size of command or response for the current framing
+ *
+ * @return MAX_COMMAND_SIZE for legacy framing, EXTENDED_COMMAND_SIZE for extended framing
+ */
+extern unsigned getMaxCommandSize(void);
+
 /**
  * Process commands from USB device
  *
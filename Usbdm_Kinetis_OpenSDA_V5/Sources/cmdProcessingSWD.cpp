@@ -32,6 +32,7 @@
  */
 #include <interfaceCommon.h>
 #include <string>
+#include <string.h>
 #include <math.h>
 #include "configure.h"
 #include "commands.h"
@@ -39,6 +40,15 @@
 #include "cmdProcessing.h"
 #include "cmdProcessingSWD.h"
 #include "swd.h"
+#include "targetFlash.h"
+#include "flashLoader.h"
+#include "targetCrc.h"
+#include "eventMonitor.h"
+#include "memoryCache.h"
+#include "pcSampler.h"
+#include "targetRtt.h"
+#include "liveWatch.h"
+#include "linkTuner.h"
 
 namespace Swd {
 
@@ -59,6 +69,7 @@ USBDM_ErrorCode f_CMD_CONNECT(void) {
    if (rc != BDM_RC_OK) {
       return rc;
    }
+   MemoryCache::invalidate();
    rc = Swd::connect();
    if (rc != BDM_RC_OK) {
       return rc;
@@ -77,6 +88,8 @@ USBDM_ErrorCode f_CMD_CONNECT(void) {
  */
 USBDM_ErrorCode f_CMD_SET_SPEED(void) {
    uint16_t freq = (commandBuffer[2]<<8)|commandBuffer[3]; // Get the new speed
+   // Explicit speed overrides automatic adjustment
+   LinkTuner::disable();
    return Swd::setSpeed(1000*freq);
 }
 
@@ -96,6 +109,16 @@ USBDM_ErrorCode f_CMD_GET_SPEED(void) {
    return BDM_RC_OK;
 }
 
+/** Maps register index into SWD command for register write */
+static const SwdWrite writeDP[] = {
+      SwdWrite_DP_ABORT, SwdWrite_DP_CONTROL, SwdWrite_DP_SELECT, SwdWrite_DP_INVALID,
+      SwdWrite_AP_REG0,  SwdWrite_AP_REG1,    SwdWrite_AP_REG2,   SwdWrite_AP_REG3, };
+
+/** Maps register index into SWD command for register read */
+static const SwdRead readDP[]  = {
+      SwdRead_DP_IDCODE, SwdRead_DP_STATUS, SwdRead_DP_RESEND, SwdRead_DP_RDBUFF,
+      SwdRead_AP_REG0,   SwdRead_AP_REG1,   SwdRead_AP_REG2,   SwdRead_AP_REG3, };
+
 /**
  *  Write SWD DP register;
  *
@@ -113,11 +136,9 @@ USBDM_ErrorCode f_CMD_GET_SPEED(void) {
  *    SwdWrite_AP_REGx    - Write to AP register.  May initiate action e.g. memory access.  Result is pending, FAULT on sticky error.
  */
 USBDM_ErrorCode f_CMD_WRITE_DREG(void) {
-
-   static const SwdWrite writeDP[] = {
-         SwdWrite_DP_ABORT, SwdWrite_DP_CONTROL, SwdWrite_DP_SELECT, SwdWrite_DP_INVALID,
-         SwdWrite_AP_REG0,  SwdWrite_AP_REG1,    SwdWrite_AP_REG2,   SwdWrite_AP_REG3, };
-
+   // AP accesses may modify core registers or memory
+   invalidateCoreRegisterCache();
+   MemoryCache::invalidate();
    return Swd::writeReg(writeDP[commandBuffer[3]&0x07], commandBuffer+4);
 }
 
@@ -140,9 +161,6 @@ USBDM_ErrorCode f_CMD_WRITE_DREG(void) {
  *    SwdRead_AP_REGx   - Value from last AP read, clear READOK flag in STRL/STAT and INITIATE next AP read, FAULT on sticky error
  */
 USBDM_ErrorCode f_CMD_READ_DREG(void) {
-   static const SwdRead readDP[]  = {
-         SwdRead_DP_IDCODE, SwdRead_DP_STATUS, SwdRead_DP_RESEND, SwdRead_DP_RDBUFF,
-         SwdRead_AP_REG0,   SwdRead_AP_REG1,   SwdRead_AP_REG2,   SwdRead_AP_REG3, };
    returnSize = 5;
    return Swd::readReg(readDP[commandBuffer[3]&0x07], commandBuffer+1);
 }
@@ -163,6 +181,9 @@ USBDM_ErrorCode f_CMD_READ_DREG(void) {
  *  @note - Access is completed before return
  */
 USBDM_ErrorCode f_CMD_WRITE_CREG(void) {
+   // AP accesses may modify core registers or memory
+   invalidateCoreRegisterCache();
+   MemoryCache::invalidate();
    // Write to AP register
    return Swd::writeAPReg(commandBuffer+2, commandBuffer+4);
 }
@@ -189,19 +210,504 @@ USBDM_ErrorCode f_CMD_READ_CREG(void) {
 }
 
 
+/**
+ * Read DP or AP register
+ *
+ * @param regNo Register index (0-3 => DP, 4-7 => AP)
+ * @param data  32-bit register value
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note AP reads are completed by reading DP.RDBUFF
+ */
+static USBDM_ErrorCode readDapRegister(unsigned regNo, uint32_t &data) {
+   USBDM_ErrorCode rc = Swd::readReg(readDP[regNo], data);
+   if ((rc != BDM_RC_OK) || (regNo < 4)) {
+      return rc;
+   }
+   // Get data from posted AP read
+   return Swd::readReg(SwdRead_DP_RDBUFF, data);
+}
+
+/**
+ * Check if DAP transfer operation is followed by a 32-bit value
+ *
+ * @param operation Operation byte (see DapTransferOp_t)
+ */
+static constexpr bool dapOperationHasValue(uint8_t operation) {
+   return (operation & (DAP_OP_READ|DAP_OP_MATCH|DAP_OP_SET_MASK)) != DAP_OP_READ;
+}
+
+/**  Execute a list of DP/AP register operations
+ *
+ *  @note
+ *   commandBuffer\n
+ *    - [2..3]  =>  16-bit retry count for DAP_OP_MATCH operations
+ *    - [4]     =>  number of operations (N)
+ *    - [5..M]  =>  N operations, each an operation byte (see DapTransferOp_t) optionally
+ *                  followed by a 32-bit value in BIG-ENDIAN order
+ *
+ *  @return BDM_RC_OK => operations were processed (check response), error otherwise \n
+ *                                                \n
+ *   commandBuffer                                \n
+ *    - [1]     =>  number of operations completed i.e. index of failing operation
+ *    - [2]     =>  error code from failing operation, BDM_RC_OK if all completed
+ *    - [3..N]  =>  32-bit values from DAP_OP_READ operations (excluding DAP_OP_MATCH) in BIG-ENDIAN order
+ *
+ *  @note WAIT responses are retried as usual for each operation
+ *  @note The usual error recovery is done if an operation fails
+ */
+USBDM_ErrorCode f_CMD_DAP_TRANSFER(void) {
+   // Copy of operations as response overwrites command
+   uint8_t operations[MAX_COMMAND_SIZE];
+
+   if (commandSize < 5) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   // AP accesses may modify core registers or memory
+   invalidateCoreRegisterCache();
+   MemoryCache::invalidate();
+
+   unsigned matchRetries   = pack16BE(commandBuffer+2);
+   unsigned operationCount = commandBuffer[4];
+   unsigned operationBytes = commandSize-5;
+
+   // Validate operations and response size before doing anything
+   unsigned index        = 0;
+   unsigned responseSize = 3;
+   for (unsigned count=0; count<operationCount; count++) {
+      if (index >= operationBytes) {
+         return BDM_RC_ILLEGAL_PARAMS;
+      }
+      uint8_t operation = commandBuffer[5+index++];
+      if (dapOperationHasValue(operation)) {
+         index += 4;
+      }
+      else {
+         responseSize += 4;
+      }
+   }
+   if ((index > operationBytes) || (index > sizeof(operations)) || (responseSize > getMaxCommandSize())) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   memcpy(operations, commandBuffer+5, index);
+
+   const uint8_t   *operationPtr  = operations;
+   uint8_t         *outputPtr     = commandBuffer+3;
+   uint32_t         matchMask     = 0xFFFFFFFF;
+   bool             apWritePosted = false;
+   unsigned         completed;
+   USBDM_ErrorCode  rc = BDM_RC_OK;
+
+   for (completed=0; completed<operationCount; completed++) {
+      uint8_t  operation = *operationPtr++;
+      uint32_t value     = 0;
+      if (dapOperationHasValue(operation)) {
+         value = pack32BE(operationPtr);
+         operationPtr += 4;
+      }
+      if (operation & DAP_OP_SET_MASK) {
+         matchMask = value;
+         continue;
+      }
+      unsigned regNo = operation & DAP_OP_REG_MASK;
+      if (operation & DAP_OP_READ) {
+         uint32_t data;
+         unsigned retry = matchRetries;
+         do {
+            rc = readDapRegister(regNo, data);
+            if ((rc != BDM_RC_OK) || !(operation & DAP_OP_MATCH) || ((data&matchMask) == value)) {
+               break;
+            }
+            if (retry-- == 0) {
+               rc = BDM_RC_UNEXPECTED_RESPONSE;
+               break;
+            }
+         } while (true);
+         if (rc != BDM_RC_OK) {
+            break;
+         }
+         if (!(operation & DAP_OP_MATCH)) {
+            unpack32BE(data, outputPtr);
+            outputPtr += 4;
+         }
+         apWritePosted = false;
+      }
+      else {
+         rc = Swd::writeReg(writeDP[regNo], value);
+         if (rc != BDM_RC_OK) {
+            break;
+         }
+         apWritePosted = (regNo >= 4);
+      }
+   }
+   if ((rc == BDM_RC_OK) && apWritePosted) {
+      // Obtain status of final AP write
+      uint32_t dummy;
+      rc = Swd::readReg(SwdRead_DP_RDBUFF, dummy);
+      if (rc != BDM_RC_OK) {
+         completed--;
+      }
+   }
+   if (rc != BDM_RC_OK) {
+      // Re-connect in case synchronisation lost
+      (void)Swd::connect();
+      if (rc == BDM_RC_ACK_TIMEOUT) {
+         // Abort AP transactions as they are the usual cause of WAIT timeouts
+         (void)Swd::abortAP();
+      }
+      // Clear sticky bits since already reporting error
+      (void)Swd::clearStickyBits();
+   }
+   commandBuffer[1] = (uint8_t)completed;
+   commandBuffer[2] = (uint8_t)rc;
+   returnSize = outputPtr-commandBuffer;
+   return BDM_RC_OK;
+}
+
+/**  Kinetis target Flash programming
+ *
+ *  @note
+ *   commandBuffer\n
+ *    - [2]     =>  Operation, see \ref TargetFlashOp_t
+ *    - [3..N]  =>  Operation parameters
+ *
+ *   TF_OP_START \n
+ *    - [3..6]   =>  Address to start programming in BIG-ENDIAN order
+ *    - [7..10]  =>  Sector size in BIG-ENDIAN order
+ *    - [11]     =>  Phrase size (4 or 8)
+ *    - [12]     =>  Options, see \ref TargetFlashOptions_t
+ *    - [13..16] =>  Programming acceleration RAM address in BIG-ENDIAN order (TF_OPTION_SECTION only)
+ *    - [17..18] =>  Programming acceleration RAM size in BIG-ENDIAN order (TF_OPTION_SECTION only)
+ *
+ *   TF_OP_DATA \n
+ *    - [3..N]   =>  Data to program at current address
+ *
+ *   TF_OP_ERASE \n
+ *    - [3..6]   =>  Address of first sector in BIG-ENDIAN order
+ *    - [7..10]  =>  Size of range in BIG-ENDIAN order
+ *    - [11..14] =>  Sector size in BIG-ENDIAN order
+ *
+ *   TF_OP_DELTA \n
+ *    - [3]      =>  CRC to use, see \ref CrcPreset_t
+ *    - [4..7]   =>  Address of first sector in BIG-ENDIAN order
+ *    - [8..11]  =>  Sector size in BIG-ENDIAN order
+ *    - [12..N]  =>  Expected 32-bit CRC of each sector in BIG-ENDIAN order
+ *
+ *  @return BDM_RC_OK => success, error otherwise \n
+ *                                                \n
+ *   commandBuffer (TF_OP_END only)               \n
+ *    - [1..4]  =>  Address following last byte programmed in BIG-ENDIAN order
+ *                                                \n
+ *   commandBuffer (TF_OP_DELTA only)             \n
+ *    - [1..2]  =>  Number of changed sectors in BIG-ENDIAN order
+ *    - [3..N]  =>  Bitmap of changed sectors, bit n%8 of byte n/8 set => sector n needs programming
+ */
+USBDM_ErrorCode f_CMD_TARGET_FLASH(void) {
+   if (commandSize < 3) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   MemoryCache::invalidate();
+   switch (commandBuffer[2]) {
+      case TF_OP_START: {
+         if (commandSize < 13) {
+            return BDM_RC_ILLEGAL_PARAMS;
+         }
+         unsigned options           = commandBuffer[12];
+         uint32_t sectionRamAddress = 0;
+         unsigned sectionRamSize    = 0;
+         if (options&TF_OPTION_SECTION) {
+            if (commandSize < 19) {
+               return BDM_RC_ILLEGAL_PARAMS;
+            }
+            sectionRamAddress = pack32BE(commandBuffer+13);
+            sectionRamSize    = pack16BE(commandBuffer+17);
+         }
+         return TargetFlash::startProgramming(
+               pack32BE(commandBuffer+3), pack32BE(commandBuffer+7), commandBuffer[11],
+               options, sectionRamAddress, sectionRamSize);
+      }
+      case TF_OP_DATA:
+         return TargetFlash::programData(commandBuffer+3, commandSize-3);
+      case TF_OP_END: {
+         uint32_t nextAddress = 0;
+         USBDM_ErrorCode rc = TargetFlash::endProgramming(nextAddress);
+         unpack32BE(nextAddress, commandBuffer+1);
+         returnSize = 5;
+         return rc;
+      }
+      case TF_OP_ERASE:
+         if (commandSize < 15) {
+            return BDM_RC_ILLEGAL_PARAMS;
+         }
+         return TargetFlash::eraseRange(pack32BE(commandBuffer+3), pack32BE(commandBuffer+7), pack32BE(commandBuffer+11));
+      case TF_OP_DELTA: {
+         if ((commandSize < 16) || (((commandSize-12)%4) != 0)) {
+            return BDM_RC_ILLEGAL_PARAMS;
+         }
+         unsigned sectorCount  = (commandSize-12)/4;
+         unsigned changedCount = 0;
+         USBDM_ErrorCode rc = TargetFlash::compareSectors(
+               pack32BE(commandBuffer+4), pack32BE(commandBuffer+8), (CrcPreset_t)commandBuffer[3],
+               commandBuffer+12, sectorCount, commandBuffer+3, changedCount);
+         if (rc != BDM_RC_OK) {
+            return rc;
+         }
+         unpack16BE(changedCount, commandBuffer+1);
+         returnSize = 3+(sectorCount+7)/8;
+         return BDM_RC_OK;
+      }
+      default:
+         return BDM_RC_ILLEGAL_PARAMS;
+   }
+}
+
+/**  Target RAM Flash loader programming
+ *
+ *  @note
+ *   commandBuffer\n
+ *    - [2]     =>  Operation, see \ref FlashLoaderOp_t
+ *    - [3..N]  =>  Operation parameters
+ *
+ *   FL_OP_START \n
+ *    - [3]      =>  Mode, see \ref FlashLoaderMode_t
+ *    - [4..7]   =>  Loader entry point in BIG-ENDIAN order
+ *    - [8..11]  =>  Loader stack pointer in BIG-ENDIAN order
+ *    - [12..15] =>  Loader return address (BKPT instruction) in BIG-ENDIAN order
+ *    - [16..19] =>  Mailbox address in BIG-ENDIAN order (FL_MODE_MAILBOX only)
+ *    - [20..23] =>  Buffer A address in BIG-ENDIAN order
+ *    - [24..27] =>  Buffer B address in BIG-ENDIAN order
+ *    - [28..29] =>  Buffer size in BIG-ENDIAN order
+ *    - [30..33] =>  Flash address to start programming in BIG-ENDIAN order
+ *
+ *   FL_OP_DATA \n
+ *    - [3..N]   =>  Data to program
+ *
+ *  @return BDM_RC_OK => success, error otherwise \n
+ *                                                \n
+ *   commandBuffer (FL_OP_END only)               \n
+ *    - [1..4]  =>  Address following last byte programmed in BIG-ENDIAN order
+ */
+USBDM_ErrorCode f_CMD_FLASH_LOADER(void) {
+   if (commandSize < 3) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   MemoryCache::invalidate();
+   switch (commandBuffer[2]) {
+      case FL_OP_START:
+         if (commandSize < 34) {
+            return BDM_RC_ILLEGAL_PARAMS;
+         }
+         return FlashLoader::startLoader(
+               (FlashLoaderMode_t)commandBuffer[3],
+               pack32BE(commandBuffer+4),  pack32BE(commandBuffer+8),  pack32BE(commandBuffer+12),
+               pack32BE(commandBuffer+16), pack32BE(commandBuffer+20), pack32BE(commandBuffer+24),
+               pack16BE(commandBuffer+28), pack32BE(commandBuffer+30));
+      case FL_OP_DATA:
+         return FlashLoader::programData(commandBuffer+3, commandSize-3);
+      case FL_OP_END: {
+         uint32_t nextAddress = 0;
+         USBDM_ErrorCode rc = FlashLoader::endLoader(nextAddress);
+         unpack32BE(nextAddress, commandBuffer+1);
+         returnSize = 5;
+         return rc;
+      }
+      default:
+         return BDM_RC_ILLEGAL_PARAMS;
+   }
+}
+
 /**  Write ARM-SWD Memory
  *
  *  @note
  *   commandBuffer\n
- *    - [2]     =>  size of data elements
- *    - [3]     =>  # of bytes
+ *    - [2]     =>  size of data elements (+MS_SkipErased => destination is erased Flash, runs of 0xFF are skipped)
+ *    - [3]     =>  # of bytes (0 => remainder of command, for extended framing)
  *    - [4..7]  =>  Memory address in BIG-ENDIAN order
  *    - [8..N]  =>  Data to write
  *
  *  @return BDM_RC_OK => success, error otherwise
  */
 USBDM_ErrorCode f_CMD_WRITE_MEM(void) {
-   return Swd::writeMemory(commandBuffer[2], commandBuffer[3], pack32BE(commandBuffer+4), commandBuffer+8);
+   MemoryCache::invalidate();
+   uint32_t size = commandBuffer[3];
+   if (size == 0) {
+      if (commandSize <= 8) {
+         return BDM_RC_ILLEGAL_PARAMS;
+      }
+      size = commandSize-8;
+   }
+   if (commandBuffer[2]&MS_SkipErased) {
+      return Swd::writeMemorySkipErased(commandBuffer[2]&MS_SIZE, size, pack32BE(commandBuffer+4), commandBuffer+8);
+   }
+   return Swd::writeMemory(commandBuffer[2], size, pack32BE(commandBuffer+4), commandBuffer+8);
+}
+
+/**  Write compressed data to ARM-SWD Memory
+ *
+ *  @note
+ *   commandBuffer\n
+ *    - [2]     =>  size of data elements (+MS_SkipErased => destination is erased Flash)
+ *    - [3]     =>  reserved - must be zero
+ *    - [4..7]  =>  Memory address in BIG-ENDIAN order
+ *    - [8..N]  =>  Compressed data, see \ref CompressionToken_t
+ *
+ *  @return
+ *  BDM_RC_OK => success, error otherwise \n
+ *                                        \n
+ *   commandBuffer                        \n
+ *    - [1..4]  =>  Number of bytes written to target in BIG-ENDIAN order
+ */
+USBDM_ErrorCode f_CMD_WRITE_MEM_COMPRESSED(void) {
+   if ((commandSize <= 8) || (commandBuffer[3] != 0)) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   MemoryCache::invalidate();
+   uint32_t decodedSize = 0;
+   USBDM_ErrorCode rc = Swd::writeMemoryCompressed(
+         commandBuffer[2], pack32BE(commandBuffer+4), commandBuffer+8, commandSize-8, decodedSize);
+   unpack32BE(decodedSize, commandBuffer+1);
+   returnSize = 5;
+   return rc;
+}
+
+/** Size of chunks written to target when filling memory */
+static constexpr unsigned FILL_CHUNK_SIZE = 256;
+
+/** Feedback mask for maximal length 32-bit Galois LFSR (taps 32,31,29,1) */
+static constexpr uint32_t FILL_LFSR_TAPS = 0xD0000001;
+
+/**  Fill ARM-SWD Memory with a pattern
+ *
+ *  @note
+ *   commandBuffer\n
+ *    - [2]      =>  size of data elements
+ *    - [3]      =>  Mode, see \ref FillMode_t
+ *    - [4..7]   =>  Memory address in BIG-ENDIAN order
+ *    - [8..11]  =>  # of bytes in BIG-ENDIAN order (multiple of element size)
+ *
+ *   FILL_PATTERN \n
+ *    - [12]     =>  Pattern size (1, 2, 4 or 8)
+ *    - [13..N]  =>  Pattern in target memory order
+ *
+ *   FILL_INCREMENT \n
+ *    - [12..15] =>  Value of first element in BIG-ENDIAN order
+ *    - [16..19] =>  Increment in BIG-ENDIAN order
+ *
+ *   FILL_LFSR \n
+ *    - [12..15] =>  LFSR seed (non-zero) in BIG-ENDIAN order
+ *
+ *  @return BDM_RC_OK => success, error otherwise
+ *
+ *  @note The pattern is generated in chunks that do not cross a 1K boundary
+ *        so TAR is re-written at each auto-increment boundary
+ */
+USBDM_ErrorCode f_CMD_FILL_MEM(void) {
+   uint8_t buffer[FILL_CHUNK_SIZE];
+
+   if (commandSize < 12) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   MemoryCache::invalidate();
+   uint32_t elementSize = commandBuffer[2];
+   unsigned mode        = commandBuffer[3];
+   uint32_t address     = pack32BE(commandBuffer+4);
+   uint32_t size        = pack32BE(commandBuffer+8);
+   uint8_t  pattern[8];
+   unsigned patternSize = 0;
+   unsigned patternIndex= 0;
+   uint32_t value       = 0;
+   uint32_t increment   = 0;
+
+   if (((elementSize != MS_Byte) && (elementSize != MS_Word) && (elementSize != MS_Long)) ||
+       ((size&(elementSize-1)) != 0)) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   switch (mode) {
+      case FILL_PATTERN:
+         patternSize = (commandSize>12)?commandBuffer[12]:0;
+         if (((patternSize != 1) && (patternSize != 2) && (patternSize != 4) && (patternSize != 8)) ||
+             (commandSize < 13+patternSize)) {
+            return BDM_RC_ILLEGAL_PARAMS;
+         }
+         memcpy(pattern, commandBuffer+13, patternSize);
+         break;
+      case FILL_INCREMENT:
+         if (commandSize < 20) {
+            return BDM_RC_ILLEGAL_PARAMS;
+         }
+         value     = pack32BE(commandBuffer+12);
+         increment = pack32BE(commandBuffer+16);
+         break;
+      case FILL_LFSR:
+         if (commandSize < 16) {
+            return BDM_RC_ILLEGAL_PARAMS;
+         }
+         value = pack32BE(commandBuffer+12);
+         if (value == 0) {
+            return BDM_RC_ILLEGAL_PARAMS;
+         }
+         break;
+      default:
+         return BDM_RC_ILLEGAL_PARAMS;
+   }
+   while (size > 0) {
+      // Chunk must not cross TAR auto-increment boundary
+      uint32_t chunkSize = TAR_INCREMENT_BOUNDARY-(address&(TAR_INCREMENT_BOUNDARY-1));
+      if (chunkSize > FILL_CHUNK_SIZE) {
+         chunkSize = FILL_CHUNK_SIZE;
+      }
+      if (chunkSize > size) {
+         chunkSize = size;
+      }
+      if (mode == FILL_PATTERN) {
+         for (unsigned index=0; index<chunkSize; index++) {
+            buffer[index] = pattern[patternIndex];
+            patternIndex  = (patternIndex+1)&(patternSize-1);
+         }
+      }
+      else {
+         // Elements in target (little-endian) order
+         for (unsigned index=0; index<chunkSize; index+=elementSize) {
+            uint32_t element = value;
+            for (unsigned byte=0; byte<elementSize; byte++) {
+               buffer[index+byte] = (uint8_t)element;
+               element >>= 8;
+            }
+            if (mode == FILL_INCREMENT) {
+               value += increment;
+            }
+            else {
+               value = (value>>1)^((value&1)?FILL_LFSR_TAPS:0);
+            }
+         }
+      }
+      USBDM_ErrorCode rc = Swd::writeMemory(elementSize, chunkSize, address, buffer);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      address += chunkSize;
+      size    -= chunkSize;
+   }
+   return BDM_RC_OK;
+}
+
+/**  Configure target event monitor
+ *
+ *  @note
+ *   commandBuffer\n
+ *    - [2]  =>  Events to report, see \ref TargetEvent_t (0 => disable monitor)
+ *    - [3]  =>  Interval between samples of target state in ms
+ *
+ *  @return BDM_RC_OK => success, error otherwise
+ *
+ *  @note Events are reported on the event IN endpoint while the probe is idle
+ */
+USBDM_ErrorCode f_CMD_EVENT_MONITOR(void) {
+   if (commandSize < 4) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   return EventMonitor::configure(commandBuffer[2], commandBuffer[3]);
 }
 
 /**  Read ARM-SWD Memory
@@ -209,25 +715,277 @@ USBDM_ErrorCode f_CMD_WRITE_MEM(void) {
  *  @note
  *   commandBuffer\n
  *    - [2]     =>  size of data elements
- *    - [3]     =>  # of bytes
+ *    - [3]     =>  # of bytes (0 => use [8..9], for extended framing)
  *    - [4..7]  =>  Memory address in BIG-ENDIAN order
+ *    - [8..9]  =>  16-bit # of bytes in BIG-ENDIAN order (only if [3] is 0)
  *
  *  @return
  *  BDM_RC_OK => success, error otherwise \n
  *                                        \n
  *   commandBuffer                        \n
  *    - [1..N]  =>  Data read
+ *
+ *  @note DHCSR sticky bits cleared by the probe's own reads of DHCSR are included when DHCSR is read
  */
 USBDM_ErrorCode f_CMD_READ_MEM(void) {
    uint32_t size = commandBuffer[3];
-   USBDM_ErrorCode rc = Swd::readMemory(commandBuffer[2], commandBuffer[3], pack32BE(commandBuffer+4), commandBuffer+1);
+   if (size == 0) {
+      if (commandSize < 10) {
+         return BDM_RC_ILLEGAL_PARAMS;
+      }
+      size = pack16BE(commandBuffer+8);
+   }
+   if (size >= getMaxCommandSize()) {
+      // Requested block+status is too long to fit into the response
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   uint32_t address = pack32BE(commandBuffer+4);
+   USBDM_ErrorCode rc = MemoryCache::readMemory(commandBuffer[2], size, address, commandBuffer+1);
    if (rc == BDM_RC_OK) {
+      // Report DHCSR status bits cleared by background reads
+      mergeDhcsrStickyBits(address, size, commandBuffer+1);
       // Return size including status byte
       returnSize = size+1;
    }
    return rc;
 }
 
+/**  Control target memory read cache
+ *
+ *  @note
+ *   commandBuffer\n
+ *    - [2]     =>  Operation, see \ref MemCacheOp_t
+ *
+ *   MC_OP_SET_REGION \n
+ *    - [3]      =>  Region number (0..MEM_CACHE_REGIONS-1)
+ *    - [4..7]   =>  Start address in BIG-ENDIAN order
+ *    - [8..11]  =>  Size in BIG-ENDIAN order (0 => disable region)
+ *
+ *   MC_OP_GET_STATS \n
+ *    - [3]      =>  Non-zero => clear statistics after reading
+ *
+ *  @return BDM_RC_OK => success, error otherwise \n
+ *                                                \n
+ *   commandBuffer (MC_OP_GET_STATS only)         \n
+ *    - [1..4]  =>  Number of cache hits in BIG-ENDIAN order
+ *    - [5..8]  =>  Number of cache misses in BIG-ENDIAN order
+ */
+USBDM_ErrorCode f_CMD_MEM_CACHE(void) {
+   if (commandSize < 3) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   switch (commandBuffer[2]) {
+      case MC_OP_SET_REGION:
+         if (commandSize < 12) {
+            return BDM_RC_ILLEGAL_PARAMS;
+         }
+         return MemoryCache::setRegion(commandBuffer[3], pack32BE(commandBuffer+4), pack32BE(commandBuffer+8));
+      case MC_OP_INVALIDATE:
+         MemoryCache::invalidate();
+         return BDM_RC_OK;
+      case MC_OP_GET_STATS: {
+         uint32_t hits, misses;
+         MemoryCache::getStatistics(hits, misses);
+         if ((commandSize > 3) && (commandBuffer[3] != 0)) {
+            MemoryCache::clearStatistics();
+         }
+         unpack32BE(hits,   commandBuffer+1);
+         unpack32BE(misses, commandBuffer+5);
+         returnSize = 9;
+         return BDM_RC_OK;
+      }
+      default:
+         return BDM_RC_ILLEGAL_PARAMS;
+   }
+}
+
+/** Size of chunks read from target when verifying memory */
+static constexpr unsigned VERIFY_CHUNK_SIZE     = 256;
+
+/** Maximum number of mismatch offsets reported by CMD_USBDM_VERIFY_MEM */
+static constexpr unsigned VERIFY_MAX_MISMATCHES = 32;
+
+/**
+ * Compare CRCs of consecutive blocks of ARM-SWD Memory with expected values
+ *
+ *  @note
+ *   commandBuffer\n
+ *    - [2]      =>  0 (selects CRC form)
+ *    - [3]      =>  CRC to use, see CrcPreset_t (CRC_PRESET_CUSTOM not supported)
+ *    - [4..7]   =>  Memory address in BIG-ENDIAN order
+ *    - [8..11]  =>  Block size in BIG-ENDIAN order
+ *    - [12..N]  =>  Expected 32-bit CRC of each block in BIG-ENDIAN order
+ *
+ *  @return
+ *  BDM_RC_OK => success, error otherwise \n
+ *                                        \n
+ *   commandBuffer                        \n
+ *    - [1..2]  =>  Number of mismatching blocks in BIG-ENDIAN order (0 => verified)
+ *    - [3..N]  =>  16-bit indices of reported mismatching blocks in BIG-ENDIAN order
+ */
+static USBDM_ErrorCode verifyMemoryCrc() {
+   uint16_t mismatches[VERIFY_MAX_MISMATCHES];
+
+   if ((commandSize < 16) || (((commandSize-12)%4) != 0)) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   USBDM_ErrorCode rc = TargetCrc::configure((CrcPreset_t)commandBuffer[3]);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   uint32_t       address       = pack32BE(commandBuffer+4);
+   uint32_t       blockSize     = pack32BE(commandBuffer+8);
+   const uint8_t *expected      = commandBuffer+12;
+   unsigned       blockCount    = (commandSize-12)/4;
+   unsigned       mismatchCount = 0;
+
+   if (blockSize == 0) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   for (unsigned block=0; block<blockCount; block++) {
+      uint32_t crc;
+      rc = TargetCrc::calculateCrc(address, blockSize, crc);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      if (crc != pack32BE(expected+4*block)) {
+         if (mismatchCount < VERIFY_MAX_MISMATCHES) {
+            mismatches[mismatchCount] = block;
+         }
+         mismatchCount++;
+      }
+      address += blockSize;
+   }
+   unpack16BE(mismatchCount, commandBuffer+1);
+   uint8_t *outputPtr = commandBuffer+3;
+   for (unsigned index=0; (index<mismatchCount) && (index<VERIFY_MAX_MISMATCHES); index++) {
+      unpack16BE(mismatches[index], outputPtr);
+      outputPtr += 2;
+   }
+   returnSize = outputPtr-commandBuffer;
+   return BDM_RC_OK;
+}
+
+/**  Compare ARM-SWD Memory with data
+ *
+ *  @note
+ *   commandBuffer\n
+ *    - [2]     =>  size of data elements (0 => compare block CRCs, see verifyMemoryCrc())
+ *    - [3]     =>  maximum number of mismatch offsets to report (limited to VERIFY_MAX_MISMATCHES)
+ *    - [4..7]  =>  Memory address in BIG-ENDIAN order
+ *    - [8..N]  =>  Expected data
+ *
+ *  @return
+ *  BDM_RC_OK => success, error otherwise \n
+ *                                        \n
+ *   commandBuffer                        \n
+ *    - [1..2]  =>  Number of mismatching bytes in BIG-ENDIAN order (0 => verified)
+ *    - [3..N]  =>  16-bit offsets of reported mismatching bytes in BIG-ENDIAN order
+ *
+ *  @note Target memory is read in chunks and compared on the fly
+ */
+USBDM_ErrorCode f_CMD_VERIFY_MEM(void) {
+   uint8_t  readBuffer[VERIFY_CHUNK_SIZE];
+   uint16_t mismatches[VERIFY_MAX_MISMATCHES];
+
+   if (commandBuffer[2] == 0) {
+      return verifyMemoryCrc();
+   }
+   if (commandSize <= 8) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   uint32_t       elementSize   = commandBuffer[2];
+   unsigned       maxReported   = commandBuffer[3];
+   uint32_t       address       = pack32BE(commandBuffer+4);
+   const uint8_t *expected      = commandBuffer+8;
+   unsigned       size          = commandSize-8;
+   unsigned       mismatchCount = 0;
+
+   if (maxReported > VERIFY_MAX_MISMATCHES) {
+      maxReported = VERIFY_MAX_MISMATCHES;
+   }
+   for (unsigned offset=0, chunkSize=0; offset<size; offset+=chunkSize) {
+      // Chunk must not cross TAR auto-increment boundary
+      chunkSize = TAR_INCREMENT_BOUNDARY-((address+offset)&(TAR_INCREMENT_BOUNDARY-1));
+      if (chunkSize > VERIFY_CHUNK_SIZE) {
+         chunkSize = VERIFY_CHUNK_SIZE;
+      }
+      if (chunkSize > (size-offset)) {
+         chunkSize = size-offset;
+      }
+      USBDM_ErrorCode rc = Swd::readMemory(elementSize, chunkSize, address+offset, readBuffer);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      if (memcmp(readBuffer, expected+offset, chunkSize) == 0) {
+         continue;
+      }
+      for (unsigned index=0; index<chunkSize; index++) {
+         if (readBuffer[index] != expected[offset+index]) {
+            if (mismatchCount < maxReported) {
+               mismatches[mismatchCount] = offset+index;
+            }
+            mismatchCount++;
+         }
+      }
+   }
+   // Response overwrites expected data so is only written at end
+   unpack16BE(mismatchCount, commandBuffer+1);
+   uint8_t *outputPtr = commandBuffer+3;
+   for (unsigned index=0; (index<mismatchCount) && (index<maxReported); index++) {
+      unpack16BE(mismatches[index], outputPtr);
+      outputPtr += 2;
+   }
+   returnSize = outputPtr-commandBuffer;
+   return BDM_RC_OK;
+}
+
+/**  Calculate CRC of ARM-SWD Memory
+ *
+ *  @note
+ *   commandBuffer\n
+ *    - [2]       =>  CRC to use, see CrcPreset_t
+ *    - [3..6]    =>  Memory address in BIG-ENDIAN order
+ *    - [7..10]   =>  Size of range in bytes in BIG-ENDIAN order
+ *    - [11]      =>  Options, see CrcOptions_t (CRC_PRESET_CUSTOM only)
+ *    - [12..15]  =>  Polynomial in BIG-ENDIAN order (CRC_PRESET_CUSTOM only)
+ *    - [16..19]  =>  Seed in BIG-ENDIAN order (CRC_PRESET_CUSTOM only)
+ *
+ *  @return
+ *  BDM_RC_OK => success, error otherwise \n
+ *                                        \n
+ *   commandBuffer                        \n
+ *    - [1..4]  =>  CRC in BIG-ENDIAN order
+ *
+ *  @note Target memory is read in chunks and fed to the CRC hardware on the fly
+ */
+USBDM_ErrorCode f_CMD_CRC_MEM(void) {
+   if (commandSize < 11) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   CrcPreset_t preset = (CrcPreset_t)commandBuffer[2];
+   if (preset == CRC_PRESET_CUSTOM) {
+      if (commandSize < 20) {
+         return BDM_RC_ILLEGAL_PARAMS;
+      }
+      TargetCrc::configure(commandBuffer[11], pack32BE(commandBuffer+12), pack32BE(commandBuffer+16));
+   }
+   else {
+      USBDM_ErrorCode rc = TargetCrc::configure(preset);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+   }
+   uint32_t crc;
+   USBDM_ErrorCode rc = TargetCrc::calculateCrc(pack32BE(commandBuffer+3), pack32BE(commandBuffer+7), crc);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   unpack32BE(crc, commandBuffer+1);
+   returnSize = 5;
+   return BDM_RC_OK;
+}
+
 /** Maps register index into magic number for ARM device register */
 static const uint8_t regIndexMap[] = {
       ARM_RegR0, ARM_RegR1, ARM_RegR2,  ARM_RegR3,  ARM_RegR4,  ARM_RegR5, ARM_RegR6, ARM_RegR7,
@@ -283,6 +1041,48 @@ USBDM_ErrorCode f_CMD_READ_ALL_CORE_REGS(void) {
    return BDM_RC_OK;
 }
 
+/**  Write all core registers
+ *
+ *  @note
+ *   commandBuffer\n
+ *    - [2]     =>  flag - must be zero
+ *    - [3]     =>  register index to start at
+ *    - [4]     =>  register index to end at
+ *    - [5..N]  =>  32-bit register values (target format - LITTLE-ENDIAN)
+ *
+ *  @return BDM_RC_OK => success, error otherwise
+ *
+ *  @note Only registers that differ from the value held in the register cache are written
+ */
+USBDM_ErrorCode f_CMD_WRITE_ALL_CORE_REGS(void) {
+   if (commandBuffer[2] != 0) {
+      // Check flag is zero
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   unsigned regIndex    = commandBuffer[3];
+   unsigned endRegister = commandBuffer[4];
+   if ((endRegister < regIndex) || (endRegister >= USBDM::sizeofArray(regIndexMap)) ||
+       (commandSize < 5+4*(endRegister-regIndex+1))) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   const uint8_t *inputPtr = commandBuffer+5;
+   while (regIndex<=endRegister) {
+      uint32_t value = pack32LE(inputPtr);
+      uint32_t cachedValue;
+      if (!Swd::getCachedCoreRegister(regIndexMap[regIndex], cachedValue) || (cachedValue != value)) {
+         uint8_t regValue[4];
+         unpack32BE(value, regValue);
+         USBDM_ErrorCode rc = Swd::writeCoreReg(regIndexMap[regIndex], regValue);
+         if (rc != BDM_RC_OK) {
+            return rc;
+         }
+      }
+      inputPtr += 4;
+      regIndex++;
+   }
+   return BDM_RC_OK;
+}
+
 /**  Read ARM-SWD core register
  *
  *  @note
@@ -317,6 +1117,7 @@ USBDM_ErrorCode f_CMD_WRITE_REG(void) {
  *  @return BDM_RC_OK => success, error otherwise
  */
 USBDM_ErrorCode f_CMD_TARGET_STEP(void) {
+   MemoryCache::invalidate();
    // Preserve DHCSR_C_MASKINTS value
    return Swd::modifyDHCSR(DHCSR_C_MASKINTS, DHCSR_C_STEP|DHCSR_C_DEBUGEN);
 }
@@ -326,14 +1127,393 @@ USBDM_ErrorCode f_CMD_TARGET_STEP(void) {
  *  @return BDM_RC_OK => success, error otherwise
  */
 USBDM_ErrorCode f_CMD_TARGET_GO(void) {
+   MemoryCache::invalidate();
    return modifyDHCSR(DHCSR_C_MASKINTS, DHCSR_C_DEBUGEN);
 }
 
+/**  ARM-SWD -  Step target until PC leaves address range
+ *
+ *  @note
+ *   commandBuffer\n
+ *    - [2..5]   =>  Start of address range in BIG-ENDIAN order
+ *    - [6..9]   =>  End of address range (exclusive) in BIG-ENDIAN order
+ *    - [10..13] =>  Maximum number of steps in BIG-ENDIAN order (0 => illegal)
+ *
+ *  @return BDM_RC_OK => success, error otherwise \n
+ *                                                \n
+ *   commandBuffer                                \n
+ *    - [1..4]  =>  Final PC in BIG-ENDIAN order
+ *    - [5..8]  =>  Number of steps executed in BIG-ENDIAN order
+ *    - [9]     =>  Reason stepping stopped, see \ref RangeStepReason_t
+ */
+USBDM_ErrorCode f_CMD_RANGE_STEP(void) {
+   if (commandSize < 14) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   uint32_t start    = pack32BE(commandBuffer+2);
+   uint32_t end      = pack32BE(commandBuffer+6);
+   uint32_t maxSteps = pack32BE(commandBuffer+10);
+   if (maxSteps == 0) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   MemoryCache::invalidate();
+
+   uint32_t          pc;
+   uint32_t          steps;
+   RangeStepReason_t reason;
+   USBDM_ErrorCode rc = rangeStep(start, end, maxSteps, pc, steps, reason);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   unpack32BE(pc,    commandBuffer+1);
+   unpack32BE(steps, commandBuffer+5);
+   commandBuffer[9] = reason;
+   returnSize = 10;
+   return BDM_RC_OK;
+}
+
+/**  ARM-SWD -  PC sampling profiler
+ *
+ *  @note
+ *   commandBuffer\n
+ *    - [2]     =>  Operation, see \ref PcSampleOp_t
+ *
+ *   PS_OP_CONFIGURE \n
+ *    - [3..6]   =>  Address of first bucket in BIG-ENDIAN order
+ *    - [7]      =>  log2(bucket size in bytes)
+ *    - [8..9]   =>  Number of buckets in BIG-ENDIAN order
+ *    - [10..13] =>  Sample period in microseconds in BIG-ENDIAN order
+ *
+ *   PS_OP_READ \n
+ *    - [3..4]   =>  First bucket in BIG-ENDIAN order
+ *    - [5..6]   =>  Number of buckets in BIG-ENDIAN order
+ *
+ *  @return BDM_RC_OK => success, error otherwise \n
+ *                                                \n
+ *   commandBuffer (PS_OP_GET_STATUS)             \n
+ *    - [1]      =>  Non-zero if sampling
+ *    - [2..5]   =>  Number of samples in BIG-ENDIAN order
+ *    - [6..9]   =>  Number of samples outside histogram in BIG-ENDIAN order
+ *    - [10..13] =>  Number of samples without a PC (halted, sleeping, SWD failure) in BIG-ENDIAN order
+ *                                                \n
+ *   commandBuffer (PS_OP_READ)                   \n
+ *    - [1..2N]  =>  Bucket counts as 16-bit values in BIG-ENDIAN order (saturating)
+ */
+USBDM_ErrorCode f_CMD_PC_SAMPLE(void) {
+   if (commandSize < 3) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   switch (commandBuffer[2]) {
+      case PS_OP_CONFIGURE:
+         if (commandSize < 14) {
+            return BDM_RC_ILLEGAL_PARAMS;
+         }
+         return PcSampler::configure(
+               pack32BE(commandBuffer+3), commandBuffer[7], pack16BE(commandBuffer+8), pack32BE(commandBuffer+10));
+      case PS_OP_START:
+         return PcSampler::start();
+      case PS_OP_STOP:
+         PcSampler::stop();
+         return BDM_RC_OK;
+      case PS_OP_CLEAR:
+         PcSampler::clear();
+         return BDM_RC_OK;
+      case PS_OP_GET_STATUS: {
+         bool     running;
+         uint32_t totalCount, outsideCount, noPcCount;
+         PcSampler::getStatus(running, totalCount, outsideCount, noPcCount);
+         commandBuffer[1] = running;
+         unpack32BE(totalCount,   commandBuffer+2);
+         unpack32BE(outsideCount, commandBuffer+6);
+         unpack32BE(noPcCount,    commandBuffer+10);
+         returnSize = 14;
+         return BDM_RC_OK;
+      }
+      case PS_OP_READ: {
+         if (commandSize < 7) {
+            return BDM_RC_ILLEGAL_PARAMS;
+         }
+         unsigned count = pack16BE(commandBuffer+5);
+         if ((1+2*count) > getMaxCommandSize()) {
+            return BDM_RC_ILLEGAL_PARAMS;
+         }
+         USBDM_ErrorCode rc = PcSampler::readHistogram(pack16BE(commandBuffer+3), count, commandBuffer+1);
+         if (rc != BDM_RC_OK) {
+            return rc;
+         }
+         returnSize = 1+2*count;
+         return BDM_RC_OK;
+      }
+      default:
+         return BDM_RC_ILLEGAL_PARAMS;
+   }
+}
+
+/**  ARM-SWD -  Stream target RTT ring buffers over CDC
+ *
+ *  @note
+ *   commandBuffer\n
+ *    - [2]     =>  Operation, see \ref RttOp_t
+ *
+ *   RTT_OP_START \n
+ *    - [3..6]   =>  Address of control block or start of search region in BIG-ENDIAN order
+ *    - [7..10]  =>  Size of search region in BIG-ENDIAN order (0 => control block is at address)
+ *    - [11]     =>  Up channel streamed to CDC IN
+ *    - [12]     =>  Down channel receiving CDC OUT (RTT_NO_CHANNEL => none)
+ *    - [13..14] =>  Polling interval in ms in BIG-ENDIAN order
+ *
+ *  @return BDM_RC_OK => success, error otherwise \n
+ *                                                \n
+ *   commandBuffer (RTT_OP_GET_STATUS)            \n
+ *    - [1]      =>  Non-zero if active
+ *    - [2..5]   =>  Address of control block in BIG-ENDIAN order
+ *    - [6..9]   =>  Bytes transferred target -> host in BIG-ENDIAN order
+ *    - [10..13] =>  Bytes transferred host -> target in BIG-ENDIAN order
+ *    - [14..17] =>  Number of failed polls in BIG-ENDIAN order
+ *
+ *  @note While active the CDC interface is disconnected from the UART
+ */
+USBDM_ErrorCode f_CMD_RTT(void) {
+   if (commandSize < 3) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   switch (commandBuffer[2]) {
+      case RTT_OP_START:
+         if (commandSize < 15) {
+            return BDM_RC_ILLEGAL_PARAMS;
+         }
+         return TargetRtt::start(
+               pack32BE(commandBuffer+3), pack32BE(commandBuffer+7),
+               commandBuffer[11], commandBuffer[12], pack16BE(commandBuffer+13));
+      case RTT_OP_STOP:
+         TargetRtt::stop();
+         return BDM_RC_OK;
+      case RTT_OP_GET_STATUS: {
+         bool     active;
+         uint32_t controlBlock, upCount, downCount, errorCount;
+         TargetRtt::getStatus(active, controlBlock, upCount, downCount, errorCount);
+         commandBuffer[1] = active;
+         unpack32BE(controlBlock, commandBuffer+2);
+         unpack32BE(upCount,      commandBuffer+6);
+         unpack32BE(downCount,    commandBuffer+10);
+         unpack32BE(errorCount,   commandBuffer+14);
+         returnSize = 18;
+         return BDM_RC_OK;
+      }
+      default:
+         return BDM_RC_ILLEGAL_PARAMS;
+   }
+}
+
+/**  ARM-SWD -  Periodic sampling of target variables (live watch)
+ *
+ *  @note
+ *   commandBuffer\n
+ *    - [2]     =>  Operation, see \ref LiveWatchOp_t
+ *
+ *   LW_OP_CONFIGURE \n
+ *    - [3..6]   =>  Sample period in microseconds in BIG-ENDIAN order
+ *    - [7]      =>  Number of variables (N)
+ *    - [8..]    =>  N x 5 bytes: [0] size (1,2,4), [1..4] address in BIG-ENDIAN order
+ *
+ *  @return BDM_RC_OK => success, error otherwise \n
+ *                                                \n
+ *   commandBuffer (LW_OP_CONFIGURE)              \n
+ *    - [1..4]   =>  Timestamp frequency in Hz in BIG-ENDIAN order
+ *    - [5]      =>  Size of each record on the watch IN endpoint
+ *                                                \n
+ *   commandBuffer (LW_OP_GET_STATUS)             \n
+ *    - [1]      =>  Non-zero if sampling
+ *    - [2..5]   =>  Number of records sent in BIG-ENDIAN order
+ *    - [6..9]   =>  Number of samples dropped in BIG-ENDIAN order
+ *    - [10..13] =>  Number of samples failed in BIG-ENDIAN order
+ */
+USBDM_ErrorCode f_CMD_LIVE_WATCH(void) {
+   if (commandSize < 3) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   switch (commandBuffer[2]) {
+      case LW_OP_CONFIGURE: {
+         if ((commandSize < 8) || (commandSize < (8u+5u*commandBuffer[7]))) {
+            return BDM_RC_ILLEGAL_PARAMS;
+         }
+         USBDM_ErrorCode rc = LiveWatch::configure(pack32BE(commandBuffer+3), commandBuffer[7], commandBuffer+8);
+         if (rc != BDM_RC_OK) {
+            return rc;
+         }
+         unpack32BE(LiveWatch::getTimestampFrequency(), commandBuffer+1);
+         commandBuffer[5] = LiveWatch::getRecordSize();
+         returnSize = 6;
+         return BDM_RC_OK;
+      }
+      case LW_OP_START:
+         return LiveWatch::start();
+      case LW_OP_STOP:
+         LiveWatch::stop();
+         return BDM_RC_OK;
+      case LW_OP_GET_STATUS: {
+         bool     running;
+         uint32_t recordCount, droppedCount, errorCount;
+         LiveWatch::getStatus(running, recordCount, droppedCount, errorCount);
+         commandBuffer[1] = running;
+         unpack32BE(recordCount,  commandBuffer+2);
+         unpack32BE(droppedCount, commandBuffer+6);
+         unpack32BE(errorCount,   commandBuffer+10);
+         returnSize = 14;
+         return BDM_RC_OK;
+      }
+      default:
+         return BDM_RC_ILLEGAL_PARAMS;
+   }
+}
+
+/**  ARM-SWD -  Select fastest reliable SWD clock
+ *
+ *  @note
+ *   commandBuffer\n
+ *    - [2]     =>  Operation, see \ref AutoTuneOp_t
+ *
+ *   AT_OP_TUNE \n
+ *    - [3..6]   =>  Lowest frequency to try in Hz in BIG-ENDIAN order (must work)
+ *    - [7..10]  =>  Highest frequency to try in Hz in BIG-ENDIAN order
+ *    - [11]     =>  Number of steps below the fastest clean step to select
+ *    - [12..13] =>  Number of test bursts at each step in BIG-ENDIAN order
+ *    - [14]     =>  Link errors per 100 ms causing an automatic step down (0 => none)
+ *
+ *  @return BDM_RC_OK => success, error otherwise \n
+ *                                                \n
+ *   commandBuffer (AT_OP_TUNE)                   \n
+ *    - [1..4]   =>  Selected frequency in Hz in BIG-ENDIAN order
+ *    - [5]      =>  Number of steps tested
+ *    - [6]      =>  Number of steps passing
+ *                                                \n
+ *   commandBuffer (AT_OP_GET_STATUS)             \n
+ *    - [1..4]   =>  Current frequency in Hz in BIG-ENDIAN order
+ *    - [5..8]   =>  Link error count in BIG-ENDIAN order
+ *    - [9]      =>  Number of automatic step downs
+ */
+USBDM_ErrorCode f_CMD_SWD_AUTOTUNE(void) {
+   if (commandSize < 3) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   switch (commandBuffer[2]) {
+      case AT_OP_TUNE: {
+         if (commandSize < 15) {
+            return BDM_RC_ILLEGAL_PARAMS;
+         }
+         uint32_t frequency;
+         unsigned stepsTested, stepsPassed;
+         USBDM_ErrorCode rc = LinkTuner::tune(
+               pack32BE(commandBuffer+3), pack32BE(commandBuffer+7), commandBuffer[11],
+               pack16BE(commandBuffer+12), commandBuffer[14], frequency, stepsTested, stepsPassed);
+         if (rc != BDM_RC_OK) {
+            return rc;
+         }
+         unpack32BE(frequency, commandBuffer+1);
+         commandBuffer[5] = stepsTested;
+         commandBuffer[6] = stepsPassed;
+         returnSize = 7;
+         return BDM_RC_OK;
+      }
+      case AT_OP_GET_STATUS:
+         unpack32BE(Swd::getSpeed(),          commandBuffer+1);
+         unpack32BE(Swd::getLinkErrorCount(), commandBuffer+5);
+         commandBuffer[9] = LinkTuner::getStepDownCount();
+         returnSize = 10;
+         return BDM_RC_OK;
+      default:
+         return BDM_RC_ILLEGAL_PARAMS;
+   }
+}
+
+/**  ARM-SWD -  Set WAIT handling and streaming writes
+ *
+ *  @note
+ *   commandBuffer\n
+ *    - [2..3]   =>  Maximum retries after WAIT in BIG-ENDIAN order (0 => limited by timeout only)
+ *    - [4..5]   =>  Idle cycles inserted before each retry in BIG-ENDIAN order
+ *    - [6..9]   =>  Maximum time to retry in microseconds in BIG-ENDIAN order (0 => limited by retries only)
+ *    - [10]     =>  Options, see \ref SwdLinkOptions_t (optional, 0 if absent)
+ *
+ *  @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode f_CMD_SWD_LINK_OPTIONS(void) {
+   if (commandSize < 10) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   USBDM_ErrorCode rc = Swd::setWaitPolicy(pack16BE(commandBuffer+2), pack16BE(commandBuffer+4), pack32BE(commandBuffer+6));
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   uint8_t options = (commandSize > 10)?commandBuffer[10]:0;
+   Swd::setStreamingWrites((options&SLO_STREAMING_WRITES) != 0);
+   return BDM_RC_OK;
+}
+
+/**  ARM-SWD -  Enumerate and select Access Ports
+ *
+ *  @note
+ *   commandBuffer\n
+ *    - [2]     =>  Operation, see \ref AccessPortOp_t
+ *
+ *   AP_OP_SELECT \n
+ *    - [3]     =>  AP # used by following memory and core register commands
+ *
+ *  @return BDM_RC_OK => success, error otherwise \n
+ *                                                \n
+ *   commandBuffer (AP_OP_ENUMERATE)              \n
+ *    - [1]     =>  Number of APs found
+ *    - [2..]   =>  For each AP: IDR, BASE and CPUID (0 if no Cortex-M core) in BIG-ENDIAN order
+ *                                                \n
+ *   commandBuffer (AP_OP_GET_SELECTED)           \n
+ *    - [1]     =>  Selected AP #
+ */
+USBDM_ErrorCode f_CMD_ACCESS_PORT(void) {
+   if (commandSize < 3) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   switch (commandBuffer[2]) {
+      case AP_OP_ENUMERATE: {
+         ApDescription aps[SWD_MAX_APS];
+         unsigned count;
+         USBDM_ErrorCode rc = enumerateAps(aps, count);
+         if (rc != BDM_RC_OK) {
+            return rc;
+         }
+         uint8_t *bufferPtr = commandBuffer+2;
+         for (unsigned index=0; index<count; index++) {
+            unpack32BE(aps[index].idr,   bufferPtr);   bufferPtr += 4;
+            unpack32BE(aps[index].base,  bufferPtr);   bufferPtr += 4;
+            unpack32BE(aps[index].cpuid, bufferPtr);   bufferPtr += 4;
+         }
+         commandBuffer[1] = count;
+         returnSize = bufferPtr-commandBuffer;
+         return BDM_RC_OK;
+      }
+      case AP_OP_SELECT:
+         if (commandSize < 4) {
+            return BDM_RC_ILLEGAL_PARAMS;
+         }
+         if (commandBuffer[3] != getSelectedAp()) {
+            // Cached memory belongs to the previous core's view
+            MemoryCache::invalidate();
+         }
+         return selectAp(commandBuffer[3]);
+      case AP_OP_GET_SELECTED:
+         commandBuffer[1] = getSelectedAp();
+         returnSize = 2;
+         return BDM_RC_OK;
+      default:
+         return BDM_RC_ILLEGAL_PARAMS;
+   }
+}
+
 /* ARM-SWD -  Stop the target
  *
  *  @return BDM_RC_OK => success, error otherwise
  */
 USBDM_ErrorCode f_CMD_TARGET_HALT(void) {
+   MemoryCache::invalidate();
    return modifyDHCSR(DHCSR_C_MASKINTS, DHCSR_C_HALT|DHCSR_C_DEBUGEN);
 }
 
@@ -31,6 +31,23 @@ USBDM_ErrorCode f_CMD_WRITE_DREG(void);
 USBDM_ErrorCode f_CMD_READ_DREG(void);
 USBDM_ErrorCode f_CMD_WRITE_CREG(void);
 USBDM_ErrorCode f_CMD_READ_CREG(void);
+USBDM_ErrorCode f_CMD_DAP_TRANSFER(void);
+USBDM_ErrorCode f_CMD_TARGET_FLASH(void);
+USBDM_ErrorCode f_CMD_FLASH_LOADER(void);
+USBDM_ErrorCode f_CMD_VERIFY_MEM(void);
+USBDM_ErrorCode f_CMD_CRC_MEM(void);
+USBDM_ErrorCode f_CMD_WRITE_MEM_COMPRESSED(void);
+USBDM_ErrorCode f_CMD_FILL_MEM(void);
+USBDM_ErrorCode f_CMD_EVENT_MONITOR(void);
+USBDM_ErrorCode f_CMD_WRITE_ALL_CORE_REGS(void);
+USBDM_ErrorCode f_CMD_MEM_CACHE(void);
+USBDM_ErrorCode f_CMD_RANGE_STEP(void);
+USBDM_ErrorCode f_CMD_PC_SAMPLE(void);
+USBDM_ErrorCode f_CMD_RTT(void);
+USBDM_ErrorCode f_CMD_LIVE_WATCH(void);
+USBDM_ErrorCode f_CMD_SWD_AUTOTUNE(void);
+USBDM_ErrorCode f_CMD_SWD_LINK_OPTIONS(void);
+USBDM_ErrorCode f_CMD_ACCESS_PORT(void);
 
 }; // End namespace Swd
 
@@ -31,7 +31,8 @@
 
 #include "USBDM_ErrorMessages.h"
 
-static constexpr int  MAX_COMMAND_SIZE = 254;
+static constexpr int  MAX_COMMAND_SIZE           = 254;  //!< Maximum size of command/response using legacy framing
+static constexpr int  EXTENDED_FRAME_HEADER_SIZE = 2;    //!< Size of 16-bit length prefix used by extended framing
 
 //! BDM command values
 //!
@@ -47,7 +48,7 @@ enum BDMCommands {
    CMD_USBDM_SET_VDD                     = 2,   //!< Set target Vdd (immediate effect)
    CMD_USBDM_DEBUG                       = 3,   //!< Debugging commands (parameter determines actual command) @param [2]  Debug command see DebugSubCommands
    CMD_USBDM_GET_BDM_STATUS              = 4,   //!< Get BDM status\n @return [1] 16-bit status value reflecting BDM status
-   CMD_USBDM_GET_CAPABILITIES            = 5,   //!< Get capabilities of BDM, see HardwareCapabilities_t
+   CMD_USBDM_GET_CAPABILITIES            = 5,   //!< Get capabilities of BDM, see HardwareCapabilities_t @param [2] Optional framing request see FramingOptions_t
    CMD_USBDM_SET_OPTIONS                 = 6,   //!< Set BDM options, see BDM_Options_t
 //   CMD_USBDM_GET_SETTINGS              = 7,   //!< Get BDM setting
    CMD_USBDM_CONTROL_PINS                = 8,   //!< Directly control BDM interface levels
@@ -109,8 +110,258 @@ enum BDMCommands {
    CMD_USBDM_SET_VPP                     = 42,  //!< Set VPP level
    CMD_USBDM_JTAG_READ_WRITE             = 43,  //!< Read & Write to JTAG chain (in-out buffer)
    CMD_USBDM_JTAG_EXECUTE_SEQUENCE       = 44,  //!< Execute sequence of JTAG commands
+
+   CMD_USBDM_DAP_TRANSFER                = 45,  //!< Execute a list of DP/AP register operations, see DapTransferOp_t
+   CMD_USBDM_TARGET_FLASH                = 46,  //!< Kinetis target Flash programming, @param [2] Operation see TargetFlashOp_t
+   CMD_USBDM_FLASH_LOADER                = 47,  //!< Target RAM Flash loader programming, @param [2] Operation see FlashLoaderOp_t
+   CMD_USBDM_VERIFY_MEM                  = 48,  //!< Compare target memory with data, @return [1..2] mismatch count, [3..N] mismatch offsets
+   CMD_USBDM_CRC_MEM                     = 49,  //!< Calculate CRC of target memory range, @param [2] CRC see CrcPreset_t, @return [1..4] CRC
+   CMD_USBDM_WRITE_MEM_COMPRESSED        = 50,  //!< Write compressed data to target memory, see CompressionToken_t, @return [1..4] decoded size
+   CMD_USBDM_FILL_MEM                    = 51,  //!< Fill target memory with pattern, @param [3] Mode see FillMode_t
+   CMD_USBDM_EVENT_MONITOR               = 52,  //!< Configure target event monitor, @param [2] events see TargetEvent_t, [3] interval (ms)
+   CMD_USBDM_WRITE_ALL_CORE_REGS         = 53,  //!< Write range of core registers (inverse of CMD_USBDM_READ_ALL_CORE_REGS)
+   CMD_USBDM_MEM_CACHE                   = 54,  //!< Control target memory read cache, @param [2] Operation see MemCacheOp_t
+   CMD_USBDM_RANGE_STEP                  = 55,  //!< Single-step target until PC leaves address range, @return [9] Reason see RangeStepReason_t
+   CMD_USBDM_PC_SAMPLE                   = 56,  //!< PC sampling profiler, @param [2] Operation see PcSampleOp_t
+   CMD_USBDM_RTT                         = 57,  //!< Stream target RTT buffers over CDC, @param [2] Operation see RttOp_t
+   CMD_USBDM_LIVE_WATCH                  = 58,  //!< Periodic sampling of target variables, @param [2] Operation see LiveWatchOp_t
+   CMD_USBDM_SWD_AUTOTUNE                = 59,  //!< Select fastest reliable SWD clock, @param [2] Operation see AutoTuneOp_t
+   CMD_USBDM_SWD_LINK_OPTIONS            = 60,  //!< Set WAIT handling and streaming writes, @param [2..3] retries, [4..5] idle cycles, [6..9] timeout us, [10] SwdLinkOptions_t (optional)
+   CMD_USBDM_ACCESS_PORT                 = 61,  //!< Enumerate and select Access Ports, @param [2] Operation see AccessPortOp_t
+};
+
+
+//! Operation byte for each entry in CMD_USBDM_DAP_TRANSFER
+//!
+//! Each operation byte is followed by a 32-bit value in BIG-ENDIAN order
+//! for DAP_OP_WRITE, DAP_OP_MATCH and DAP_OP_SET_MASK operations.
+//!
+enum DapTransferOp_t {
+   DAP_OP_REG_MASK   = 0x07,     //!< Register index as used by CMD_USBDM_READ_DREG/CMD_USBDM_WRITE_DREG (0-3 => DP, 4-7 => AP)
+   DAP_OP_WRITE      = (0<<3),   //!< Write register
+   DAP_OP_READ       = (1<<3),   //!< Read register (AP reads are completed using DP.RDBUFF)
+   DAP_OP_MATCH      = (1<<4),   //!< Read register until (value&mask)==match value (with DAP_OP_READ)
+   DAP_OP_SET_MASK   = (1<<5),   //!< Set mask for later DAP_OP_MATCH operations (no register access)
+};
+
+//! Operations for CMD_USBDM_TARGET_FLASH
+//!
+enum TargetFlashOp_t {
+   TF_OP_START   = 0,   //!< Start programming, @param [3..6] address, [7..10] sector size, [11] phrase size, [12] options see TargetFlashOptions_t,
+                        //!< [13..16] acceleration RAM address, [17..18] acceleration RAM size (TF_OPTION_SECTION only)
+   TF_OP_DATA    = 1,   //!< Program data at current address, @param [3..N] data
+   TF_OP_END     = 2,   //!< Complete programming (pad final phrase with 0xFF), @return [1..4] address following last byte programmed
+   TF_OP_ERASE   = 3,   //!< Erase sectors, @param [3..6] address, [7..10] size, [11..14] sector size
+   TF_OP_DELTA   = 4,   //!< Compare sector CRCs, @param [3] CRC see CrcPreset_t, [4..7] address, [8..11] sector size, [12..N] sector CRCs,
+                        //!< @return [1..2] changed sector count, [3..N] bitmap of changed sectors
+};
+
+//! Options for TF_OP_START
+//!
+enum TargetFlashOptions_t {
+   TF_OPTION_ERASE    = (1<<0),  //!< Erase each sector as it is entered
+   TF_OPTION_SECTION  = (1<<1),  //!< Use Program Section command via target programming acceleration RAM
+   TF_OPTION_DELTA    = (1<<2),  //!< Skip sectors found unchanged by preceding TF_OP_DELTA
+};
+
+static constexpr unsigned DELTA_MAX_SECTORS = 1024;  //!< Maximum number of sectors compared by TF_OP_DELTA
+
+//! Operations for CMD_USBDM_FLASH_LOADER
+//!
+enum FlashLoaderOp_t {
+   FL_OP_START   = 0,   //!< Start loader, @param [3] mode see FlashLoaderMode_t, [4..7] entry, [8..11] stack, [12..15] return address,
+                        //!< [16..19] mailbox, [20..23] buffer A, [24..27] buffer B, [28..29] buffer size, [30..33] Flash address
+   FL_OP_DATA    = 1,   //!< Stream data to loader, @param [3..N] data
+   FL_OP_END     = 2,   //!< Complete programming, @return [1..4] address following last byte programmed
+};
+
+//! Method used to invoke Flash loader
+//!
+enum FlashLoaderMode_t {
+   FL_MODE_BKPT     = 0,   //!< Loader called for each buffer, returns to a BKPT instruction (R0 = status)
+   FL_MODE_MAILBOX  = 1,   //!< Loader runs continuously and polls mailbox in target RAM
 };
 
+//! Layout of mailbox in target RAM used by FL_MODE_MAILBOX
+//!
+//! The probe writes address, buffer and size and then sets status to FL_MAILBOX_BUSY.\n
+//! The loader programs the buffer and sets status to 0 (success) or an error value.
+//!
+struct FlashLoaderMailbox_t {
+   uint32_t address;   //!< Flash address to program
+   uint32_t buffer;    //!< Address of data buffer
+   uint32_t size;      //!< Number of bytes to program
+   uint32_t status;    //!< Status, see FL_MAILBOX_BUSY
+};
+
+static constexpr uint32_t FL_MAILBOX_BUSY = 0xFFFFFFFF;  //!< Mailbox status while loader is busy
+
+//! CRCs available for CMD_USBDM_CRC_MEM and CMD_USBDM_VERIFY_MEM
+//!
+enum CrcPreset_t {
+   CRC_PRESET_CRC32               = 0,   //!< CRC-32 (Ethernet, zlib)
+   CRC_PRESET_CRC32_MPEG2         = 1,   //!< CRC-32/MPEG-2
+   CRC_PRESET_CRC16_CCITT_FALSE   = 2,   //!< CRC-16/CCITT-FALSE
+   CRC_PRESET_CRC16_ARC           = 3,   //!< CRC-16/ARC
+   CRC_PRESET_CUSTOM              = 0xFF,//!< Custom CRC, see CrcOptions_t
+};
+
+//! Options for CRC_PRESET_CUSTOM
+//!
+enum CrcOptions_t {
+   CRC_OPTION_32BIT        = (1<<0),   //!< 32-bit CRC (otherwise 16-bit)
+   CRC_OPTION_REFLECT      = (1<<1),   //!< Reflected input and output
+   CRC_OPTION_COMPLEMENT   = (1<<2),   //!< Complement result
+};
+
+//! Token types in data for CMD_USBDM_WRITE_MEM_COMPRESSED
+//!
+//! Each token byte is followed by its operands:\n
+//!  - CT_LITERAL  : (token+1) bytes to copy
+//!  - CT_RUN      : value byte, repeated (token&CT_LENGTH_MASK)+CT_MIN_LENGTH times.
+//!                  If the length field is all ones a 16-bit BIG-ENDIAN length precedes the value byte
+//!  - CT_MATCH    : offset byte, copy (token&CT_LENGTH_MASK)+CT_MIN_LENGTH bytes from (offset+1) bytes earlier in output
+//!
+enum CompressionToken_t {
+   CT_LITERAL       = 0x00,   //!< Literal bytes (token 0x00-0x7F)
+   CT_RUN           = 0x80,   //!< Run of a single byte value
+   CT_MATCH         = 0xC0,   //!< Copy of earlier output (within 256 bytes)
+   CT_TYPE_MASK     = 0xC0,   //!< Mask for token type (CT_RUN, CT_MATCH, otherwise literal)
+   CT_LENGTH_MASK   = 0x3F,   //!< Mask for length in CT_RUN and CT_MATCH tokens
+   CT_MIN_LENGTH    = 3,      //!< Length offset for CT_RUN and CT_MATCH tokens
+};
+
+//! Patterns for CMD_USBDM_FILL_MEM
+//!
+enum FillMode_t {
+   FILL_PATTERN     = 0,   //!< Repeated 1, 2, 4 or 8 byte pattern, @param [12] pattern size, [13..N] pattern in target memory order
+   FILL_INCREMENT   = 1,   //!< Incrementing elements, @param [12..15] start value, [16..19] increment
+   FILL_LFSR        = 2,   //!< Pseudo-random elements from 32-bit LFSR, @param [12..15] seed (non-zero)
+};
+
+//! Target events reported on the event IN endpoint, see CMD_USBDM_EVENT_MONITOR
+//!
+//! Each event record is 8 bytes:\n
+//!  - [0]     Events, see TargetEvent_t
+//!  - [1]     Sequence number (incremented for each record)
+//!  - [2..3]  USB frame number (ms) of sample in BIG-ENDIAN order
+//!  - [4..7]  DHCSR value at sample in BIG-ENDIAN order
+//!
+enum TargetEvent_t {
+   EVENT_HALT        = (1<<0),   //!< Target halted (DHCSR.S_HALT set)
+   EVENT_LOCKUP      = (1<<1),   //!< Target locked up (DHCSR.S_LOCKUP set)
+   EVENT_RESET       = (1<<2),   //!< Target reset (DHCSR.S_RESET_ST or RESET pin activity)
+   EVENT_VDD_LOSS    = (1<<3),   //!< Target Vdd lost
+   EVENT_RUNNING     = (1<<4),   //!< Target resumed execution (DHCSR.S_HALT cleared)
+   EVENT_SWD_ERROR   = (1<<5),   //!< Target stopped responding over SWD
+};
+
+//! Operations for CMD_USBDM_MEM_CACHE
+//!
+enum MemCacheOp_t {
+   MC_OP_SET_REGION   = 0,   //!< Set cacheable region, @param [3] region, [4..7] address, [8..11] size (0 => disable region)
+   MC_OP_INVALIDATE   = 1,   //!< Invalidate cache
+   MC_OP_GET_STATS    = 2,   //!< Get statistics, @param [3] non-zero => clear after reading, @return [1..4] hits, [5..8] misses
+};
+
+static constexpr unsigned MEM_CACHE_REGIONS = 4;  //!< Number of cacheable regions for CMD_USBDM_MEM_CACHE
+
+//! Reason range stepping stopped, see CMD_USBDM_RANGE_STEP
+//!
+enum RangeStepReason_t {
+   RS_LEFT_RANGE    = 0,   //!< PC left the address range
+   RS_MAX_STEPS     = 1,   //!< Maximum number of steps reached
+   RS_BREAKPOINT    = 2,   //!< Halted on breakpoint, watchpoint or vector catch
+};
+
+//! Operations for CMD_USBDM_PC_SAMPLE
+//!
+enum PcSampleOp_t {
+   PS_OP_CONFIGURE    = 0,   //!< Configure and clear, @param [3..6] base address, [7] log2(bucket size), [8..9] bucket count, [10..13] period in us
+   PS_OP_START        = 1,   //!< Start sampling
+   PS_OP_STOP         = 2,   //!< Stop sampling
+   PS_OP_CLEAR        = 3,   //!< Clear histogram and counts
+   PS_OP_GET_STATUS   = 4,   //!< Get status, @return [1] running, [2..5] samples, [6..9] outside range, [10..13] no PC
+   PS_OP_READ         = 5,   //!< Read histogram, @param [3..4] first bucket, [5..6] bucket count, @return [1..2N] 16-bit counts
+};
+
+static constexpr unsigned PC_SAMPLE_MAX_BUCKETS   = 256;     //!< Maximum number of histogram buckets for CMD_USBDM_PC_SAMPLE
+static constexpr unsigned PC_SAMPLE_MIN_PERIOD_US = 20;      //!< Minimum sample period for CMD_USBDM_PC_SAMPLE
+static constexpr unsigned PC_SAMPLE_MAX_PERIOD_US = 1000000; //!< Maximum sample period for CMD_USBDM_PC_SAMPLE
+
+//! Operations for CMD_USBDM_RTT
+//!
+enum RttOp_t {
+   RTT_OP_START       = 0,   //!< Start, @param [3..6] address, [7..10] search size (0 => exact), [11] up channel, [12] down channel, [13..14] interval ms
+   RTT_OP_STOP        = 1,   //!< Stop and return CDC to UART
+   RTT_OP_GET_STATUS  = 2,   //!< Get status, @return [1] active, [2..5] control block, [6..9] up bytes, [10..13] down bytes, [14..17] errors
+};
+
+static constexpr unsigned RTT_NO_CHANNEL = 0xFF;  //!< Down channel value for CMD_USBDM_RTT indicating no down-buffer
+
+//! Operations for CMD_USBDM_LIVE_WATCH
+//!
+enum LiveWatchOp_t {
+   LW_OP_CONFIGURE    = 0,   //!< Configure, @param [3..6] period in us, [7] count, [8..] 5 bytes each: size, address, @return [1..4] timestamp Hz, [5] record size
+   LW_OP_START        = 1,   //!< Start sampling
+   LW_OP_STOP         = 2,   //!< Stop sampling
+   LW_OP_GET_STATUS   = 3,   //!< Get status, @return [1] running, [2..5] records, [6..9] dropped, [10..13] errors
+};
+
+static constexpr unsigned LIVE_WATCH_MAX_VARIABLES = 16;   //!< Maximum number of variables for CMD_USBDM_LIVE_WATCH
+static constexpr unsigned LIVE_WATCH_MIN_PERIOD_US = 100;  //!< Minimum sample period for CMD_USBDM_LIVE_WATCH
+
+//! Operations for CMD_USBDM_ACCESS_PORT
+//!
+enum AccessPortOp_t {
+   AP_OP_ENUMERATE    = 0,   //!< Enumerate APs, @return [1] count, [2..] 12 bytes/AP: IDR, BASE, CPUID (0 => no core)
+   AP_OP_SELECT       = 1,   //!< Select MEM-AP for memory & core register commands, @param [3] AP #
+   AP_OP_GET_SELECTED = 2,   //!< Get selected MEM-AP, @return [1] AP #
+};
+
+//! Flags for CMD_USBDM_SWD_LINK_OPTIONS
+//!
+enum SwdLinkOptions_t {
+   SLO_STREAMING_WRITES = (1<<0),   //!< DMA block writes are not ACK checked - STICKYORUN is checked once at the end
+};
+
+//! Operations for CMD_USBDM_SWD_AUTOTUNE
+//!
+enum AutoTuneOp_t {
+   AT_OP_TUNE         = 0,   //!< Tune, @param [3..6] min Hz, [7..10] max Hz, [11] margin steps, [12..13] bursts, [14] error threshold
+   AT_OP_GET_STATUS   = 1,   //!< Get status, @return [1..4] current Hz, [5..8] link errors, [9] automatic step downs
+};
+
+//! Optional firmware features reported by CMD_USBDM_GET_CAPABILITIES
+//!
+enum FirmwareFeatures_t {
+   FEATURE_NONE               = 0,
+   FEATURE_COMPRESSED_WRITE   = (1<<0),   //!< Supports CMD_USBDM_WRITE_MEM_COMPRESSED
+   FEATURE_FILL_MEM           = (1<<1),   //!< Supports CMD_USBDM_FILL_MEM
+   FEATURE_EVENT_MONITOR      = (1<<2),   //!< Supports CMD_USBDM_EVENT_MONITOR and event IN endpoint
+   FEATURE_MEM_CACHE          = (1<<3),   //!< Supports CMD_USBDM_MEM_CACHE
+   FEATURE_RANGE_STEP         = (1<<4),   //!< Supports CMD_USBDM_RANGE_STEP
+   FEATURE_PC_SAMPLE          = (1<<5),   //!< Supports CMD_USBDM_PC_SAMPLE
+   FEATURE_RTT                = (1<<6),   //!< Supports CMD_USBDM_RTT
+   FEATURE_LIVE_WATCH         = (1<<7),   //!< Supports CMD_USBDM_LIVE_WATCH and watch IN endpoint
+   FEATURE_SWD_AUTOTUNE       = (1<<8),   //!< Supports CMD_USBDM_SWD_AUTOTUNE
+   FEATURE_SWD_LINK_OPTIONS   = (1<<9),   //!< Supports CMD_USBDM_SWD_LINK_OPTIONS
+   FEATURE_ACCESS_PORT        = (1<<10),  //!< Supports CMD_USBDM_ACCESS_PORT (multi-AP targets)
+};
+
+//! Framing options requested by CMD_USBDM_GET_CAPABILITIES
+//!
+//! Legacy framing limits a command or response to MAX_COMMAND_SIZE bytes.\n
+//! Extended framing prefixes each command and response with a 16-bit BIG-ENDIAN length
+//! (excluding the prefix) and may span multiple USB packets up to the extended size
+//! reported by CMD_USBDM_GET_CAPABILITIES. Each transfer is terminated by a short packet or ZLP.\n
+//! The new framing applies to commands following the CMD_USBDM_GET_CAPABILITIES response.
+//! A legacy command (or a CMD_USBDM_GET_CAPABILITIES without this request) reverts to legacy framing.
+//!
+enum FramingOptions_t {
+   FRAMING_LEGACY     = 0,        //!< Legacy framing - 8-bit length
+   FRAMING_EXTENDED   = (1<<0),   //!< Extended framing - 16-bit length prefix
+};
 
 //! Capabilities of the hardware
 //!
@@ -164,6 +415,8 @@ enum MemorySpace_t {
    MS_Byte     = 1,        //! Byte (8-bit) access
    MS_Word     = 2,        //! Word (16-bit) access
    MS_Long     = 4,        //! Long (32-bit) access
+   // Optional
+   MS_SkipErased = 1<<3,   //! ARM - Flash destination known to be erased, runs of 0xFF are not written
    // One of the following
    MS_None     = 0<<4,     //! Memory space unused/undifferentiated
    MS_Program  = 1<<4,     //! Program memory space (e.g. P: on DSC)
@@ -857,6 +1110,8 @@ enum DebugSubCommands {
 
   BDM_DBG_SERIAL_ON        = 21,
   BDM_DBG_SERIAL_OFF       = 22,
+  BDM_DBG_SWD_STATISTICS   = 23, //!< - Read & clear SWD link statistics
+  BDM_DBG_COMMAND_LATENCY  = 24, //!< - Read & clear command execution time histogram @param [3] Command
 
 };
 
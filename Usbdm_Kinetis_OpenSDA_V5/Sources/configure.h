@@ -139,6 +139,13 @@
 #define TARGET_CAPABILITY   (CAP_RST   |CAP_ARM_SWD|CAP_CDC)
 #endif
 
+//==========================================================================================
+// Optional firmware features
+//
+#define SWD_DMA_TRANSFERS      (1)        //!< Use DMA for SWD memory block transfers (see Swd::readMemory(), Swd::writeMemory())
+#define EXTENDED_COMMAND_SIZE  (4096+8)   //!< Size of command buffer when extended framing is negotiated (see CMD_USBDM_GET_CAPABILITIES)
+#define COMMAND_RECEIVE_SIZE   (512)      //!< Size of buffer receiving the next command while the current one executes (see commandLoop())
+
 #define CPU  MK20D5
 
 #define VERSION_HW  (HW_ARM+TARGET_HARDWARE)
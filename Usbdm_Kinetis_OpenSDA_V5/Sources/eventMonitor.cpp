@@ -0,0 +1,190 @@
+/** \file
+    \brief Background monitoring of target state with event notification
+
+   \verbatim
+
+   USBDM
+   Copyright (C) 2016  Peter O'Donoghue
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   \endverbatim
+ */
+#include "configure.h"
+#include "commands.h"
+#include "targetVddInterface.h"
+#include "resetInterface.h"
+#include "usb.h"
+#include "swd.h"
+#include "memoryCache.h"
+#include "eventMonitor.h"
+
+using namespace USBDM;
+
+namespace EventMonitor {
+
+/** Mask for SOF frame number (11 bits) */
+static constexpr uint16_t FRAME_NUMBER_MASK = 0x7FF;
+
+/** Events to report (0 => monitor disabled) */
+static uint8_t  eventMask       = 0;
+
+/** Interval between samples in frames (ms) */
+static uint16_t interval        = 1;
+
+/** Frame number at last sample */
+static uint16_t lastSampleFrame = 0;
+
+/** DHCSR at last successful sample */
+static uint32_t lastDhcsr       = 0;
+
+/** Indicates last sample failed over SWD */
+static bool     lastSwdFailed   = false;
+
+/** Indicates target Vdd was present at last sample */
+static bool     lastVddPresent  = true;
+
+/** Events waiting for the event endpoint */
+static uint8_t  pendingEvents   = 0;
+
+/** Sequence number of event records */
+static uint8_t  eventSequence   = 0;
+
+/**
+ * Check if target Vdd is present
+ */
+static bool isVddPresent() {
+#if (HW_CAPABILITY&CAP_VDDCONTROL)
+   VddState vddState = TargetVddInterface::checkVddState();
+   return (vddState == VddState_Internal) || (vddState == VddState_External);
+#else
+   return true;
+#endif
+}
+
+/**
+ * Report pending events if event endpoint is available
+ */
+static void sendPendingEvents() {
+   if (pendingEvents == 0) {
+      return;
+   }
+   uint8_t record[8];
+   record[0] = pendingEvents;
+   record[1] = eventSequence;
+   unpack16BE(lastSampleFrame, record+2);
+   unpack32BE(lastDhcsr, record+4);
+   if (UsbImplementation::sendEventData(sizeof(record), record)) {
+      pendingEvents = 0;
+      eventSequence++;
+   }
+}
+
+/**
+ * Configure event monitor
+ *
+ * @param mask       Events to report, see \ref TargetEvent_t (0 => disable monitor)
+ * @param intervalMs Interval between samples of target state in ms
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode configure(unsigned mask, unsigned intervalMs) {
+   eventMask     = 0;
+   pendingEvents = 0;
+   if (mask == 0) {
+      return BDM_RC_OK;
+   }
+   if (intervalMs == 0) {
+      intervalMs = 1;
+   }
+   if (intervalMs > FRAME_NUMBER_MASK) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   // Establish initial state so only later changes are reported
+   (void)ResetInterface::resetEvent();
+   lastSwdFailed   = (Swd::readDhcsr(lastDhcsr) != BDM_RC_OK);
+   lastVddPresent  = isVddPresent();
+   lastSampleFrame = UsbImplementation::getFrameNumber();
+   interval        = intervalMs;
+   eventMask       = mask;
+   return BDM_RC_OK;
+}
+
+/**
+ * Sample target state if due and report any events.
+ * Called while the probe is idle waiting for a command.
+ */
+void poll() {
+   using namespace Swd;
+
+   if (eventMask == 0) {
+      return;
+   }
+   uint16_t frame = UsbImplementation::getFrameNumber();
+   if (((frame-lastSampleFrame)&FRAME_NUMBER_MASK) < interval) {
+      // Not due - retry any events not yet sent
+      sendPendingEvents();
+      return;
+   }
+   lastSampleFrame = frame;
+
+   uint8_t events = 0;
+   if (ResetInterface::resetEvent()) {
+      events |= EVENT_RESET;
+   }
+   bool vddPresent = isVddPresent();
+   if (lastVddPresent && !vddPresent) {
+      events |= EVENT_VDD_LOSS;
+   }
+   lastVddPresent = vddPresent;
+
+   uint32_t dhcsr;
+   if (readDhcsr(dhcsr) == BDM_RC_OK) {
+      uint32_t set     = dhcsr&~lastDhcsr;
+      uint32_t cleared = ~dhcsr&lastDhcsr;
+      if (dhcsr&DHCSR_S_RESET_ST) {
+         events |= EVENT_RESET;
+      }
+      if (set&DHCSR_S_HALT) {
+         events |= EVENT_HALT;
+      }
+      if (cleared&DHCSR_S_HALT) {
+         events |= EVENT_RUNNING;
+      }
+      if (set&DHCSR_S_LOCKUP) {
+         events |= EVENT_LOCKUP;
+      }
+      lastDhcsr     = dhcsr;
+      lastSwdFailed = false;
+   }
+   else {
+      if (!lastSwdFailed) {
+         events |= EVENT_SWD_ERROR;
+      }
+      lastSwdFailed = true;
+   }
+   pendingEvents |= events&eventMask;
+   sendPendingEvents();
+
+   if (events&(EVENT_RESET|EVENT_RUNNING)) {
+      invalidateCoreRegisterCache();
+      MemoryCache::invalidate();
+   }
+   else if (events&EVENT_HALT) {
+      // Have registers ready for the debugger
+      (void)snapshotCoreRegisters();
+   }
+}
+
+}; // End namespace EventMonitor
@@ -0,0 +1,59 @@
+/** \file
+    \brief Background monitoring of target state with event notification
+
+   \verbatim
+
+   USBDM
+   Copyright (C) 2016  Peter O'Donoghue
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   \endverbatim
+ */
+
+#ifndef SOURCES_EVENTMONITOR_H_
+#define SOURCES_EVENTMONITOR_H_
+
+#include <stdint.h>
+#include "commands.h"
+
+/**
+ * Background monitoring of target state.
+ *
+ * While the probe is idle (waiting for a command) the target DHCSR, reset
+ * and Vdd state are sampled periodically. Changes are reported to the host as
+ * event records on the event IN endpoint so the host does not need to poll
+ * over the bulk pipe. See \ref TargetEvent_t.
+ */
+namespace EventMonitor {
+
+/**
+ * Configure event monitor
+ *
+ * @param mask       Events to report, see \ref TargetEvent_t (0 => disable monitor)
+ * @param intervalMs Interval between samples of target state in ms
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode configure(unsigned mask, unsigned intervalMs);
+
+/**
+ * Sample target state if due and report any events.
+ * Called while the probe is idle waiting for a command.
+ */
+void poll();
+
+}; // End namespace EventMonitor
+
+#endif /* SOURCES_EVENTMONITOR_H_ */
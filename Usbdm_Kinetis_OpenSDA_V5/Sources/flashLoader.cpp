@@ -0,0 +1,358 @@
+/** \file
+    \brief Target RAM Flash loader over ARM-SWD
+
+   \verbatim
+
+   USBDM
+   Copyright (C) 2016  Peter O'Donoghue
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   \endverbatim
+ */
+#include <stddef.h>
+#include <string.h>
+#include "configure.h"
+#include "delay.h"
+#include "commands.h"
+#include "swd.h"
+#include "flashLoader.h"
+
+using namespace USBDM;
+using namespace Swd;
+
+namespace FlashLoader {
+
+/** Polling interval for loader completion */
+static constexpr unsigned POLL_INTERVAL_US  = 20;
+
+/** Time-out for loader to program a buffer */
+static constexpr unsigned LOADER_TIMEOUT_US = 5000000;
+
+/** Initial xPSR value (Thumb state) */
+static constexpr uint32_t XPSR_THUMB        = (1<<24);
+
+/** Loader state */
+struct LoaderState {
+   uint32_t          returnAddress;  //!< Loader return address (BKPT instruction)
+   uint32_t          entry;          //!< Loader entry point
+   uint32_t          stack;          //!< Loader stack pointer
+   uint32_t          mailbox;        //!< Address of mailbox in target RAM
+   uint32_t          buffers[2];     //!< Address of buffers in target RAM
+   uint32_t          flashAddress;   //!< Flash address for next buffer handed to loader
+   uint16_t          bufferSize;     //!< Size of each buffer
+   uint16_t          fillCount;      //!< Bytes in buffer being filled
+   uint8_t           fillBuffer;     //!< Index of buffer being filled
+   FlashLoaderMode_t mode;           //!< Loader invocation mode
+   bool              busy;           //!< Loader is programming the other buffer
+   bool              active;         //!< Loader programming has been started
+};
+
+static LoaderState loaderState = {};
+
+/**
+ * Write ARM-SWD core register
+ *
+ * @param regNo  Register number
+ * @param value  Register value
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode writeCoreRegister(uint32_t regNo, uint32_t value) {
+   uint8_t data[4];
+   unpack32BE(value, data);
+   return Swd::writeCoreReg(regNo, data);
+}
+
+/**
+ * Halt target and wait until halted
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode haltTarget() {
+   USBDM_ErrorCode rc = Swd::writeMemoryWord(DHCSR_ADDR, DHCSR_DBGKEY|DHCSR_C_HALT|DHCSR_C_DEBUGEN);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   uint32_t dhcsr;
+   rc = Swd::readDhcsr(dhcsr);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   return ((dhcsr&DHCSR_S_HALT) != 0)?BDM_RC_OK:BDM_RC_TARGET_BUSY;
+}
+
+/**
+ * Set up core registers and start loader executing
+ *
+ * @param flashAddress  Value for R0
+ * @param buffer        Value for R1
+ * @param size          Value for R2
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note Target must be halted
+ */
+static USBDM_ErrorCode runLoader(uint32_t flashAddress, uint32_t buffer, uint32_t size) {
+   const struct {
+      uint8_t  regNo;
+      uint32_t value;
+   } registers[] = {
+         {ARM_RegR0,   flashAddress},
+         {ARM_RegR1,   buffer},
+         {ARM_RegR2,   size},
+         {ARM_RegSP,   loaderState.stack},
+         {ARM_RegLR,   loaderState.returnAddress|1},
+         {ARM_RegxPSR, XPSR_THUMB},
+         {ARM_RegPC,   loaderState.entry&~1},
+   };
+   for (auto &reg : registers) {
+      USBDM_ErrorCode rc = writeCoreRegister(reg.regNo, reg.value);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+   }
+   // Run with interrupts masked
+   return Swd::writeMemoryWord(DHCSR_ADDR, DHCSR_DBGKEY|DHCSR_C_MASKINTS|DHCSR_C_DEBUGEN);
+}
+
+/**
+ * Hand buffer to loader
+ *
+ * @param buffer  Address of buffer in target RAM
+ * @param size    Number of bytes in buffer
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode startJob(uint32_t buffer, unsigned size) {
+   if (loaderState.mode == FL_MODE_BKPT) {
+      return runLoader(loaderState.flashAddress, buffer, size);
+   }
+   // Mailbox is written in ascending order so status is written last
+   uint8_t mailbox[sizeof(FlashLoaderMailbox_t)];
+   unpack32LE(loaderState.flashAddress, mailbox+offsetof(FlashLoaderMailbox_t, address));
+   unpack32LE(buffer,                   mailbox+offsetof(FlashLoaderMailbox_t, buffer));
+   unpack32LE(size,                     mailbox+offsetof(FlashLoaderMailbox_t, size));
+   unpack32LE(FL_MAILBOX_BUSY,          mailbox+offsetof(FlashLoaderMailbox_t, status));
+   return Swd::writeMemory(MS_Long, sizeof(mailbox), loaderState.mailbox, mailbox);
+}
+
+/**
+ * Wait for loader to complete current buffer
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode waitForJob() {
+   USBDM_ErrorCode rc;
+   unsigned timeoutUs = LOADER_TIMEOUT_US;
+   uint32_t status;
+   for(;;) {
+      if (loaderState.mode == FL_MODE_BKPT) {
+         uint32_t dhcsr;
+         rc = Swd::readDhcsr(dhcsr);
+         if (rc != BDM_RC_OK) {
+            return rc;
+         }
+         if ((dhcsr&DHCSR_S_LOCKUP) != 0) {
+            return PROGRAMMING_RC_ERROR_FAILED_FLASH_COMMAND;
+         }
+         if ((dhcsr&DHCSR_S_HALT) != 0) {
+            // Loader returns status in R0
+            uint8_t r0[4];
+            rc = Swd::readCoreRegister(ARM_RegR0, r0);
+            if (rc != BDM_RC_OK) {
+               return rc;
+            }
+            status = pack32BE(r0);
+            break;
+         }
+      }
+      else {
+         rc = Swd::readMemoryWord(loaderState.mailbox+offsetof(FlashLoaderMailbox_t, status), status);
+         if (rc != BDM_RC_OK) {
+            return rc;
+         }
+         if (status != FL_MAILBOX_BUSY) {
+            break;
+         }
+      }
+      if (timeoutUs < POLL_INTERVAL_US) {
+         return BDM_RC_FLASH_NOT_READY;
+      }
+      timeoutUs -= POLL_INTERVAL_US;
+      waitUS(POLL_INTERVAL_US);
+   }
+   return (status == 0)?BDM_RC_OK:PROGRAMMING_RC_ERROR_FAILED_FLASH_COMMAND;
+}
+
+/**
+ * Hand buffer being filled to loader and switch to other buffer
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode flushBuffer() {
+   if (loaderState.busy) {
+      // Other buffer still being programmed
+      USBDM_ErrorCode rc = waitForJob();
+      loaderState.busy = false;
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+   }
+   USBDM_ErrorCode rc = startJob(loaderState.buffers[loaderState.fillBuffer], loaderState.fillCount);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   loaderState.busy          = true;
+   loaderState.flashAddress += loaderState.fillCount;
+   loaderState.fillBuffer   ^= 1;
+   loaderState.fillCount     = 0;
+   return BDM_RC_OK;
+}
+
+/**
+ * Start loader based programming
+ *
+ * @param mode           Loader invocation mode, see \ref FlashLoaderMode_t
+ * @param entry          Loader entry point
+ * @param stack          Loader initial stack pointer
+ * @param returnAddress  Loader return address i.e. address of BKPT instruction
+ * @param mailbox        Address of mailbox in target RAM (FL_MODE_MAILBOX only)
+ * @param bufferA        Address of first buffer in target RAM
+ * @param bufferB        Address of second buffer in target RAM
+ * @param bufferSize     Size of each buffer
+ * @param flashAddress   Target Flash address to start programming at
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note The target is halted
+ */
+USBDM_ErrorCode startLoader(
+      FlashLoaderMode_t mode,
+      uint32_t          entry,
+      uint32_t          stack,
+      uint32_t          returnAddress,
+      uint32_t          mailbox,
+      uint32_t          bufferA,
+      uint32_t          bufferB,
+      unsigned          bufferSize,
+      uint32_t          flashAddress) {
+
+   loaderState.active = false;
+   if (((mode != FL_MODE_BKPT) && (mode != FL_MODE_MAILBOX)) ||
+       (bufferSize == 0) || (bufferSize > 0xFFFF) || ((mailbox&3) != 0)) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   loaderState.mode          = mode;
+   loaderState.entry         = entry;
+   loaderState.stack         = stack;
+   loaderState.returnAddress = returnAddress;
+   loaderState.mailbox       = mailbox;
+   loaderState.buffers[0]    = bufferA;
+   loaderState.buffers[1]    = bufferB;
+   loaderState.bufferSize    = bufferSize;
+   loaderState.flashAddress  = flashAddress;
+   loaderState.fillBuffer    = 0;
+   loaderState.fillCount     = 0;
+   loaderState.busy          = false;
+
+   USBDM_ErrorCode rc = haltTarget();
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   if (mode == FL_MODE_MAILBOX) {
+      // Clear mailbox and start loader polling it
+      rc = Swd::writeMemoryWord(mailbox+offsetof(FlashLoaderMailbox_t, status), (uint32_t)0);
+      if (rc == BDM_RC_OK) {
+         rc = runLoader(0, 0, 0);
+      }
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+   }
+   loaderState.active = true;
+   return BDM_RC_OK;
+}
+
+/**
+ * Add data to loader stream
+ *
+ * @param data  Data to program
+ * @param size  Number of bytes
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note Data is written to the current target buffer.
+ *       A full buffer is handed to the loader once it has completed the previous buffer.
+ */
+USBDM_ErrorCode programData(const uint8_t *data, unsigned size) {
+   if (!loaderState.active) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   while (size > 0) {
+      unsigned blockSize = loaderState.bufferSize-loaderState.fillCount;
+      if (blockSize > size) {
+         blockSize = size;
+      }
+      // Write to buffer while loader programs the other buffer
+      uint32_t address     = loaderState.buffers[loaderState.fillBuffer]+loaderState.fillCount;
+      uint32_t elementSize = (((address|blockSize)&3) == 0)?MS_Long:MS_Byte;
+      USBDM_ErrorCode rc = Swd::writeMemory(elementSize, blockSize, address, const_cast<uint8_t *>(data));
+      if (rc == BDM_RC_OK) {
+         loaderState.fillCount += blockSize;
+         data                  += blockSize;
+         size                  -= blockSize;
+         if (loaderState.fillCount == loaderState.bufferSize) {
+            rc = flushBuffer();
+         }
+      }
+      if (rc != BDM_RC_OK) {
+         loaderState.active = false;
+         return rc;
+      }
+   }
+   return BDM_RC_OK;
+}
+
+/**
+ * Complete loader based programming.
+ * Any partially filled buffer is programmed and the loader is waited on.
+ *
+ * @param nextAddress Address following last byte programmed
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note The target is left halted
+ */
+USBDM_ErrorCode endLoader(uint32_t &nextAddress) {
+   if (!loaderState.active) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   loaderState.active = false;
+   USBDM_ErrorCode rc = BDM_RC_OK;
+   if (loaderState.fillCount > 0) {
+      rc = flushBuffer();
+   }
+   if ((rc == BDM_RC_OK) && loaderState.busy) {
+      rc = waitForJob();
+   }
+   loaderState.busy = false;
+   nextAddress = loaderState.flashAddress;
+
+   // Leave target halted
+   USBDM_ErrorCode haltRc = haltTarget();
+   return (rc != BDM_RC_OK)?rc:haltRc;
+}
+
+}; // End namespace FlashLoader
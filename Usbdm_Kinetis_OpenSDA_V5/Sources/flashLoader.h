@@ -0,0 +1,100 @@
+/** \file
+    \brief Target RAM Flash loader over ARM-SWD
+
+   \verbatim
+
+   USBDM
+   Copyright (C) 2016  Peter O'Donoghue
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   \endverbatim
+ */
+
+#ifndef SOURCES_FLASHLOADER_H_
+#define SOURCES_FLASHLOADER_H_
+
+#include <stdint.h>
+#include "commands.h"
+
+/**
+ * Programming of target Flash using a Flash algorithm (loader) previously
+ * downloaded to target RAM.
+ *
+ * Data is streamed into two target RAM buffers alternately. While the loader
+ * programs one buffer the probe fills the other.
+ *
+ * The loader is invoked in one of two ways (see FlashLoaderMode_t):
+ *  - FL_MODE_BKPT    - Called for each buffer with R0 = Flash address, R1 = buffer address, R2 = size.
+ *                      Returns to LR (a BKPT instruction) with R0 = 0 for success.
+ *  - FL_MODE_MAILBOX - Started once and polls a mailbox in target RAM, see FlashLoaderMailbox_t.
+ */
+namespace FlashLoader {
+
+/**
+ * Start loader based programming
+ *
+ * @param mode           Loader invocation mode, see \ref FlashLoaderMode_t
+ * @param entry          Loader entry point
+ * @param stack          Loader initial stack pointer
+ * @param returnAddress  Loader return address i.e. address of BKPT instruction
+ * @param mailbox        Address of mailbox in target RAM (FL_MODE_MAILBOX only)
+ * @param bufferA        Address of first buffer in target RAM
+ * @param bufferB        Address of second buffer in target RAM
+ * @param bufferSize     Size of each buffer
+ * @param flashAddress   Target Flash address to start programming at
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note The target is halted
+ */
+USBDM_ErrorCode startLoader(
+      FlashLoaderMode_t mode,
+      uint32_t          entry,
+      uint32_t          stack,
+      uint32_t          returnAddress,
+      uint32_t          mailbox,
+      uint32_t          bufferA,
+      uint32_t          bufferB,
+      unsigned          bufferSize,
+      uint32_t          flashAddress);
+
+/**
+ * Add data to loader stream
+ *
+ * @param data  Data to program
+ * @param size  Number of bytes
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note Data is written to the current target buffer.
+ *       A full buffer is handed to the loader once it has completed the previous buffer.
+ */
+USBDM_ErrorCode programData(const uint8_t *data, unsigned size);
+
+/**
+ * Complete loader based programming.
+ * Any partially filled buffer is programmed and the loader is waited on.
+ *
+ * @param nextAddress Address following last byte programmed
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note The target is left halted
+ */
+USBDM_ErrorCode endLoader(uint32_t &nextAddress);
+
+}; // End namespace FlashLoader
+
+#endif /* SOURCES_FLASHLOADER_H_ */
@@ -0,0 +1,307 @@
+/** \file
+    \brief Adaptive SWD clock tuning
+
+   \verbatim
+
+   USBDM
+   Copyright (C) 2016  Peter O'Donoghue
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   \endverbatim
+ */
+#include "configure.h"
+#include "commands.h"
+#include "usb.h"
+#include "swd.h"
+#include "linkTuner.h"
+
+using namespace USBDM;
+
+namespace LinkTuner {
+
+/** Requested frequencies used to find achievable steps */
+static constexpr uint32_t candidateFrequencies[] = {
+        100000,   200000,   250000,   400000,   500000,   750000,
+       1000000,  1500000,  2000000,  2500000,  3000000,  4000000,
+       5000000,  6000000,  8000000, 10000000, 12000000, 16000000,
+      24000000,
+};
+
+/** Maximum number of achievable steps */
+static constexpr unsigned MAX_STEPS = USBDM::sizeofArray(candidateFrequencies);
+
+/** AHB-AP.TAR register address for readAPReg()/writeAPReg() */
+static constexpr uint32_t AHB_AP_TAR = 0x00000004;
+
+/** Address of CPUID register - read-only constant used for DRW test */
+static constexpr uint32_t CPUID_ADDR = 0xE000ED00U;
+
+/** Patterns written to AHB-AP.TAR and read back (word aligned) */
+static constexpr uint32_t testPatterns[] = {
+      0xAAAAAAA8, 0x55555554, 0xFFFFFFFC, 0x00000000, 0xF0F0F0F0, 0x0F0F0F0C,
+};
+
+/** Interval for monitoring link errors (ms) */
+static constexpr uint16_t MONITOR_INTERVAL = 100;
+
+static constexpr uint16_t FRAME_NUMBER_MASK = 0x7FF;
+
+/** Successful transfers needed in a monitoring interval for it to be assessed */
+static constexpr uint32_t MIN_INTERVAL_TRANSFERS = 32;
+
+/** Consecutive clean (assessed) intervals before trying a step up */
+static constexpr unsigned STEP_UP_INTERVALS = 50;
+
+/** Achievable frequencies found during tuning */
+static uint32_t steps[MAX_STEPS];
+
+/** Index of current step (in steps[]) */
+static unsigned currentStep    = 0;
+
+/** Index of step selected by tuning - monitoring never steps above this */
+static unsigned tunedStep      = 0;
+
+/** Link errors in monitoring interval causing step down (0 => not monitoring) */
+static unsigned errorThreshold = 0;
+
+/** Test transfer groups used when tuning (re-used to check a step up) */
+static unsigned testBurstCount = 0;
+
+static uint32_t lastErrorCount    = 0;
+static uint32_t lastTransferCount = 0;
+static uint16_t lastCheckFrame    = 0;
+static unsigned cleanIntervals    = 0;
+static unsigned stepDownCount     = 0;
+
+/** Reference values read at lowest step */
+static uint32_t referenceIdcode;
+static uint32_t referenceCpuid;
+
+/**
+ * Restore communication after a failed test
+ */
+static void recover() {
+   (void)Swd::lineReset();
+   (void)Swd::clearStickyBits();
+}
+
+/**
+ * Run test burst at current speed
+ *
+ * @param burstCount Number of test transfer groups
+ *
+ * @return BDM_RC_OK                  => all transfers correct
+ * @return BDM_RC_UNEXPECTED_RESPONSE => data read back differs from reference
+ * @return Other                      => transfer error
+ */
+static USBDM_ErrorCode testLink(unsigned burstCount) {
+   USBDM_ErrorCode rc;
+   uint32_t value;
+
+   for (unsigned burst=0; burst<burstCount; burst++) {
+      // DP register
+      rc = Swd::readReg(Swd::SwdRead_DP_IDCODE, value);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      if (value != referenceIdcode) {
+         return BDM_RC_UNEXPECTED_RESPONSE;
+      }
+      // AP register write/read-back (completed through RDBUFF)
+      for (uint32_t pattern : testPatterns) {
+         rc = Swd::writeAPReg(AHB_AP_TAR, pattern^(burst<<2));
+         if (rc != BDM_RC_OK) {
+            return rc;
+         }
+         rc = Swd::readAPReg(AHB_AP_TAR, value);
+         if (rc != BDM_RC_OK) {
+            return rc;
+         }
+         if (value != (pattern^(burst<<2))) {
+            return BDM_RC_UNEXPECTED_RESPONSE;
+         }
+      }
+      // Memory read through DRW
+      rc = Swd::readMemoryWord(CPUID_ADDR, value);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      if (value != referenceCpuid) {
+         return BDM_RC_UNEXPECTED_RESPONSE;
+      }
+   }
+   return BDM_RC_OK;
+}
+
+/**
+ * Find and select fastest reliable SWD clock
+ *
+ * @param minFrequency   Lowest frequency to try (Hz) - must work
+ * @param maxFrequency   Highest frequency to try (Hz)
+ * @param marginSteps    Number of steps below fastest clean step to select
+ * @param burstCount     Number of test transfer groups at each step
+ * @param errorThreshold Link errors in a monitoring interval that cause a step down (0 => no monitoring)
+ * @param frequency      Selected frequency (Hz)
+ * @param stepsTested    Number of steps tested
+ * @param stepsPassed    Number of steps passing
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note The target must be connected
+ */
+USBDM_ErrorCode tune(
+      uint32_t  minFrequency,
+      uint32_t  maxFrequency,
+      unsigned  marginSteps,
+      unsigned  burstCount,
+      unsigned  errorThreshold,
+      uint32_t &frequency,
+      unsigned &stepsTested,
+      unsigned &stepsPassed) {
+
+   disable();
+   stepsTested = 0;
+   stepsPassed = 0;
+   if ((minFrequency > maxFrequency) || (burstCount == 0)) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   const uint32_t originalFrequency = Swd::getSpeed();
+
+   // Find distinct achievable speeds in range
+   unsigned stepCount = 0;
+   steps[stepCount++] = Swd::getAchievableSpeed(minFrequency);
+   for (uint32_t candidate : candidateFrequencies) {
+      if ((candidate <= minFrequency) || (candidate > maxFrequency)) {
+         continue;
+      }
+      uint32_t speed = Swd::getAchievableSpeed(candidate);
+      if (speed > steps[stepCount-1]) {
+         steps[stepCount++] = speed;
+      }
+   }
+   // Reference values are obtained at the lowest speed
+   Swd::setSpeed(steps[0]);
+   USBDM_ErrorCode rc = Swd::readReg(Swd::SwdRead_DP_IDCODE, referenceIdcode);
+   if (rc == BDM_RC_OK) {
+      rc = Swd::readMemoryWord(CPUID_ADDR, referenceCpuid);
+   }
+   if (rc != BDM_RC_OK) {
+      Swd::setSpeed(originalFrequency);
+      return rc;
+   }
+   // Walk up until first failure
+   for (unsigned step=0; step<stepCount; step++) {
+      Swd::setSpeed(steps[step]);
+      stepsTested++;
+      if (testLink(burstCount) != BDM_RC_OK) {
+         Swd::setSpeed(steps[0]);
+         recover();
+         break;
+      }
+      stepsPassed++;
+   }
+   if (stepsPassed == 0) {
+      Swd::setSpeed(originalFrequency);
+      recover();
+      return BDM_RC_NO_CONNECTION;
+   }
+   currentStep = (stepsPassed>marginSteps)?(stepsPassed-1-marginSteps):0;
+   Swd::setSpeed(steps[currentStep]);
+   frequency = Swd::getSpeed();
+
+   // Start monitoring
+   tunedStep                 = currentStep;
+   testBurstCount            = burstCount;
+   stepDownCount             = 0;
+   cleanIntervals            = 0;
+   lastErrorCount            = Swd::getLinkErrorCount();
+   lastTransferCount         = Swd::getLinkTransferCount();
+   lastCheckFrame            = UsbImplementation::getFrameNumber();
+   LinkTuner::errorThreshold = errorThreshold;
+   return BDM_RC_OK;
+}
+
+/**
+ * Stop monitoring of link errors e.g. when speed is explicitly set
+ */
+void disable() {
+   errorThreshold = 0;
+}
+
+/**
+ * Monitor link error rate and adjust speed if needed.
+ * Called from the command loop while waiting for a command.
+ *
+ * The speed is reduced a step when an interval with traffic has too many link errors.
+ * After a run of clean intervals with traffic, the next faster step (not above the
+ * tuned step) is re-tested and selected if it passes.
+ * Intervals with little traffic are ignored.
+ */
+void poll() {
+   if (errorThreshold == 0) {
+      return;
+   }
+   uint16_t frame = UsbImplementation::getFrameNumber();
+   if (((frame-lastCheckFrame)&FRAME_NUMBER_MASK) < MONITOR_INTERVAL) {
+      return;
+   }
+   lastCheckFrame = frame;
+   uint32_t errorCount    = Swd::getLinkErrorCount();
+   uint32_t transferCount = Swd::getLinkTransferCount();
+   uint32_t newErrors     = errorCount-lastErrorCount;
+   uint32_t newTransfers  = transferCount-lastTransferCount;
+   lastErrorCount    = errorCount;
+   lastTransferCount = transferCount;
+
+   if (newErrors >= errorThreshold) {
+      cleanIntervals = 0;
+      if ((newTransfers > 0) && (currentStep > 0)) {
+         currentStep--;
+         stepDownCount++;
+         Swd::setSpeed(steps[currentStep]);
+      }
+      return;
+   }
+   if ((newErrors > 0) || (newTransfers < MIN_INTERVAL_TRANSFERS)) {
+      // Not enough evidence that the link is clean
+      return;
+   }
+   if ((currentStep >= tunedStep) || (++cleanIntervals < STEP_UP_INTERVALS)) {
+      return;
+   }
+   cleanIntervals = 0;
+   Swd::setSpeed(steps[currentStep+1]);
+   if (testLink(testBurstCount) == BDM_RC_OK) {
+      currentStep++;
+   }
+   else {
+      Swd::setSpeed(steps[currentStep]);
+      recover();
+   }
+   // Don't count the test transfers
+   lastErrorCount    = Swd::getLinkErrorCount();
+   lastTransferCount = Swd::getLinkTransferCount();
+}
+
+/**
+ * Get number of automatic speed reductions since tuning
+ *
+ * @return Number of reductions
+ */
+unsigned getStepDownCount() {
+   return stepDownCount;
+}
+
+}; // End namespace LinkTuner
@@ -0,0 +1,89 @@
+/** \file
+    \brief Adaptive SWD clock tuning
+
+   \verbatim
+
+   USBDM
+   Copyright (C) 2016  Peter O'Donoghue
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   \endverbatim
+ */
+
+#ifndef SOURCES_LINKTUNER_H_
+#define SOURCES_LINKTUNER_H_
+
+#include <stdint.h>
+#include "commands.h"
+
+/**
+ * Selection of the fastest reliable SWD clock.
+ *
+ * Each achievable SWD clock in a range is tested with a burst of transfers
+ * that are checked for parity errors, bad ACKs and data mismatches.
+ * The fastest clean clock, less a safety margin, is selected.
+ * Optionally the clock is reduced a step at a time while idle if the link
+ * error count rises too quickly during target traffic, and raised again
+ * (up to the tuned clock) after a sustained period without errors.
+ */
+namespace LinkTuner {
+
+/**
+ * Find and select fastest reliable SWD clock
+ *
+ * @param minFrequency   Lowest frequency to try (Hz) - must work
+ * @param maxFrequency   Highest frequency to try (Hz)
+ * @param marginSteps    Number of steps below fastest clean step to select
+ * @param burstCount     Number of test transfer groups at each step
+ * @param errorThreshold Link errors in a monitoring interval that cause a step down (0 => no monitoring)
+ * @param frequency      Selected frequency (Hz)
+ * @param stepsTested    Number of steps tested
+ * @param stepsPassed    Number of steps passing
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note The target must be connected
+ */
+USBDM_ErrorCode tune(
+      uint32_t  minFrequency,
+      uint32_t  maxFrequency,
+      unsigned  marginSteps,
+      unsigned  burstCount,
+      unsigned  errorThreshold,
+      uint32_t &frequency,
+      unsigned &stepsTested,
+      unsigned &stepsPassed);
+
+/**
+ * Stop monitoring of link errors e.g. when speed is explicitly set
+ */
+void disable();
+
+/**
+ * Monitor link error rate and adjust speed if needed.
+ * Called from the command loop while waiting for a command.
+ */
+void poll();
+
+/**
+ * Get number of automatic speed reductions since tuning
+ *
+ * @return Number of reductions
+ */
+unsigned getStepDownCount();
+
+}; // End namespace LinkTuner
+
+#endif /* SOURCES_LINKTUNER_H_ */
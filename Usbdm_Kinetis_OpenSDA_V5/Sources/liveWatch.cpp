@@ -0,0 +1,218 @@
+/** \file
+    \brief Periodic timestamped sampling of target variables (live watch)
+
+   \verbatim
+
+   USBDM
+   Copyright (C) 2016  Peter O'Donoghue
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   \endverbatim
+ */
+#include "configure.h"
+#include "commands.h"
+#include "pit.h"
+#include "usb.h"
+#include "swd.h"
+#include "liveWatch.h"
+
+using namespace USBDM;
+
+namespace LiveWatch {
+
+/** PIT channel generating sample ticks (interrupt wakes the command loop) */
+static constexpr PitChannelNum TICK_CHANNEL      = PitChannelNum_1;
+
+/** PIT channel used as free-running timestamp counter */
+static constexpr PitChannelNum TIMESTAMP_CHANNEL = PitChannelNum_2;
+
+/** Size of record header */
+static constexpr unsigned HEADER_SIZE = 6;
+
+/** Watched variables */
+static Swd::MemoryLocation variables[LIVE_WATCH_MAX_VARIABLES];
+static unsigned variableCount = 0;
+static unsigned recordSize    = 0;
+static uint32_t period        = 0;
+static bool     running       = false;
+
+/** Ticks since last sample - updated by PIT interrupt */
+static volatile uint32_t pendingTicks = 0;
+
+/** Sequence number of next tick */
+static uint16_t sequence      = 0;
+
+static uint32_t recordCount   = 0;
+static uint32_t droppedCount  = 0;
+static uint32_t errorCount    = 0;
+
+/**
+ * Configure watch
+ *
+ * @param periodUs  Sample period in microseconds
+ * @param count     Number of variables (1..LIVE_WATCH_MAX_VARIABLES)
+ * @param variables Variable descriptions, 5 bytes each: [0] size (1,2,4), [1..4] address in BIG-ENDIAN order
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note Sampling is stopped
+ */
+USBDM_ErrorCode configure(uint32_t periodUs, unsigned count, const uint8_t *variables) {
+   stop();
+   variableCount = 0;
+   if ((periodUs < LIVE_WATCH_MIN_PERIOD_US) || (count < 1) || (count > LIVE_WATCH_MAX_VARIABLES)) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   unsigned size = HEADER_SIZE;
+   for (unsigned index=0; index<count; index++) {
+      uint8_t  varSize = variables[0];
+      uint32_t address = pack32BE(variables+1);
+      variables += 5;
+      if (((varSize != 1) && (varSize != 2) && (varSize != 4)) || ((address&(varSize-1)) != 0)) {
+         return BDM_RC_ILLEGAL_PARAMS;
+      }
+      LiveWatch::variables[index].address = address;
+      LiveWatch::variables[index].size    = varSize;
+      size += varSize;
+   }
+   if (size > WATCH_IN_EP_MAXSIZE) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   variableCount = count;
+   recordSize    = size;
+   period        = periodUs;
+   return BDM_RC_OK;
+}
+
+/**
+ * Start sampling
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode start() {
+   if (variableCount == 0) {
+      // Not configured
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   sequence      = 0;
+   pendingTicks  = 0;
+   recordCount   = 0;
+   droppedCount  = 0;
+   errorCount    = 0;
+
+   Pit::defaultConfigureIfNeeded();
+   // Timestamp counter free-runs over the full 32-bit range
+   Pit::configureChannel(TIMESTAMP_CHANNEL, Ticks(0xFFFFFFFFU));
+   Pit::configureChannelInMicroseconds(TICK_CHANNEL, period, PitChannelAction_Interrupt);
+   PitInfo::enableNvicInterrupts(PitIrqNum_Ch1);
+   running = true;
+   return BDM_RC_OK;
+}
+
+/**
+ * Stop sampling
+ */
+void stop() {
+   if (running) {
+      PitInfo::disableNvicInterrupts(PitIrqNum_Ch1);
+      Pit::disableChannel(TICK_CHANNEL);
+      Pit::disableChannel(TIMESTAMP_CHANNEL);
+   }
+   running = false;
+}
+
+/**
+ * Take sample if due.
+ * Called from the command loop while waiting for a command.
+ */
+void poll() {
+   if (!running) {
+      return;
+   }
+   uint32_t ticks;
+   {
+      CriticalSection cs;
+      ticks        = pendingTicks;
+      pendingTicks = 0;
+   }
+   if (ticks == 0) {
+      return;
+   }
+   // Only the latest tick is sampled
+   droppedCount += ticks-1;
+   sequence     += ticks;
+
+   uint8_t record[WATCH_IN_EP_MAXSIZE];
+   unpack16BE(sequence, record+0);
+   // Timestamp counts down
+   unpack32BE(~PitInfo::pit->CHANNEL[TIMESTAMP_CHANNEL].CVAL, record+2);
+
+   // All variables are read in one pipelined sequence
+   if (Swd::readMemoryList(variableCount, variables, record+HEADER_SIZE) != BDM_RC_OK) {
+      errorCount++;
+      return;
+   }
+   if (!UsbImplementation::sendWatchData(recordSize, record)) {
+      // Host not keeping up
+      droppedCount++;
+      return;
+   }
+   recordCount++;
+}
+
+/**
+ * Get size of records
+ *
+ * @return Size in bytes
+ */
+unsigned getRecordSize() {
+   return recordSize;
+}
+
+/**
+ * Get frequency of timestamp counter
+ *
+ * @return Frequency in Hz
+ */
+uint32_t getTimestampFrequency() {
+   return PitInfo::getClockFrequency();
+}
+
+/**
+ * Get sampling status
+ *
+ * @param running      Sampling is active
+ * @param recordCount  Number of records sent
+ * @param droppedCount Number of samples dropped
+ * @param errorCount   Number of samples failed due to SWD errors
+ */
+void getStatus(bool &running, uint32_t &recordCount, uint32_t &droppedCount, uint32_t &errorCount) {
+   running      = LiveWatch::running;
+   recordCount  = LiveWatch::recordCount;
+   droppedCount = LiveWatch::droppedCount;
+   errorCount   = LiveWatch::errorCount;
+}
+
+}; // End namespace LiveWatch
+
+/**
+ * Sample tick interrupt handler.
+ * Counts ticks and wakes the command loop.
+ */
+extern "C"
+void PIT_Ch1_IRQHandler() {
+   PitInfo::pit->CHANNEL[LiveWatch::TICK_CHANNEL].TFLG = PIT_TFLG_TIF_MASK;
+   LiveWatch::pendingTicks = LiveWatch::pendingTicks + 1;
+}
@@ -0,0 +1,102 @@
+/** \file
+    \brief Periodic timestamped sampling of target variables (live watch)
+
+   \verbatim
+
+   USBDM
+   Copyright (C) 2016  Peter O'Donoghue
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   \endverbatim
+ */
+
+#ifndef SOURCES_LIVEWATCH_H_
+#define SOURCES_LIVEWATCH_H_
+
+#include <stdint.h>
+#include "commands.h"
+
+/**
+ * Periodic sampling of a set of target variables while the target runs.
+ *
+ * A PIT channel sets the sample rate. On each tick all variables are read in a
+ * single pass and a record is sent on the watch IN endpoint:\n
+ *  - [0..1]  Tick sequence number in BIG-ENDIAN order (gaps indicate dropped samples)
+ *  - [2..5]  Timestamp from free-running counter in BIG-ENDIAN order
+ *  - [6..N]  Variable values in configuration order (target memory order)
+ *
+ * Samples are dropped and counted, rather than blocking, if the host does not
+ * collect records fast enough.
+ */
+namespace LiveWatch {
+
+/**
+ * Configure watch
+ *
+ * @param periodUs  Sample period in microseconds
+ * @param count     Number of variables (1..LIVE_WATCH_MAX_VARIABLES)
+ * @param variables Variable descriptions, 5 bytes each: [0] size (1,2,4), [1..4] address in BIG-ENDIAN order
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note Sampling is stopped
+ */
+USBDM_ErrorCode configure(uint32_t periodUs, unsigned count, const uint8_t *variables);
+
+/**
+ * Start sampling
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode start();
+
+/**
+ * Stop sampling
+ */
+void stop();
+
+/**
+ * Take sample if due.
+ * Called from the command loop while waiting for a command.
+ */
+void poll();
+
+/**
+ * Get size of records
+ *
+ * @return Size in bytes
+ */
+unsigned getRecordSize();
+
+/**
+ * Get frequency of timestamp counter
+ *
+ * @return Frequency in Hz
+ */
+uint32_t getTimestampFrequency();
+
+/**
+ * Get sampling status
+ *
+ * @param running      Sampling is active
+ * @param recordCount  Number of records sent
+ * @param droppedCount Number of samples dropped
+ * @param errorCount   Number of samples failed due to SWD errors
+ */
+void getStatus(bool &running, uint32_t &recordCount, uint32_t &droppedCount, uint32_t &errorCount);
+
+}; // End namespace LiveWatch
+
+#endif /* SOURCES_LIVEWATCH_H_ */
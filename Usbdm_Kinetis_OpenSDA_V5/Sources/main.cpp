@@ -101,7 +101,7 @@ USBDM_ErrorCode testmem(uint32_t addressStart, uint32_t addrRange) {
 //   CHECK(Swd::powerUp());
    console.writeln("Connected\n");
 
-   uint8_t randomData[sizeof(commandBuffer)];
+   uint8_t randomData[MAX_COMMAND_SIZE];
    for (unsigned i=0; i<sizeof(randomData);i++) {
       randomData[i] = rand();
    }
@@ -109,7 +109,7 @@ USBDM_ErrorCode testmem(uint32_t addressStart, uint32_t addrRange) {
       static const uint8_t sizes[] = {1,2,4};
       int sizeIndex    = rand()%3;
       uint8_t  opSize  = sizes[sizeIndex];
-      uint8_t  size    = rand()%(sizeof(commandBuffer)-20)+1;
+      uint8_t  size    = rand()%(MAX_COMMAND_SIZE-20)+1;
       uint32_t address = addressStart+rand()%(addrRange-size);
 
       uint32_t mask = ~((1<<sizeIndex)-1);
@@ -125,7 +125,7 @@ USBDM_ErrorCode testmem(uint32_t addressStart, uint32_t addrRange) {
       memcpy(commandBuffer+sizeof(operation), randomData, size);
       CHECK(f_CMD_WRITE_MEM());
 
-      memset(commandBuffer, 0, sizeof(commandBuffer));
+      memset(commandBuffer, 0, MAX_COMMAND_SIZE);
       memcpy(commandBuffer, operation, sizeof(operation));
       CHECK(f_CMD_READ_MEM());
 
@@ -200,7 +200,7 @@ USBDM_ErrorCode testmem() {
    CHECK(Swd::powerUp());
    console.writeln("Connected\n");
 
-   uint8_t randomData[sizeof(commandBuffer)];
+   uint8_t randomData[MAX_COMMAND_SIZE];
    for (unsigned i=0; i<sizeof(randomData);i++) {
       randomData[i] = rand();
    }
@@ -209,7 +209,7 @@ USBDM_ErrorCode testmem() {
       int sizeIndex    = rand()%3;
       uint8_t  opSize  = sizes[sizeIndex];
       uint32_t address = 0x20000000+rand()%10000;
-      uint8_t  size    = rand()%(sizeof(commandBuffer)-20)+1;
+      uint8_t  size    = rand()%(MAX_COMMAND_SIZE-20)+1;
 
       uint32_t mask = ~((1<<sizeIndex)-1);
       address = address & mask;
@@ -224,7 +224,7 @@ USBDM_ErrorCode testmem() {
       memcpy(commandBuffer+sizeof(operation), randomData, size);
       CHECK(Swd::f_CMD_WRITE_MEM());
 
-      memset(commandBuffer, 0, sizeof(commandBuffer));
+      memset(commandBuffer, 0, MAX_COMMAND_SIZE);
       memcpy(commandBuffer, operation, sizeof(operation));
       CHECK(Swd::f_CMD_READ_MEM());
 
@@ -322,6 +322,10 @@ void warmStart() {
    // The interface is initially on
    InterfaceEnable::on();
 
+   // Cycle counter is used for SWD WAIT timeouts and command timing
+   CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+   DWT->CTRL        |= DWT_CTRL_CYCCNTENA_Msk;
+
 //   console_initialise();
 
    checkError();
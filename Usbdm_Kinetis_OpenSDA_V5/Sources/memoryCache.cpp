@@ -0,0 +1,230 @@
+/** \file
+    \brief Cache of target memory while the target is halted
+
+   \verbatim
+
+   USBDM
+   Copyright (C) 2016  Peter O'Donoghue
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   \endverbatim
+ */
+#include <string.h>
+#include "configure.h"
+#include "commands.h"
+#include "swd.h"
+#include "memoryCache.h"
+
+namespace MemoryCache {
+
+/** Size of cache page - power of 2 */
+static constexpr unsigned PAGE_SIZE  = 64;
+
+/** Number of cache pages */
+static constexpr unsigned PAGE_COUNT = 8;
+
+/** Cache page */
+struct Page {
+   uint32_t address;                          //!< Target address of page
+   bool     valid;                            //!< Page holds valid data
+   uint32_t data[PAGE_SIZE/sizeof(uint32_t)]; //!< Page data (target memory order)
+};
+
+/** Cacheable region of target memory */
+struct Region {
+   uint32_t address;   //!< Start of region
+   uint32_t size;      //!< Size of region (0 => unused)
+};
+
+static Page     pages[PAGE_COUNT];
+static Region   regions[MEM_CACHE_REGIONS];
+
+/** Page to replace on next miss (round-robin) */
+static unsigned nextVictim = 0;
+
+/** Statistics */
+static uint32_t hitCount   = 0;
+static uint32_t missCount  = 0;
+
+/**
+ * Invalidate all cached pages
+ */
+void invalidate() {
+   for (Page &page : pages) {
+      page.valid = false;
+   }
+}
+
+/**
+ * Set cacheable region of target memory
+ *
+ * @param region  Region number (0..MEM_CACHE_REGIONS-1)
+ * @param address Start of region
+ * @param size    Size of region in bytes (0 => region disabled)
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note The cache is invalidated.\n
+ *       Cacheable regions must be normal memory that may be read with word accesses.
+ */
+USBDM_ErrorCode setRegion(unsigned region, uint32_t address, uint32_t size) {
+   if ((region >= MEM_CACHE_REGIONS) || ((address+size) < address)) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   // Regions are extended to whole pages
+   uint32_t end = address+size;
+   if (size != 0) {
+      address &= ~(PAGE_SIZE-1);
+      end      = (end+PAGE_SIZE-1)&~(PAGE_SIZE-1);
+   }
+   regions[region].address = address;
+   regions[region].size    = end-address;
+   invalidate();
+   return BDM_RC_OK;
+}
+
+/**
+ * Check if a range of target memory lies within a single cacheable region
+ *
+ * @param address Start of range
+ * @param count   Size of range
+ */
+static bool isCacheable(uint32_t address, unsigned count) {
+   for (const Region &region : regions) {
+      if ((region.size != 0) && (address >= region.address) &&
+          ((address-region.address)+count <= region.size)) {
+         return true;
+      }
+   }
+   return false;
+}
+
+/**
+ * Find cache page holding target address
+ *
+ * @param pageAddress Page aligned target address
+ *
+ * @return Cache page or nullptr if not present
+ */
+static Page *findPage(uint32_t pageAddress) {
+   for (Page &page : pages) {
+      if (page.valid && (page.address == pageAddress)) {
+         return &page;
+      }
+   }
+   return nullptr;
+}
+
+/**
+ * Load target memory into a cache page
+ *
+ * @param pageAddress Page aligned target address
+ * @param page        Cache page
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode loadPage(uint32_t pageAddress, Page *&page) {
+   page = &pages[nextVictim];
+   if (++nextVictim >= PAGE_COUNT) {
+      nextVictim = 0;
+   }
+   page->valid = false;
+   USBDM_ErrorCode rc = Swd::readMemory(MS_Long, PAGE_SIZE, pageAddress, (uint8_t *)page->data);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   page->address = pageAddress;
+   page->valid   = true;
+   return BDM_RC_OK;
+}
+
+/**
+ * Read target memory using cache where possible
+ *
+ * @param elementSize  Size of the data elements (used when not cacheable)
+ * @param count        Number of bytes
+ * @param address      Address in target memory
+ * @param data         Where to place data (target memory order)
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note The cache is only filled while the target is halted (DHCSR.S_HALT).
+ *       DHCSR is only read on a miss as valid pages imply the target has not
+ *       run since they were loaded, so a hit costs no SWD traffic.
+ */
+USBDM_ErrorCode readMemory(uint32_t elementSize, unsigned count, uint32_t address, uint8_t *data) {
+   if (!isCacheable(address, count)) {
+      return Swd::readMemory(elementSize, count, address, data);
+   }
+   bool haltChecked = false;
+   while (count > 0) {
+      uint32_t pageAddress = address&~(PAGE_SIZE-1);
+      unsigned offset      = address-pageAddress;
+      unsigned blockSize   = PAGE_SIZE-offset;
+      if (blockSize > count) {
+         blockSize = count;
+      }
+      Page *page = findPage(pageAddress);
+      if (page != nullptr) {
+         hitCount++;
+      }
+      else {
+         missCount++;
+         if (!haltChecked) {
+            // Only fill the cache while the target is halted
+            uint32_t dhcsr;
+            USBDM_ErrorCode rc = Swd::readDhcsr(dhcsr);
+            if (rc != BDM_RC_OK) {
+               return rc;
+            }
+            if ((dhcsr&Swd::DHCSR_S_HALT) == 0) {
+               invalidate();
+               return Swd::readMemory(elementSize, count, address, data);
+            }
+            haltChecked = true;
+         }
+         USBDM_ErrorCode rc = loadPage(pageAddress, page);
+         if (rc != BDM_RC_OK) {
+            return rc;
+         }
+      }
+      memcpy(data, (uint8_t *)page->data+offset, blockSize);
+      address += blockSize;
+      data    += blockSize;
+      count   -= blockSize;
+   }
+   return BDM_RC_OK;
+}
+
+/**
+ * Get cache statistics
+ *
+ * @param hits    Number of page accesses served from cache
+ * @param misses  Number of page accesses requiring a read from the target
+ */
+void getStatistics(uint32_t &hits, uint32_t &misses) {
+   hits   = hitCount;
+   misses = missCount;
+}
+
+/**
+ * Clear cache statistics
+ */
+void clearStatistics() {
+   hitCount  = 0;
+   missCount = 0;
+}
+
+}; // End namespace MemoryCache
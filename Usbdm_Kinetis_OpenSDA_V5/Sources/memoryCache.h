@@ -0,0 +1,90 @@
+/** \file
+    \brief Cache of target memory while the target is halted
+
+   \verbatim
+
+   USBDM
+   Copyright (C) 2016  Peter O'Donoghue
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   \endverbatim
+ */
+
+#ifndef SOURCES_MEMORYCACHE_H_
+#define SOURCES_MEMORYCACHE_H_
+
+#include <stdint.h>
+#include "commands.h"
+
+/**
+ * Read cache of target memory.
+ *
+ * Reads from configured regions of target memory (e.g. SRAM, never peripherals)
+ * are served from fixed-size pages held in probe RAM. The whole cache must be
+ * invalidated whenever target memory may change i.e. when the target runs, on
+ * any write and on reset.
+ */
+namespace MemoryCache {
+
+/**
+ * Set cacheable region of target memory
+ *
+ * @param region  Region number (0..MEM_CACHE_REGIONS-1)
+ * @param address Start of region
+ * @param size    Size of region in bytes (0 => region disabled)
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note The cache is invalidated.\n
+ *       Cacheable regions must be normal memory that may be read with word accesses.
+ */
+USBDM_ErrorCode setRegion(unsigned region, uint32_t address, uint32_t size);
+
+/**
+ * Invalidate all cached pages
+ */
+void invalidate();
+
+/**
+ * Read target memory using cache where possible
+ *
+ * @param elementSize  Size of the data elements (used when not cacheable)
+ * @param count        Number of bytes
+ * @param address      Address in target memory
+ * @param data         Where to place data (target memory order)
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note The cache is only filled while the target is halted (DHCSR.S_HALT).
+ *       DHCSR is only read on a miss so a hit costs no SWD traffic.
+ */
+USBDM_ErrorCode readMemory(uint32_t elementSize, unsigned count, uint32_t address, uint8_t *data);
+
+/**
+ * Get cache statistics
+ *
+ * @param hits    Number of page accesses served from cache
+ * @param misses  Number of page accesses requiring a read from the target
+ */
+void getStatistics(uint32_t &hits, uint32_t &misses);
+
+/**
+ * Clear cache statistics
+ */
+void clearStatistics();
+
+}; // End namespace MemoryCache
+
+#endif /* SOURCES_MEMORYCACHE_H_ */
@@ -0,0 +1,238 @@
+/** \file
+    \brief Statistical PC sampling of a running target
+
+   \verbatim
+
+   USBDM
+   Copyright (C) 2016  Peter O'Donoghue
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   \endverbatim
+ */
+#include "configure.h"
+#include "commands.h"
+#include "pit.h"
+#include "swd.h"
+#include "pcSampler.h"
+
+using namespace USBDM;
+
+namespace PcSampler {
+
+/** DWT Program Counter Sample Register */
+static constexpr uint32_t DWT_PCSR_ADDR     = 0xE000101CU;
+
+/** Debug Exception and Monitor Control Register */
+static constexpr uint32_t DEMCR_ADDR        = 0xE000EDFCU;
+static constexpr uint32_t DEMCR_TRCENA      = (1<<24);
+
+/** DWT_PCSR value when no PC is available (core halted etc.) */
+static constexpr uint32_t PCSR_NO_PC        = 0xFFFFFFFFU;
+
+/** PIT channel used to time samples */
+static constexpr PitChannelNum PIT_CHANNEL  = PitChannelNum_3;
+
+/** Maximum number of samples taken in a single pipelined burst */
+static constexpr unsigned MAX_BURST         = 32;
+
+/** Target duration of a burst in microseconds (limits delay to command processing) */
+static constexpr unsigned BURST_TIME_US     = 1000;
+
+/** Histogram of PC values */
+static uint16_t buckets[PC_SAMPLE_MAX_BUCKETS];
+
+static uint32_t baseAddress   = 0;
+static unsigned bucketShift   = 2;
+static unsigned bucketCount   = 0;
+static unsigned burstLength   = 1;
+static uint32_t period        = 0;
+static bool     running       = false;
+
+static uint32_t totalCount    = 0;
+static uint32_t outsideCount  = 0;
+static uint32_t noPcCount     = 0;
+
+/**
+ * Clear histogram and sample counts
+ */
+void clear() {
+   for (uint16_t &bucket : buckets) {
+      bucket = 0;
+   }
+   totalCount   = 0;
+   outsideCount = 0;
+   noPcCount    = 0;
+}
+
+/**
+ * Configure sampling and clear histogram
+ *
+ * @param baseAddress  Address corresponding to first bucket
+ * @param bucketShift  Size of each bucket as log2(bytes) (1..24)
+ * @param bucketCount  Number of buckets (1..PC_SAMPLE_MAX_BUCKETS)
+ * @param periodUs     Sample period in microseconds
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note Sampling is stopped
+ */
+USBDM_ErrorCode configure(uint32_t baseAddress, unsigned bucketShift, unsigned bucketCount, uint32_t periodUs) {
+   stop();
+   if ((bucketShift < 1) || (bucketShift > 24) ||
+       (bucketCount < 1) || (bucketCount > PC_SAMPLE_MAX_BUCKETS) ||
+       (periodUs < PC_SAMPLE_MIN_PERIOD_US) || (periodUs > PC_SAMPLE_MAX_PERIOD_US)) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   PcSampler::baseAddress = baseAddress;
+   PcSampler::bucketShift = bucketShift;
+   PcSampler::bucketCount = bucketCount;
+   period                 = periodUs;
+
+   // Pipeline as many samples as fit in the burst time
+   burstLength = BURST_TIME_US/periodUs;
+   if (burstLength < 1) {
+      burstLength = 1;
+   }
+   if (burstLength > MAX_BURST) {
+      burstLength = MAX_BURST;
+   }
+   clear();
+   return BDM_RC_OK;
+}
+
+/**
+ * Start sampling
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode start() {
+   if (period == 0) {
+      // Not configured
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   // DWT must be enabled for PCSR to be available
+   uint32_t demcr;
+   USBDM_ErrorCode rc = Swd::readMemoryWord(DEMCR_ADDR, demcr);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   if ((demcr&DEMCR_TRCENA) == 0) {
+      rc = Swd::writeMemoryWord(DEMCR_ADDR, demcr|DEMCR_TRCENA);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+   }
+   Pit::defaultConfigureIfNeeded();
+   Pit::configureChannelInMicroseconds(PIT_CHANNEL, period);
+   running = true;
+   return BDM_RC_OK;
+}
+
+/**
+ * Stop sampling
+ */
+void stop() {
+   if (running) {
+      Pit::disableChannel(PIT_CHANNEL);
+   }
+   running = false;
+}
+
+/**
+ * Wait until next sample is due
+ */
+static void waitForSampleTime() {
+   while (PitInfo::pit->CHANNEL[PIT_CHANNEL].TFLG == 0) {
+   }
+   PitInfo::pit->CHANNEL[PIT_CHANNEL].TFLG = PIT_TFLG_TIF_MASK;
+}
+
+/**
+ * Add sample to histogram
+ *
+ * @param pc Sampled PC value
+ */
+static void addSample(uint32_t pc) {
+   totalCount++;
+   if (pc == PCSR_NO_PC) {
+      noPcCount++;
+      return;
+   }
+   uint32_t bucket = (pc-baseAddress)>>bucketShift;
+   if ((pc < baseAddress) || (bucket >= bucketCount)) {
+      outsideCount++;
+      return;
+   }
+   if (buckets[bucket] != 0xFFFF) {
+      buckets[bucket]++;
+   }
+}
+
+/**
+ * Take any samples that are due.
+ * Called from the command loop while waiting for a command.
+ */
+void poll() {
+   if (!running || (PitInfo::pit->CHANNEL[PIT_CHANNEL].TFLG == 0)) {
+      return;
+   }
+   uint32_t samples[MAX_BURST];
+   if (Swd::sampleMemoryWord(DWT_PCSR_ADDR, burstLength, samples, waitForSampleTime) != BDM_RC_OK) {
+      // Target not accessible - count as no PC available
+      totalCount++;
+      noPcCount++;
+      return;
+   }
+   for (unsigned index=0; index<burstLength; index++) {
+      addSample(samples[index]);
+   }
+}
+
+/**
+ * Get sampling status
+ *
+ * @param running      Sampling is active
+ * @param totalCount   Total number of samples taken
+ * @param outsideCount Number of samples outside the histogram range
+ * @param noPcCount    Number of samples with no PC available (target halted or sleeping, SWD failure)
+ */
+void getStatus(bool &running, uint32_t &totalCount, uint32_t &outsideCount, uint32_t &noPcCount) {
+   running      = PcSampler::running;
+   totalCount   = PcSampler::totalCount;
+   outsideCount = PcSampler::outsideCount;
+   noPcCount    = PcSampler::noPcCount;
+}
+
+/**
+ * Read histogram buckets
+ *
+ * @param firstBucket  Index of first bucket to read
+ * @param count        Number of buckets to read
+ * @param data         Where to place bucket counts (16-bit BIG-ENDIAN values, saturating)
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode readHistogram(unsigned firstBucket, unsigned count, uint8_t *data) {
+   if ((firstBucket > bucketCount) || (count > (bucketCount-firstBucket))) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   for (unsigned index=firstBucket; index<(firstBucket+count); index++) {
+      unpack16BE(buckets[index], data);
+      data += 2;
+   }
+   return BDM_RC_OK;
+}
+
+}; // End namespace PcSampler
@@ -0,0 +1,101 @@
+/** \file
+    \brief Statistical PC sampling of a running target
+
+   \verbatim
+
+   USBDM
+   Copyright (C) 2016  Peter O'Donoghue
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   \endverbatim
+ */
+
+#ifndef SOURCES_PCSAMPLER_H_
+#define SOURCES_PCSAMPLER_H_
+
+#include <stdint.h>
+#include "commands.h"
+
+/**
+ * Non-intrusive profiling of a running target.
+ *
+ * DWT_PCSR is sampled at a fixed rate set by a PIT channel and the samples
+ * are accumulated as a histogram of PC address buckets in probe RAM.
+ * Sampling is done while the command loop is idle so it never competes with
+ * command processing for the SWD interface.
+ */
+namespace PcSampler {
+
+/**
+ * Configure sampling and clear histogram
+ *
+ * @param baseAddress  Address corresponding to first bucket
+ * @param bucketShift  Size of each bucket as log2(bytes) (1..24)
+ * @param bucketCount  Number of buckets (1..PC_SAMPLE_MAX_BUCKETS)
+ * @param periodUs     Sample period in microseconds
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note Sampling is stopped
+ */
+USBDM_ErrorCode configure(uint32_t baseAddress, unsigned bucketShift, unsigned bucketCount, uint32_t periodUs);
+
+/**
+ * Start sampling
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode start();
+
+/**
+ * Stop sampling
+ */
+void stop();
+
+/**
+ * Clear histogram and sample counts
+ */
+void clear();
+
+/**
+ * Take any samples that are due.
+ * Called from the command loop while waiting for a command.
+ */
+void poll();
+
+/**
+ * Get sampling status
+ *
+ * @param running      Sampling is active
+ * @param totalCount   Total number of samples taken
+ * @param outsideCount Number of samples outside the histogram range
+ * @param noPcCount    Number of samples with no PC available (target halted or sleeping, SWD failure)
+ */
+void getStatus(bool &running, uint32_t &totalCount, uint32_t &outsideCount, uint32_t &noPcCount);
+
+/**
+ * Read histogram buckets
+ *
+ * @param firstBucket  Index of first bucket to read
+ * @param count        Number of buckets to read
+ * @param data         Where to place bucket counts (16-bit BIG-ENDIAN values, saturating)
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode readHistogram(unsigned firstBucket, unsigned count, uint8_t *data);
+
+}; // End namespace PcSampler
+
+#endif /* SOURCES_PCSAMPLER_H_ */
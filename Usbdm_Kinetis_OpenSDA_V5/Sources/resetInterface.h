@@ -24,6 +24,8 @@ private:
 
    static bool inline fResetActivity = false;
 
+   static bool inline fResetEvent = false;
+
    /**
     * Callback used to monitor reset events
     *
@@ -34,6 +36,7 @@ private:
       // Check if RESET pin event and pin is low
       if (Pin::getAndClearInterruptState() && isLow()) {
          fResetActivity = true;
+         fResetEvent    = true;
       }
    }
 
@@ -134,6 +137,19 @@ public:
       fResetActivity = false;
       return temp;
    }
+
+   /**
+    * Check and clear reset event flag.
+    * This is independent of resetActivity() and is used by the target event monitor.
+    *
+    * @return True  Reset has been active since last polled
+    * @return False Reset has not been active since last polled
+    */
+   static bool resetEvent() {
+      bool temp = fResetEvent;
+      fResetEvent = false;
+      return temp;
+   }
 };
 
 #endif /* SOURCES_RESETINTERFACE_H_ */
@@ -28,6 +28,7 @@
    +=========================================================================================================
    \endverbatim
  */
+#include "configure.h"
 #include "delay.h"
 #include "interface.h"
 #include "resetInterface.h"
@@ -265,6 +266,8 @@ public:
    using GpioB::setOutput;
    using GpioB::on;
    using GpioB::off;
+   using GpioB::gpioPTOR;
+   using GpioB::Pcr;
 };
 
 //===========================================================================
@@ -275,18 +278,52 @@ static constexpr uint32_t  SWD_DP_ABORT_CLEAR_STICKY_ERRORS = 0x0000001E;
 // Masks for SWD_DP_ABORT abort AP
 static constexpr uint32_t  SWD_DP_ABORT_ABORT_AP            = 0x00000001;
 
+// Masks for SWD_DP_ABORT clear STICKYORUN only
+static constexpr uint32_t  SWD_DP_ABORT_CLEAR_STICKY_ORUN   = 0x00000010;
+
 // Masks for SWD_DP_STATUS
 //static constexpr uint32_t  SwdRead_DP_STATUS_ANYERROR        = 0x000000B2;
+static constexpr uint32_t  SWD_DP_STATUS_STICKYORUN = (1<<1);
+static constexpr uint32_t  SWD_DP_STATUS_STICKYERR  = (1<<5);
 
 // Masks for SWD_DP_CONTROL
 static constexpr uint32_t  SWD_DP_CONTROL_POWER_REQ = (1<<30)|(1<<28);
 static constexpr uint32_t  SWD_DP_CONTROL_POWER_ACK = (1<<31)|(1<<29);
+static constexpr uint32_t  SWD_DP_CONTROL_ORUNDETECT = (1<<0);
 
-// AP number for AHB-AP (MEM-AP implementation)
-static constexpr uint32_t  AHB_AP_NUM        = (0x0);
+// Read/write bits of SWD_DP_CONTROL = CSYSPWRUPREQ,CDBGPWRUPREQ,CDBGRSTREQ,TRNCNT,MASKLANE,TRNMODE,ORUNDETECT
+static constexpr uint32_t  SWD_DP_CONTROL_RW_MASK   = 0x543FFF0D;
 
 // DP_SELECT register value to access AHB_AP Bank #0 for memory read/write
-static constexpr uint32_t ARM_AHB_AP_BANK0 = AHB_AP_NUM;
+// A[31:24] is the AP # of the MEM-AP selected by selectAp()
+static uint32_t ahbApBank0 = 0;
+
+// AP register addresses for readAPReg()/writeAPReg()
+static constexpr uint32_t  AP_CSW            = (0x00);
+static constexpr uint32_t  AP_TAR            = (0x04);
+static constexpr uint32_t  AP_DRW            = (0x0C);
+static constexpr uint32_t  AP_BASE           = (0xF8);
+static constexpr uint32_t  AP_IDR            = (0xFC);
+
+// AP.IDR bit indicating a MEM-AP
+static constexpr uint32_t  AP_IDR_MEM_AP     = (1<<16);
+
+// AP.BASE register masks
+static constexpr uint32_t  AP_BASE_PRESENT   = (1<<0);
+static constexpr uint32_t  AP_BASE_FORMAT    = (1<<1);
+static constexpr uint32_t  AP_BASE_LEGACY_NONE = 0xFFFFFFFF;
+static constexpr uint32_t  AP_BASE_ADDR_MASK = 0xFFFFF000;
+
+// ROM table entry masks
+static constexpr uint32_t  ROM_ENTRY_PRESENT     = (1<<0);
+static constexpr uint32_t  ROM_ENTRY_OFFSET_MASK = 0xFFFFF000;
+
+// Maximum number of ROM table entries examined
+static constexpr unsigned  ROM_TABLE_MAX_ENTRIES = 16;
+
+// Cortex-M System Control Space and CPUID register
+static constexpr uint32_t  SCS_BASE_ADDR     = 0xE000E000U;
+static constexpr uint32_t  CPUID_ADDR        = 0xE000ED00U;
 
 //   static constexpr uint32_t  AHB_CSW_REGNUM    = (0x0);  // CSW register bank+register number
 //   static constexpr uint32_t  AHB_TAR_REGNUM    = (0x4);  // TAR register bank+register number
@@ -294,13 +331,14 @@ static constexpr uint32_t ARM_AHB_AP_BANK0 = AHB_AP_NUM;
 
 
 // AHB-AP (MEM-AP) CSW Register masks
+static constexpr uint32_t  AHB_AP_CSW_INC_OFF       = (0<<4);
 static constexpr uint32_t  AHB_AP_CSW_INC_SINGLE    = (1<<4);
-//static constexpr uint32_t  AHB_AP_CSW_INC_PACKED    = (2<<4);
-//static constexpr uint32_t  AHB_AP_CSW_INC_MASK      = (3<<4);
+static constexpr uint32_t  AHB_AP_CSW_INC_PACKED    = (2<<4);
+static constexpr uint32_t  AHB_AP_CSW_INC_MASK      = (3<<4);
 static constexpr uint32_t  AHB_AP_CSW_SIZE_BYTE     = (0<<0);
 static constexpr uint32_t  AHB_AP_CSW_SIZE_HALFWORD = (1<<0);
 static constexpr uint32_t  AHB_AP_CSW_SIZE_WORD     = (2<<0);
-//static constexpr uint32_t  AHB_AP_CSW_SIZE_MASK     = (7<<0);
+static constexpr uint32_t  AHB_AP_CSW_SIZE_MASK     = (7<<0);
 
 // CTAR values used for communication
 uint32_t PreambleCtar;  //< Transmit  8 bits = Write:start,APnDP,RnW,ADDR(2:3),parity,stop,park
@@ -328,6 +366,20 @@ static constexpr uint32_t getcswValue(int size) {
    return cswValues[size];
 };
 
+/**
+ * Get AHB.CSW value for packed transfers based on size
+ *
+ * @param size Transfer size in bytes (one of 1 or 2)
+ *
+ * @return AHB.CSW mask.  This will include size and packed increment.
+ */
+static constexpr uint32_t getPackedcswValue(int size) {
+   return (getcswValue(size)&AHB_AP_CSW_SIZE_MASK)|AHB_AP_CSW_INC_PACKED;
+};
+
+/** Smallest word-aligned portion of a byte/halfword transfer worth doing as packed transfers */
+static constexpr uint32_t PACKED_MIN_BYTES = 8;
+
    /**
     * SWD ACK values padded to 5 bits e.g. 0 <ACK value> 0
     */
@@ -348,6 +400,261 @@ static const HardwarePtr<SPI_Type> spi = SpiInfo::baseAddress;
 /** Initial value of AHB_SP_CSW register read from target */
 static uint32_t ahb_ap_csw_defaultValue;
 
+/** Indicates AHB-AP supports packed transfers (determined with ahb_ap_csw_defaultValue) */
+static bool packedTransfersSupported;
+
+/**
+ * AHB-AP.CSW default value and packed transfer support of each AP.
+ * Discovered on first use of the AP and cached until the next connect().
+ */
+struct ApCswInfo {
+   uint32_t cswDefaultValue;  //!< 0 => not yet discovered
+   bool     packedSupported;
+};
+
+static ApCswInfo apCswInfo[SWD_MAX_APS];
+
+/** Count of transfers failing due to link errors (parity errors or corrupted ACKs) */
+static uint32_t linkErrorCount = 0;
+
+/** Count of successful transfers (used with linkErrorCount to judge link quality) */
+static uint32_t linkTransferCount = 0;
+
+/** SWD link statistics */
+static SwdStatistics statistics = {};
+
+/** A posted AHB-AP.DRW read has been done and its data not yet collected */
+static bool drwReadPending = false;
+
+/**
+ * Shadow copy of the read/write bits of DP.CTRL/STAT.
+ * This is not invalidated by failed transfers as the register only changes when written
+ * or on a DP power-on reset. It is refreshed by connect().
+ */
+static uint32_t dpControl      = 0;
+
+/** dpControl is valid */
+static bool     dpControlValid = false;
+
+/**
+ * Check if DP.CTRL/STAT.ORUNDETECT is set.\n
+ * While set, the target expects a data phase after WAIT and FAULT responses.
+ */
+static bool isOverrunDetectEnabled() {
+   return dpControlValid && ((dpControl&SWD_DP_CONTROL_ORUNDETECT) != 0);
+}
+
+/**
+ * Handling of WAIT responses to DP/AP register accesses (see setWaitPolicy())
+ */
+struct WaitPolicy {
+   unsigned retries;       //!< Maximum number of retries (0 => limited by timeout only)
+   unsigned idleCycles;    //!< Idle cycles inserted before each retry
+   uint32_t timeoutTicks;  //!< Maximum time to retry in DWT.CYCCNT ticks (0 => limited by retries only)
+};
+
+/** Current WAIT policy - default is immediate retries */
+static WaitPolicy waitPolicy = {2000, 0, 0};
+
+/** Indicates DMA block writes are streamed without checking individual ACKs */
+static bool streamingWrites = false;
+
+/**
+ * Shadow copies of DP.SELECT and AHB-AP CSW/TAR registers.
+ * These are used to avoid redundant register writes.
+ */
+struct DapShadow {
+   uint32_t select;        //!< Last value written to DP.SELECT
+   uint32_t csw;           //!< Last value written to AHB-AP.CSW
+   uint32_t tar;           //!< Current value of AHB-AP.TAR including auto-increment
+   bool     selectValid;   //!< select is valid
+   bool     cswValid;      //!< csw is valid
+   bool     tarValid;      //!< tar is valid
+};
+
+static DapShadow dapShadow;
+
+/**
+ * Invalidate all DAP shadow registers
+ */
+static void invalidateDapShadow() {
+   dapShadow.selectValid = false;
+   dapShadow.cswValid    = false;
+   dapShadow.tarValid    = false;
+}
+
+/**
+ * Check if DP.SELECT is known to select AHB-AP register bank 0 (CSW,TAR,DRW)
+ */
+static bool isAhbBank0Selected() {
+   return dapShadow.selectValid && ((dapShadow.select&0xFF0000F0) == ahbApBank0);
+}
+
+/**
+ * Update shadow AHB-AP.TAR to reflect auto-increment after DRW accesses
+ *
+ * @param accesses Number of DRW accesses completed
+ *
+ * @note TAR is unchanged if auto-increment is off
+ * @note TAR is invalidated if auto-increment is unknown or a 1K boundary is crossed
+ */
+static void advanceDapShadowTar(uint32_t accesses) {
+   if (!dapShadow.tarValid) {
+      return;
+   }
+   if (!dapShadow.cswValid) {
+      dapShadow.tarValid = false;
+      return;
+   }
+   uint32_t increment;
+   switch (dapShadow.csw & (AHB_AP_CSW_INC_MASK|AHB_AP_CSW_SIZE_MASK)) {
+      case AHB_AP_CSW_INC_OFF   |AHB_AP_CSW_SIZE_BYTE     :
+      case AHB_AP_CSW_INC_OFF   |AHB_AP_CSW_SIZE_HALFWORD :
+      case AHB_AP_CSW_INC_OFF   |AHB_AP_CSW_SIZE_WORD     : increment = 0; break;
+      case AHB_AP_CSW_INC_SINGLE|AHB_AP_CSW_SIZE_BYTE     : increment = 1; break;
+      case AHB_AP_CSW_INC_SINGLE|AHB_AP_CSW_SIZE_HALFWORD : increment = 2; break;
+      case AHB_AP_CSW_INC_SINGLE|AHB_AP_CSW_SIZE_WORD     : increment = 4; break;
+      case AHB_AP_CSW_INC_PACKED|AHB_AP_CSW_SIZE_BYTE     : increment = 4; break;
+      case AHB_AP_CSW_INC_PACKED|AHB_AP_CSW_SIZE_HALFWORD : increment = 4; break;
+      default :
+         dapShadow.tarValid = false;
+         return;
+   }
+   uint32_t newTar = dapShadow.tar + accesses*increment;
+   if (((newTar^dapShadow.tar) & ~(TAR_INCREMENT_BOUNDARY-1)) != 0) {
+      // Auto-increment is only guaranteed within 1K block
+      dapShadow.tarValid = false;
+      return;
+   }
+   dapShadow.tar = newTar;
+}
+
+/**
+ * Update shadow registers after successful register write
+ *
+ * @param swdWrite SWD command byte used
+ * @param data     Value written
+ */
+static void updateDapShadowOnWrite(const SwdWrite swdWrite, const uint32_t data) {
+   if (swdWrite == SwdWrite_DP_SELECT) {
+      dapShadow.select      = data;
+      dapShadow.selectValid = true;
+      return;
+   }
+   if ((swdWrite != SwdWrite_AHB_CSW) && (swdWrite != SwdWrite_AHB_TAR) && (swdWrite != SwdWrite_AHB_DRW)) {
+      return;
+   }
+   if (!isAhbBank0Selected()) {
+      if (!dapShadow.selectValid) {
+         // May have changed AHB-AP registers
+         dapShadow.cswValid = false;
+         dapShadow.tarValid = false;
+      }
+      return;
+   }
+   switch(swdWrite) {
+      case SwdWrite_AHB_CSW :
+         dapShadow.csw      = data;
+         dapShadow.cswValid = true;
+         break;
+      case SwdWrite_AHB_TAR :
+         dapShadow.tar      = data;
+         dapShadow.tarValid = true;
+         break;
+      default:
+         advanceDapShadowTar(1);
+         break;
+   }
+}
+
+/**
+ * Update shadow registers after successful register read
+ *
+ * @param swdRead SWD command byte used
+ */
+static void updateDapShadowOnRead(const SwdRead swdRead) {
+   if (swdRead != SwdRead_AHB_DRW) {
+      return;
+   }
+   if (isAhbBank0Selected()) {
+      advanceDapShadowTar(1);
+   }
+   else if (!dapShadow.selectValid) {
+      // May have been DRW access
+      dapShadow.tarValid = false;
+   }
+}
+
+/**
+ * Count AHB-AP.DRW data words collected by a successful register read.
+ * AP reads are posted so a DRW read returns the data of the previous AP read
+ * and the data of the last one is collected by a following AP or RDBUFF read.
+ *
+ * @param swdRead SWD command byte used
+ */
+static void countDrwReadData(const SwdRead swdRead) {
+   switch(swdRead) {
+      case SwdRead_AP_REG0 :
+      case SwdRead_AP_REG1 :
+      case SwdRead_AP_REG2 :
+      case SwdRead_AP_REG3 :
+      case SwdRead_DP_RDBUFF :
+         if (drwReadPending) {
+            statistics.drwWords++;
+         }
+         drwReadPending = (swdRead == SwdRead_AHB_DRW);
+         break;
+      default:
+         break;
+   }
+}
+
+/**
+ * Write DP.SELECT unless already known to have this value
+ *
+ * @param value Value to write
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode writeSelect(uint32_t value) {
+   if (dapShadow.selectValid && (dapShadow.select == value)) {
+      return BDM_RC_OK;
+   }
+   return writeReg(SwdWrite_DP_SELECT, value);
+}
+
+/**
+ * Write AHB-AP.CSW unless already known to have this value
+ *
+ * @param value Value to write
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note Assumes DP.SELECT has been set to access AHB-AP register bank 0
+ */
+static USBDM_ErrorCode writeCsw(uint32_t value) {
+   if (dapShadow.cswValid && (dapShadow.csw == value)) {
+      return BDM_RC_OK;
+   }
+   return writeReg(SwdWrite_AHB_CSW, value);
+}
+
+/**
+ * Write AHB-AP.TAR unless already known to have this value
+ *
+ * @param address Value to write
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note Assumes DP.SELECT has been set to access AHB-AP register bank 0
+ */
+static USBDM_ErrorCode writeTar(uint32_t address) {
+   if (dapShadow.tarValid && (dapShadow.tar == address)) {
+      return BDM_RC_OK;
+   }
+   return writeReg(SwdWrite_AHB_TAR, address);
+}
+
 /**
  * Calculate parity of a 32-bit value
  *
@@ -398,46 +705,742 @@ static void tx32(const uint32_t data) {
 }
 
 /**
- * Sets Communication speed for SPI
+ *  Transmit idle cycles (SWDIO low)
+ *
+ *  @param cycles Number of cycles - rounded up to a multiple of 8
+ */
+static void txIdle(unsigned cycles) {
+   spi->CTAR[0] = PreambleCtar;
+
+   spi->SR = SPI_SR_TCF_MASK|SPI_SR_EOQF_MASK;
+
+   SwdDataBuffer::on();
+   while (cycles > 0) {
+      spi->PUSHR = 0b00000000|SPI_PUSHR_CTAS(0)|SPI_PUSHR_CONT(0)|SPI_PUSHR_EOQ(1);
+
+      // Wait until End of Transmission
+      while ((spi->SR & SPI_SR_EOQF_MASK)==0) {
+      }
+      spi->SR = SPI_SR_TCF_MASK|SPI_SR_EOQF_MASK;
+      (void)(spi->POPR);
+      cycles = (cycles>8)?(cycles-8):0;
+   }
+   SwdDataBuffer::off();
+}
+
+/**
+ * Decide whether to retry a transfer after a WAIT response.
+ * Inserts idle cycles before the retry as set by the WAIT policy.
+ *
+ * @param retry      Number of retries so far (updated)
+ * @param startTime  Time of first WAIT response (updated on first WAIT)
+ *
+ * @return true  => Retry transfer
+ * @return false => Give up (BDM_RC_ACK_TIMEOUT)
+ */
+static bool retryAfterWait(unsigned &retry, uint32_t &startTime) {
+   statistics.waitRetries++;
+   uint32_t now = DWT->CYCCNT;
+   if (retry == 0) {
+      startTime = now;
+   }
+   retry++;
+   if ((waitPolicy.retries != 0) && (retry > waitPolicy.retries)) {
+      return false;
+   }
+   if ((waitPolicy.timeoutTicks != 0) && ((now-startTime) >= waitPolicy.timeoutTicks)) {
+      return false;
+   }
+   if (waitPolicy.idleCycles != 0) {
+      txIdle(waitPolicy.idleCycles);
+   }
+   return true;
+}
+
+/**
+ * Sets Communication speed for SPI
+ *
+ * @param frequency Frequency in Hz
+ *
+ * @return BDM_RC_OK success
+ *
+ * Note: Chooses the highest speed that is not greater than frequency.
+ */
+USBDM_ErrorCode setSpeed(uint32_t frequency) {
+   const uint32_t ctarBase = Spi::calculateCtarTiming(SpiInfo::getClockFrequency(), frequency);
+
+   PreambleCtar = ctarBase|SpiMode_3|SpiFrameSize_8_bits |SpiBitOrder_MsbFirst;
+   AckCtar      = ctarBase|SpiMode_2|SpiFrameSize_5_bits |SpiBitOrder_MsbFirst;
+   RxCtar       = ctarBase|SpiMode_2|SpiFrameSize_16_bits|SpiBitOrder_LsbFirst;
+   TxCtar       = ctarBase|SpiMode_3|SpiFrameSize_11_bits|SpiBitOrder_LsbFirst;
+   Tx16Ctar     = ctarBase|SpiMode_3|SpiFrameSize_16_bits|SpiBitOrder_LsbFirst;
+
+//   console.setPadding(Padding_LeadingZeroes).setWidth(32);
+//   console.writeln("PreambleCtar 0b", PreambleCtar, Radix_2);
+//   console.writeln("AckCtar      0b", AckCtar, Radix_2);
+//   console.writeln("RxCtar       0b", RxCtar, Radix_2);
+//   console.writeln("TxCtar       0b", TxCtar, Radix_2);
+//   console.writeln("Tx16Ctar     0b", Tx16Ctar, Radix_2);
+
+   return BDM_RC_OK;
+}
+
+/**
+ * Gets Communication speed of SWD
+ *
+ * @return frequency Frequency in Hz
+ *
+ * @note This may differ from set speed due to limited range of speeds available
+ */
+uint32_t getSpeed() {
+   return Spi::calculateSpeed(SpiInfo::getClockFrequency(), TxCtar);
+}
+
+/**
+ * Gets speed that would be used for a requested SWD frequency
+ *
+ * @param frequency Frequency in Hz
+ *
+ * @return Achievable frequency in Hz (highest speed that is not greater than frequency)
+ */
+uint32_t getAchievableSpeed(uint32_t frequency) {
+   return Spi::calculateSpeed(SpiInfo::getClockFrequency(), Spi::calculateCtarTiming(SpiInfo::getClockFrequency(), frequency));
+}
+
+/**
+ * Gets count of SWD transfers that failed due to link errors
+ * i.e. parity errors or corrupted ACKs (not WAIT, FAULT or no response)
+ *
+ * @return Error count (wraps)
+ */
+uint32_t getLinkErrorCount() {
+   return linkErrorCount;
+}
+
+/**
+ * Gets count of successful SWD transfers
+ *
+ * @return Transfer count (wraps)
+ */
+uint32_t getLinkTransferCount() {
+   return linkTransferCount;
+}
+
+/**
+ * Get SWD link statistics
+ *
+ * @param stats Where to return statistics
+ */
+void getStatistics(SwdStatistics &stats) {
+   stats = statistics;
+}
+
+/**
+ * Clear SWD link statistics
+ */
+void clearStatistics() {
+   statistics = {};
+}
+
+/**
+ * Set handling of WAIT responses to DP/AP register accesses
+ *
+ * @param retries     Maximum number of retries after WAIT (0 => limited by timeout only)
+ * @param idleCycles  Idle cycles inserted before each retry (rounded up to a multiple of 8)
+ * @param timeoutUs   Maximum time to retry in microseconds (0 => limited by retries only)
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode setWaitPolicy(unsigned retries, unsigned idleCycles, uint32_t timeoutUs) {
+   static constexpr uint32_t MAX_TIMEOUT_US = 1000000;
+
+   if (((retries == 0) && (timeoutUs == 0)) || (timeoutUs > MAX_TIMEOUT_US)) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   waitPolicy.retries      = retries;
+   waitPolicy.idleCycles   = idleCycles;
+   waitPolicy.timeoutTicks = timeoutUs*(SystemCoreClock/1000000);
+   return BDM_RC_OK;
+}
+
+/**
+ * Enable streaming block writes.
+ * When enabled, DMA block writes are transferred as a continuous run without checking
+ * individual ACKs. DP.CTRL/STAT is checked once at the end of the run and on an overrun
+ * the write resumes with checked transfers from the first element not written (from AHB-AP.TAR).
+ *
+ * @param enable True to enable streaming writes
+ */
+void setStreamingWrites(bool enable) {
+   streamingWrites = enable;
+}
+
+#if SWD_DMA_TRANSFERS
+//===========================================================================
+// DMA driven DRW block transfers
+//
+// Each SPI frame of a transaction is handled in lock-step by three linked DMA channels:
+//  - RX channel   : Triggered by SPI RFDF. Pops the received frame to dmaRxFrames[]
+//  - GPIO channel : Linked from RX channel. Writes dmaToggles[] to GPIO.PTOR to turn the SWDIO buffer around
+//  - TX channel   : Linked from GPIO channel. Writes the next CTAR[1] and PUSHR values from dmaTxFrames[]
+//
+// ACKs are not examined while the transfer is in progress.
+// DP.CTRL/STAT.ORUNDETECT is set so the target always completes the data phase and
+// any WAIT/FAULT will set STICKYORUN.  ACK and parity are checked after each chunk completes.
+// ORUNDETECT is left set afterwards - readReg()/writeReg() complete the data phase of
+// WAIT/FAULT responses while it is set.
+//
+// Streaming writes split the frame lists into two halves. The next chunk is prepared in one half
+// while the other is transferred and started as soon as the previous chunk completes.
+// No ACKs are examined - DP.CTRL/STAT is checked once at the end of the run.
+//
+// Note: The DMA library (dma.h) is not configured for this target so the hardware is used directly.
+
+/** DMA Object */
+static const HardwarePtr<DMA_Type>    dma    = Dma0Info::baseAddress;
+
+/** DMAMUX Object */
+static const HardwarePtr<DMAMUX_Type> dmamux = Dmamux0Info::baseAddress;
+
+/** DMA channel receiving SPI frames */
+static constexpr unsigned DMA_RX_CHANNEL   = 0;
+
+/** DMA channel doing SWDIO buffer turn-around */
+static constexpr unsigned DMA_GPIO_CHANNEL = 1;
+
+/** DMA channel transmitting SPI frames */
+static constexpr unsigned DMA_TX_CHANNEL   = 2;
+
+/** Maximum number of DRW transactions in a single DMA chunk */
+static constexpr unsigned DMA_MAX_TRANSACTIONS = 8;
+
+/** SPI frames in a DRW read transaction = Preamble,T+ACK+Data[0],Data[1-16],Data[17-31]+Parity,Idle */
+static constexpr unsigned DMA_READ_FRAMES  = 5;
+
+/** SPI frames in a DRW write transaction = Preamble,T+ACK+T,Data[0-10],Data[11-21],Data[22-31]+Parity,Idle */
+static constexpr unsigned DMA_WRITE_FRAMES = 6;
+
+/** DRW write transactions in each half of the frame lists when streaming writes */
+static constexpr unsigned DMA_STREAM_TRANSACTIONS = DMA_MAX_TRANSACTIONS/2;
+
+/** Smallest transfer (in elements) worth the overhead of setting up DMA */
+static constexpr unsigned DMA_MIN_TRANSACTIONS = 8;
+
+/** Value written to GPIO.PTOR to turn around the SWDIO buffer */
+static constexpr uint32_t SWDIO_TOGGLE = SwdDataBuffer::Pcr::BITMASK;
+
+/** CTAR[1] and PUSHR values for a single SPI frame */
+struct DmaTxFrame {
+   uint32_t ctar1;
+   uint32_t pushr;
+};
+
+static DmaTxFrame dmaTxFrames[DMA_MAX_TRANSACTIONS*DMA_WRITE_FRAMES];
+static uint32_t   dmaToggles[DMA_MAX_TRANSACTIONS*DMA_WRITE_FRAMES];
+static uint32_t   dmaRxFrames[DMA_MAX_TRANSACTIONS*DMA_WRITE_FRAMES];
+
+/**
+ * Initialise DMA hardware used for SWD transfers
+ */
+static void dmaInitialise() {
+   Dma0Info::enableClock();
+   Dmamux0Info::enableClock();
+
+   // Minor loop offsets are used by TX channel
+   dma->CR = DMA_CR_EMLM(1);
+
+   // Only RX channel is hardware triggered - others are linked
+   dmamux->CHCFG[DMA_RX_CHANNEL]   = DMAMUX_CHCFG_ENBL(1)|DMAMUX_CHCFG_SOURCE(Dma0Slot_SPI0_Rx);
+   dmamux->CHCFG[DMA_GPIO_CHANNEL] = 0;
+   dmamux->CHCFG[DMA_TX_CHANNEL]   = 0;
+}
+
+/**
+ * Add DRW read transaction to DMA frame lists
+ *
+ * @param frame Index of first frame to use
+ *
+ * @return Index of next free frame
+ */
+static unsigned dmaAddReadTransaction(unsigned frame) {
+   // Preamble then release SWDIO for T,ACK
+   dmaTxFrames[frame] = {AckCtar, SwdRead_AHB_DRW|SPI_PUSHR_CTAS(0)|SPI_PUSHR_CONT(0)|SPI_PUSHR_EOQ(0)};
+   dmaToggles[frame++] = SWDIO_TOGGLE;
+   // T,ACK,Data[0]
+   dmaTxFrames[frame] = {AckCtar, 0b00000|SPI_PUSHR_CTAS(1)|SPI_PUSHR_CONT(0)|SPI_PUSHR_EOQ(0)};
+   dmaToggles[frame++] = 0;
+   // Data[1-16]
+   dmaTxFrames[frame] = {RxCtar,  0xFFFF|SPI_PUSHR_CTAS(1)|SPI_PUSHR_CONT(0)|SPI_PUSHR_EOQ(0)};
+   dmaToggles[frame++] = 0;
+   // Data[17-31],Parity then drive SWDIO for idle
+   dmaTxFrames[frame] = {RxCtar,  0xFFFF|SPI_PUSHR_CTAS(1)|SPI_PUSHR_CONT(0)|SPI_PUSHR_EOQ(0)};
+   dmaToggles[frame++] = SWDIO_TOGGLE;
+   // 8 bits idle
+   dmaTxFrames[frame] = {AckCtar, 0b00000000|SPI_PUSHR_CTAS(0)|SPI_PUSHR_CONT(0)|SPI_PUSHR_EOQ(0)};
+   dmaToggles[frame++] = 0;
+   return frame;
+}
+
+/**
+ * Add DRW write transaction to DMA frame lists
+ *
+ * @param frame Index of first frame to use
+ * @param data  32-bit value to write
+ *
+ * @return Index of next free frame
+ */
+static unsigned dmaAddWriteTransaction(unsigned frame, uint32_t data) {
+   uint32_t parity = calcParity(data)?(1<<10):0;
+
+   // Preamble then release SWDIO for T,ACK,T
+   dmaTxFrames[frame] = {AckCtar, SwdWrite_AHB_DRW|SPI_PUSHR_CTAS(0)|SPI_PUSHR_CONT(0)|SPI_PUSHR_EOQ(0)};
+   dmaToggles[frame++] = SWDIO_TOGGLE;
+   // T,ACK,T then drive SWDIO for data
+   dmaTxFrames[frame] = {AckCtar, SWD_ACK_OK|SPI_PUSHR_CTAS(1)|SPI_PUSHR_CONT(0)|SPI_PUSHR_EOQ(0)};
+   dmaToggles[frame++] = SWDIO_TOGGLE;
+   // 3x11 bits = Data(0-10), Data(11-21), Data(22-31),parity
+   dmaTxFrames[frame] = {TxCtar, ((uint16_t)(data>>0))|SPI_PUSHR_CTAS(1)|SPI_PUSHR_CONT(1)|SPI_PUSHR_EOQ(0)};
+   dmaToggles[frame++] = 0;
+   dmaTxFrames[frame] = {TxCtar, ((uint16_t)(data>>11))|SPI_PUSHR_CTAS(1)|SPI_PUSHR_CONT(1)|SPI_PUSHR_EOQ(0)};
+   dmaToggles[frame++] = 0;
+   dmaTxFrames[frame] = {TxCtar, ((uint16_t)(data>>22))|parity|SPI_PUSHR_CTAS(1)|SPI_PUSHR_CONT(0)|SPI_PUSHR_EOQ(0)};
+   dmaToggles[frame++] = 0;
+   // 8 bits idle
+   dmaTxFrames[frame] = {TxCtar, 0b00000000|SPI_PUSHR_CTAS(0)|SPI_PUSHR_CONT(0)|SPI_PUSHR_EOQ(0)};
+   dmaToggles[frame++] = 0;
+   return frame;
+}
+
+/**
+ * Add DRW write transactions for a block of data to DMA frame lists
+ *
+ * @param frame         Index of first frame to use
+ * @param transactions  Number of DRW write transactions
+ * @param elementSize   Size of the data elements
+ * @param addr          Address in target memory (updated)
+ * @param data_ptr      Data to write (updated)
+ *
+ * @return Index of next free frame
+ */
+static unsigned dmaAddWriteTransactions(unsigned frame, unsigned transactions, uint32_t elementSize, uint32_t &addr, const uint8_t *&data_ptr) {
+   for (unsigned index=0; index<transactions; index++) {
+      uint32_t data = 0;
+      for (unsigned byte=0; byte<elementSize; byte++) {
+         data |= (*data_ptr++)<<(8*((addr&0x3)+byte));
+      }
+      addr  += elementSize;
+      frame  = dmaAddWriteTransaction(frame, data);
+   }
+   return frame;
+}
+
+/**
+ * Start transfer of SPI frames in dmaTxFrames[] using DMA
+ *
+ * @param firstFrame Index of first frame to transfer
+ * @param frameCount Number of frames to transfer
+ *
+ * @note Use dmaWaitTransfer() to wait for completion
+ * @note Frames outside the range may be modified while the transfer is in progress
+ */
+static void dmaStartTransfer(unsigned firstFrame, unsigned frameCount) {
+   static constexpr uint16_t ATTR_32BIT = DMA_ATTR_SSIZE(2)|DMA_ATTR_DSIZE(2);
+
+   const DmaTxFrame *txFrames = dmaTxFrames+firstFrame;
+   uint32_t         *toggles  = dmaToggles+firstFrame;
+
+   // Final idle frame releases SWDIO
+   toggles[frameCount-1] ^= SWDIO_TOGGLE;
+
+   // RX channel : SPI.POPR => dmaRxFrames[], link to GPIO channel after each frame
+   dma->TCD[DMA_RX_CHANNEL].SADDR          = (uint32_t)&spi->POPR;
+   dma->TCD[DMA_RX_CHANNEL].SOFF           = 0;
+   dma->TCD[DMA_RX_CHANNEL].ATTR           = ATTR_32BIT;
+   dma->TCD[DMA_RX_CHANNEL].NBYTES_MLNO    = sizeof(uint32_t);
+   dma->TCD[DMA_RX_CHANNEL].SLAST          = 0;
+   dma->TCD[DMA_RX_CHANNEL].DADDR          = (uint32_t)(dmaRxFrames+firstFrame);
+   dma->TCD[DMA_RX_CHANNEL].DOFF           = sizeof(uint32_t);
+   dma->TCD[DMA_RX_CHANNEL].CITER_ELINKYES =
+         DMA_CITER_ELINKYES_ELINK(1)|DMA_CITER_ELINKYES_LINKCH(DMA_GPIO_CHANNEL)|DMA_CITER_ELINKYES_CITER(frameCount);
+   dma->TCD[DMA_RX_CHANNEL].BITER_ELINKYES =
+         DMA_BITER_ELINKYES_ELINK(1)|DMA_BITER_ELINKYES_LINKCH(DMA_GPIO_CHANNEL)|DMA_BITER_ELINKYES_BITER(frameCount);
+   dma->TCD[DMA_RX_CHANNEL].DLASTSGA       = 0;
+   dma->TCD[DMA_RX_CHANNEL].CSR            =
+         DMA_CSR_DREQ(1)|DMA_CSR_MAJORELINK(1)|DMA_CSR_MAJORLINKCH(DMA_GPIO_CHANNEL);
+
+   // GPIO channel : dmaToggles[] => GPIO.PTOR, link to TX channel (except after last frame)
+   dma->TCD[DMA_GPIO_CHANNEL].SADDR          = (uint32_t)toggles;
+   dma->TCD[DMA_GPIO_CHANNEL].SOFF           = sizeof(uint32_t);
+   dma->TCD[DMA_GPIO_CHANNEL].ATTR           = ATTR_32BIT;
+   dma->TCD[DMA_GPIO_CHANNEL].NBYTES_MLNO    = sizeof(uint32_t);
+   dma->TCD[DMA_GPIO_CHANNEL].SLAST          = 0;
+   dma->TCD[DMA_GPIO_CHANNEL].DADDR          = SwdDataBuffer::gpioPTOR;
+   dma->TCD[DMA_GPIO_CHANNEL].DOFF           = 0;
+   dma->TCD[DMA_GPIO_CHANNEL].CITER_ELINKYES =
+         DMA_CITER_ELINKYES_ELINK(1)|DMA_CITER_ELINKYES_LINKCH(DMA_TX_CHANNEL)|DMA_CITER_ELINKYES_CITER(frameCount);
+   dma->TCD[DMA_GPIO_CHANNEL].BITER_ELINKYES =
+         DMA_BITER_ELINKYES_ELINK(1)|DMA_BITER_ELINKYES_LINKCH(DMA_TX_CHANNEL)|DMA_BITER_ELINKYES_BITER(frameCount);
+   dma->TCD[DMA_GPIO_CHANNEL].DLASTSGA       = 0;
+   dma->TCD[DMA_GPIO_CHANNEL].CSR            = 0;
+
+   // TX channel : txFrames[1..] => SPI.CTAR[1], SPI.PUSHR
+   // Minor loop offset returns destination to CTAR[1] after each frame
+   constexpr int16_t ctarToPushr = offsetof(SPI_Type, PUSHR)-offsetof(SPI_Type, CTAR[1]);
+   dma->TCD[DMA_TX_CHANNEL].SADDR            = (uint32_t)(txFrames+1);
+   dma->TCD[DMA_TX_CHANNEL].SOFF             = sizeof(uint32_t);
+   dma->TCD[DMA_TX_CHANNEL].ATTR             = ATTR_32BIT;
+   dma->TCD[DMA_TX_CHANNEL].NBYTES_MLOFFYES  =
+         DMA_NBYTES_MLOFFYES_DMLOE(1)|DMA_NBYTES_MLOFFYES_MLOFF(-2*ctarToPushr)|DMA_NBYTES_MLOFFYES_NBYTES(sizeof(DmaTxFrame));
+   dma->TCD[DMA_TX_CHANNEL].SLAST            = 0;
+   dma->TCD[DMA_TX_CHANNEL].DADDR            = (uint32_t)&spi->CTAR[1];
+   dma->TCD[DMA_TX_CHANNEL].DOFF             = ctarToPushr;
+   dma->TCD[DMA_TX_CHANNEL].CITER_ELINKNO    = frameCount-1;
+   dma->TCD[DMA_TX_CHANNEL].BITER_ELINKNO    = frameCount-1;
+   dma->TCD[DMA_TX_CHANNEL].DLASTSGA         = 0;
+   dma->TCD[DMA_TX_CHANNEL].CSR              = 0;
+
+   spi->SR   = SPI_SR_TCF_MASK|SPI_SR_EOQF_MASK|SPI_SR_RFDF_MASK;
+   spi->RSER = SPI_RSER_RFDF_RE(1)|SPI_RSER_RFDF_DIRS(1);
+   dma->SERQ = DMA_RX_CHANNEL;
+
+   // First frame is written directly
+   spi->CTAR[0] = PreambleCtar;
+   spi->CTAR[1] = txFrames[0].ctar1;
+   SwdDataBuffer::on();
+   spi->PUSHR   = txFrames[0].pushr;
+}
+
+/**
+ * Wait for completion of transfer started by dmaStartTransfer()
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note SWDIO buffer is released on completion
+ */
+static USBDM_ErrorCode dmaWaitTransfer() {
+   // GPIO channel completes last
+   while (((dma->TCD[DMA_GPIO_CHANNEL].CSR & DMA_CSR_DONE_MASK) == 0) && (dma->ERR == 0)) {
+   }
+   spi->RSER = 0;
+   spi->SR   = SPI_SR_TCF_MASK|SPI_SR_EOQF_MASK|SPI_SR_RFDF_MASK;
+
+   if (dma->ERR != 0) {
+      // Abandon transfer
+      dma->CERQ = DMA_RX_CHANNEL;
+      dma->CERR = DMA_CERR_CAEI_MASK;
+      spi->MCR  = spi->MCR|SPI_MCR_CLR_RXF_MASK|SPI_MCR_CLR_TXF_MASK;
+      SwdDataBuffer::off();
+      return BDM_RC_FAIL;
+   }
+   return BDM_RC_OK;
+}
+
+/**
+ * Transfer the SPI frames in dmaTxFrames[] using DMA
+ *
+ * @param frameCount Number of frames to transfer
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note On return dmaRxFrames[] contains the data received for each frame
+ * @note SWDIO buffer is released on completion
+ */
+static USBDM_ErrorCode dmaTransferFrames(unsigned frameCount) {
+   dmaStartTransfer(0, frameCount);
+   return dmaWaitTransfer();
+}
+
+/**
+ * Record a transfer that did not receive a valid ACK
+ *
+ * @param ack ACK value as received in 5-bit frame
+ *
+ * @note No response at all (SWDIO not driven) is not counted as a link error
+ *       as it is expected from a sleeping, resetting or unpowered target.
+ */
+static void recordInvalidAck(uint32_t ack) {
+   statistics.noAcks++;
+   if ((ack & SW_ACK_MASK) != SW_ACK_MASK) {
+      // Corrupted ACK
+      linkErrorCount++;
+   }
+}
+
+/**
+ * Check ACK received for a DRW transaction
+ *
+ * @param ack ACK value as received in 5-bit frame
+ *
+ * @return Error code corresponding to ACK
+ */
+static USBDM_ErrorCode dmaCheckAck(uint32_t ack) {
+   switch ((SwdAck)(ack & SW_ACK_MASK)) {
+      case SWD_ACK_OK    : return BDM_RC_OK;
+      case SWD_ACK_WAIT  : return BDM_RC_ACK_TIMEOUT; // Not retried - caller completes with register transfers
+      case SWD_ACK_FAULT : statistics.faults++;       return BDM_RC_ARM_FAULT_ERROR;
+      default            : recordInvalidAck(ack);     return BDM_RC_NO_CONNECTION;
+   }
+}
+
+/**
+ * Set DP.CTRL/STAT.ORUNDETECT
+ *
+ * Other bits of DP.CTRL/STAT (e.g. as set by the host) are preserved and the register
+ * is only written if ORUNDETECT is not already set. ORUNDETECT is left set after the transfer
+ * so consecutive DMA blocks do not re-write DP.CTRL/STAT.
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode enableOverrunDetect() {
+   if (!dpControlValid) {
+      // Reading DP.CTRL/STAT updates dpControl
+      uint32_t status;
+      USBDM_ErrorCode rc = readReg(SwdRead_DP_STATUS, status);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+   }
+   if (isOverrunDetectEnabled()) {
+      return BDM_RC_OK;
+   }
+   return writeReg(SwdWrite_DP_CONTROL, dpControl|SWD_DP_CONTROL_ORUNDETECT);
+}
+
+/**
+ * Clean up after DMA transfer
+ *
+ * @param rc Result of transfer
+ *
+ * @return rc
+ */
+static USBDM_ErrorCode dmaCompleteTransfer(USBDM_ErrorCode rc) {
+   if (rc != BDM_RC_OK) {
+      // Clears STICKYORUN etc
+      clearStickyBits();
+      invalidateDapShadow();
+   }
+   return rc;
+}
+
+/**
+ *  Read ARM-SWD Memory using DMA
+ *
+ *  @param elementSize  Size of the data elements
+ *  @param count        Number of data bytes
+ *  @param addr         Address in target memory
+ *  @param data_ptr     Where in buffer to write the data
+ *  @param bytesDone    Number of bytes successfully read (valid even on failure)
+ *
+ *  @return BDM_RC_OK => success, error otherwise
+ *
+ *  @note AHB-AP SELECT, CSW and TAR must have been set up by caller
+ */
+static USBDM_ErrorCode dmaReadMemory(uint32_t elementSize, unsigned count, uint32_t addr, uint8_t *data_ptr, unsigned &bytesDone) {
+
+   unsigned elements  = count/elementSize;
+   unsigned completed = 0;   // DRW transactions completed. Each returns data from the previous transaction
+
+   bytesDone = 0;
+
+   USBDM_ErrorCode rc = enableOverrunDetect();
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   while (completed < elements) {
+      unsigned transactions = elements-completed;
+      if (transactions > DMA_MAX_TRANSACTIONS) {
+         transactions = DMA_MAX_TRANSACTIONS;
+      }
+      unsigned frame = 0;
+      for (unsigned index=0; index<transactions; index++) {
+         frame = dmaAddReadTransaction(frame);
+      }
+      rc = dmaTransferFrames(frame);
+      if (rc != BDM_RC_OK) {
+         break;
+      }
+      const uint32_t *rx = dmaRxFrames;
+      for (unsigned index=0; index<transactions; index++, rx+=DMA_READ_FRAMES) {
+         rc = dmaCheckAck(rx[1]);
+         if (rc != BDM_RC_OK) {
+            break;
+         }
+         advanceDapShadowTar(1);
+         uint32_t data = (rx[1] & 0b00001)|(rx[2]<<1)|(rx[3]<<17);
+         if ((rx[3]>>15) != calcParity(data)) {
+            statistics.parityErrors++;
+            linkErrorCount++;
+            rc = BDM_RC_ARM_PARITY_ERROR;
+            break;
+         }
+         linkTransferCount++;
+         if (completed++ > 0) {
+            // Save data from previous read
+            statistics.drwWords++;
+            for (unsigned byte=0; byte<elementSize; byte++) {
+               *data_ptr++ = (uint8_t)(data>>(8*((addr&0x3)+byte)));
+            }
+            addr      += elementSize;
+            bytesDone += elementSize;
+         }
+      }
+      if (rc != BDM_RC_OK) {
+         break;
+      }
+   }
+   if (rc == BDM_RC_OK) {
+      // Read data from RDBUFF for final read
+      drwReadPending = true;
+      uint32_t data;
+      rc = readReg(SwdRead_DP_RDBUFF, data);
+      if (rc == BDM_RC_OK) {
+         for (unsigned byte=0; byte<elementSize; byte++) {
+            *data_ptr++ = (uint8_t)(data>>(8*((addr&0x3)+byte)));
+         }
+         bytesDone += elementSize;
+      }
+   }
+   return dmaCompleteTransfer(rc);
+}
+
+/**
+ *  Write ARM-SWD Memory using DMA without checking individual ACKs (streaming writes)
  *
- * @param frequency Frequency in Hz
+ *  @param elementSize  Size of the data elements
+ *  @param count        Number of data bytes
+ *  @param addr         Address in target memory
+ *  @param data_ptr     Data to write
+ *  @param bytesDone    Number of bytes successfully written (valid even on failure)
  *
- * @return BDM_RC_OK success
+ *  @return BDM_RC_OK => success, error otherwise
  *
- * Note: Chooses the highest speed that is not greater than frequency.
+ *  @note AHB-AP SELECT, CSW and TAR must have been set up by caller and DP.CTRL/STAT.ORUNDETECT set
+ *  @note The transfer must not cross a TAR_INCREMENT_BOUNDARY
+ *  @note After a WAIT or FAULT all following DRW writes are rejected while STICKYORUN/STICKYERR
+ *        is set so AHB-AP.TAR then addresses the first element not written
  */
-USBDM_ErrorCode setSpeed(uint32_t frequency) {
-   const uint32_t ctarBase = Spi::calculateCtarTiming(SpiInfo::getClockFrequency(), frequency);
-
-   PreambleCtar = ctarBase|SpiMode_3|SpiFrameSize_8_bits |SpiBitOrder_MsbFirst;
-   AckCtar      = ctarBase|SpiMode_2|SpiFrameSize_5_bits |SpiBitOrder_MsbFirst;
-   RxCtar       = ctarBase|SpiMode_2|SpiFrameSize_16_bits|SpiBitOrder_LsbFirst;
-   TxCtar       = ctarBase|SpiMode_3|SpiFrameSize_11_bits|SpiBitOrder_LsbFirst;
-   Tx16Ctar     = ctarBase|SpiMode_3|SpiFrameSize_16_bits|SpiBitOrder_LsbFirst;
-
-//   console.setPadding(Padding_LeadingZeroes).setWidth(32);
-//   console.writeln("PreambleCtar 0b", PreambleCtar, Radix_2);
-//   console.writeln("AckCtar      0b", AckCtar, Radix_2);
-//   console.writeln("RxCtar       0b", RxCtar, Radix_2);
-//   console.writeln("TxCtar       0b", TxCtar, Radix_2);
-//   console.writeln("Tx16Ctar     0b", Tx16Ctar, Radix_2);
-
-   return BDM_RC_OK;
+static USBDM_ErrorCode dmaStreamWriteMemory(uint32_t elementSize, unsigned count, uint32_t addr, const uint8_t *data_ptr, unsigned &bytesDone) {
+   static constexpr unsigned HALF_FRAMES = DMA_STREAM_TRANSACTIONS*DMA_WRITE_FRAMES;
+
+   const uint32_t startAddr = addr;
+   unsigned       elements  = count/elementSize;
+
+   bytesDone = 0;
+
+   // First chunk
+   unsigned transactions = (elements>DMA_STREAM_TRANSACTIONS)?DMA_STREAM_TRANSACTIONS:elements;
+   unsigned frames       = dmaAddWriteTransactions(0, transactions, elementSize, addr, data_ptr);
+   elements -= transactions;
+   dmaStartTransfer(0, frames);
+
+   USBDM_ErrorCode rc = BDM_RC_OK;
+   unsigned firstFrame = 0;
+   while (elements > 0) {
+      // Prepare next chunk in other half while current chunk is transferred
+      firstFrame   = HALF_FRAMES-firstFrame;
+      transactions = (elements>DMA_STREAM_TRANSACTIONS)?DMA_STREAM_TRANSACTIONS:elements;
+      frames       = dmaAddWriteTransactions(firstFrame, transactions, elementSize, addr, data_ptr)-firstFrame;
+      elements    -= transactions;
+
+      rc = dmaWaitTransfer();
+      if (rc != BDM_RC_OK) {
+         break;
+      }
+      dmaStartTransfer(firstFrame, frames);
+   }
+   if (rc == BDM_RC_OK) {
+      rc = dmaWaitTransfer();
+   }
+   if (rc == BDM_RC_OK) {
+      // Any WAIT or FAULT during the run will have set STICKYORUN or STICKYERR
+      uint32_t status;
+      rc = readReg(SwdRead_DP_STATUS, status);
+      if ((rc == BDM_RC_OK) && ((status&SWD_DP_STATUS_STICKYERR) != 0)) {
+         statistics.faults++;
+         rc = BDM_RC_ARM_FAULT_ERROR;
+      }
+      else if ((rc == BDM_RC_OK) && ((status&SWD_DP_STATUS_STICKYORUN) != 0)) {
+         rc = BDM_RC_ACK_TIMEOUT;
+      }
+   }
+   if (rc == BDM_RC_OK) {
+      bytesDone = count;
+   }
+   else {
+      // Resume offset from TAR - sticky bits must be cleared to access the AP
+      uint32_t tar;
+      clearStickyBits();
+      invalidateDapShadow();
+      if ((readAPReg(ahbApBank0|AP_TAR, tar) == BDM_RC_OK) && ((tar-startAddr) <= count)) {
+         bytesDone = (tar-startAddr)&~(elementSize-1);
+      }
+   }
+   advanceDapShadowTar(bytesDone/elementSize);
+   statistics.drwWords += bytesDone/elementSize;
+   linkTransferCount   += bytesDone/elementSize;
+   return rc;
 }
 
 /**
- * Gets Communication speed of SWD
+ *  Write ARM-SWD Memory using DMA
  *
- * @return frequency Frequency in Hz
+ *  @param elementSize  Size of the data elements
+ *  @param count        Number of data bytes
+ *  @param addr         Address in target memory
+ *  @param data_ptr     Data to write
+ *  @param bytesDone    Number of bytes successfully written (valid even on failure)
  *
- * @note This may differ from set speed due to limited range of speeds available
+ *  @return BDM_RC_OK => success, error otherwise
+ *
+ *  @note AHB-AP SELECT, CSW and TAR must have been set up by caller
+ *  @note Status of the final write is not confirmed
  */
-uint32_t getSpeed() {
-   return Spi::calculateSpeed(SpiInfo::getClockFrequency(), TxCtar);
+static USBDM_ErrorCode dmaWriteMemory(uint32_t elementSize, unsigned count, uint32_t addr, const uint8_t *data_ptr, unsigned &bytesDone) {
+
+   unsigned elements = count/elementSize;
+
+   bytesDone = 0;
+
+   USBDM_ErrorCode rc = enableOverrunDetect();
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   if (streamingWrites) {
+      return dmaCompleteTransfer(dmaStreamWriteMemory(elementSize, count, addr, data_ptr, bytesDone));
+   }
+   while (elements > 0) {
+      unsigned transactions = elements;
+      if (transactions > DMA_MAX_TRANSACTIONS) {
+         transactions = DMA_MAX_TRANSACTIONS;
+      }
+      unsigned frame = dmaAddWriteTransactions(0, transactions, elementSize, addr, data_ptr);
+      rc = dmaTransferFrames(frame);
+      if (rc != BDM_RC_OK) {
+         break;
+      }
+      const uint32_t *rx = dmaRxFrames;
+      for (unsigned index=0; index<transactions; index++, rx+=DMA_WRITE_FRAMES) {
+         rc = dmaCheckAck(rx[1]);
+         if (rc != BDM_RC_OK) {
+            break;
+         }
+         advanceDapShadowTar(1);
+         statistics.drwWords++;
+         linkTransferCount++;
+         bytesDone += elementSize;
+      }
+      if (rc != BDM_RC_OK) {
+         break;
+      }
+      elements -= transactions;
+   }
+   return dmaCompleteTransfer(rc);
 }
+#endif
 
 /**
  * Obtain default AHB_AP.csw register default value from target
+ * Also determines if the AHB-AP supports packed transfers
  *
  * @return BDM_RC_OK ahb_ap_csw_defaultValue already valid or successfully updated, error otherwise
  */
@@ -447,10 +1450,15 @@ static USBDM_ErrorCode update_ahb_ap_csw_defaultValue() {
       return BDM_RC_OK;
    }
 
+   // Select AHB-AP memory bank
+   USBDM_ErrorCode rc = writeSelect(ahbApBank0);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
    // Read initial AHB-AP.csw register value as device dependent
    // Do posted read - dummy data returned
    uint32_t ahb_ap_cswValue = 0;
-   USBDM_ErrorCode rc = readReg(SwdRead_AHB_CSW, ahb_ap_cswValue);
+   rc = readReg(SwdRead_AHB_CSW, ahb_ap_cswValue);
    if (rc != BDM_RC_OK) {
       return rc;
    }
@@ -460,10 +1468,53 @@ static USBDM_ErrorCode update_ahb_ap_csw_defaultValue() {
       return rc;
    }
    // Modify value - preserve some bits
-   ahb_ap_csw_defaultValue = (ahb_ap_cswValue & 0xFF000000) | 0x00000040;
+   ahb_ap_cswValue = (ahb_ap_cswValue & 0xFF000000) | 0x00000040;
+
+   // Packed transfers are supported if CSW.AddrInc reads back as written
+   uint32_t readBack;
+   rc = writeReg(SwdWrite_AHB_CSW, ahb_ap_cswValue|getPackedcswValue(MS_Byte));
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   rc = readReg(SwdRead_AHB_CSW, readBack);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   rc = readReg(SwdRead_DP_RDBUFF, readBack);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   packedTransfersSupported = (readBack & AHB_AP_CSW_INC_MASK) == AHB_AP_CSW_INC_PACKED;
+   ahb_ap_csw_defaultValue  = ahb_ap_cswValue;
+   apCswInfo[ahbApBank0>>24] = {ahb_ap_csw_defaultValue, packedTransfersSupported};
    return BDM_RC_OK;
 }
 
+/**
+ * Split a memory transfer into an unaligned head, packed body and tail
+ *
+ * @param elementSize  Size of the data elements
+ * @param count        Number of data bytes
+ * @param addr         Address in target memory
+ * @param head         Bytes to transfer before body
+ * @param body         Word-aligned bytes to transfer using packed transfers
+ * @param tail         Bytes to transfer after body
+ *
+ * @return true if packed transfers should be used, false otherwise
+ */
+static bool splitPackedTransfer(uint32_t elementSize, uint32_t count, uint32_t addr, uint32_t &head, uint32_t &body, uint32_t &tail) {
+   if (!packedTransfersSupported || (elementSize == MS_Long)) {
+      return false;
+   }
+   head = (-addr)&0x3;
+   if (head > count) {
+      return false;
+   }
+   body = (count-head)&~0x3;
+   tail = count-head-body;
+   return body >= PACKED_MIN_BYTES;
+}
+
 /**
  * Set pin state
  *
@@ -517,6 +1568,12 @@ void initialiseInterface() {
 
    SpiInfo::enableClock();
 
+   // Cycle counter used for WAIT timeouts is started in warmStart()
+
+#if SWD_DMA_TRANSFERS
+   dmaInitialise();
+#endif
+
    setSpeed(12000000);
 
    // Configure reset signal
@@ -575,6 +1632,24 @@ void disableInterface() {
 }
 
 
+/**
+ * Discover AHB-AP.CSW default value and packed transfer support of the selected MEM-AP
+ * so the first memory access of a command does not pay the cost.
+ * Nothing is done if the debug power domain is not yet powered (discovered on first use instead).
+ */
+static void probeMemAp() {
+   uint32_t status;
+   if (readReg(SwdRead_DP_STATUS, status) != BDM_RC_OK) {
+      return;
+   }
+   if ((status&SWD_DP_CONTROL_POWER_ACK) != SWD_DP_CONTROL_POWER_ACK) {
+      return;
+   }
+   if (update_ahb_ap_csw_defaultValue() != BDM_RC_OK) {
+      (void)clearStickyBits();
+   }
+}
+
 /**
  *  Switches interface to SWD and confirm connection to target
  *
@@ -587,11 +1662,19 @@ void disableInterface() {
  *   - >=50-bit sequence of 1's
  *   - 8-bit idle
  *   - Read IDCODE
+ *   - Read CTRL/STAT (refreshes shadow copy)
+ *   - Probe MEM-AP (if debug powered)
  *
  *  @return BDM_RC_OK => Success
  */
 USBDM_ErrorCode connect(void) {
-   ahb_ap_csw_defaultValue = 0;
+   ahb_ap_csw_defaultValue  = 0;
+   packedTransfersSupported = false;
+   for (ApCswInfo &info : apCswInfo) {
+      info = {0, false};
+   }
+   invalidateDapShadow();
+   invalidateCoreRegisterCache();
 
    tx32(0xFFFFFFFF);  // 32 1's
    tx32(0x79EFFFFF);  // 20 1's + 0x79E
@@ -600,7 +1683,27 @@ USBDM_ErrorCode connect(void) {
 
    // Target must respond to read IDCODE immediately
    uint32_t buff;
-   return readReg(SwdRead_DP_IDCODE, buff);
+   USBDM_ErrorCode rc = readReg(SwdRead_DP_IDCODE, buff);
+   if (rc == BDM_RC_OK) {
+      // Refresh dpControl (DP.CTRL/STAT is reset by a target power-on reset)
+      dpControlValid = false;
+      rc = readReg(SwdRead_DP_STATUS, buff);
+   }
+   if (rc == BDM_RC_OK) {
+      probeMemAp();
+   }
+   return rc;
+}
+
+/**
+ * Re-connect to target to recover from a failed command.
+ * This is counted in the link statistics.
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode reconnect() {
+   statistics.reconnects++;
+   return connect();
 }
 
 /**
@@ -622,7 +1725,11 @@ USBDM_ErrorCode powerUp() {
    if (rc != BDM_RC_OK) {
       return rc;
    }
-   return ((status&SWD_DP_CONTROL_POWER_ACK) == SWD_DP_CONTROL_POWER_ACK)?BDM_RC_OK:BDM_RC_ARM_PWR_UP_FAIL;
+   if ((status&SWD_DP_CONTROL_POWER_ACK) != SWD_DP_CONTROL_POWER_ACK) {
+      return BDM_RC_ARM_PWR_UP_FAIL;
+   }
+   probeMemAp();
+   return BDM_RC_OK;
 }
 
 /**
@@ -636,6 +1743,8 @@ USBDM_ErrorCode powerUp() {
  *  @return BDM_RC_OK => Success, error otherwise
  */
 USBDM_ErrorCode lineReset(void) {
+   invalidateDapShadow();
+
    tx32(0xFFFFFFFF);  // 32 1's
    tx32(0x007FFFFF);  // 23 1's, 9 0's
 
@@ -644,6 +1753,83 @@ USBDM_ErrorCode lineReset(void) {
    return readReg(SwdRead_DP_IDCODE, buff);
 }
 
+/**
+ * Complete the data phase of a read transaction that received a WAIT or FAULT response
+ * while DP.CTRL/STAT.ORUNDETECT is set
+ *
+ * @note The target does not drive SWDIO during this data phase
+ */
+static void rxOverrunDataPhase() {
+   spi->CTAR[1] = RxCtar;
+   spi->PUSHR = 0xFFFF|SPI_PUSHR_CTAS(1)|SPI_PUSHR_CONT(0)|SPI_PUSHR_EOQ(0);
+   spi->PUSHR = 0xFFFF|SPI_PUSHR_CTAS(1)|SPI_PUSHR_CONT(0)|SPI_PUSHR_EOQ(1);
+
+   // Wait until End of Transmission
+   while ((spi->SR & SPI_SR_EOQF_MASK)==0) {
+   }
+   spi->SR = SPI_SR_TCF_MASK|SPI_SR_EOQF_MASK;
+
+   // Transmit 8 bits idle
+   SwdDataBuffer::on();
+   spi->PUSHR = 0b00000000|SPI_PUSHR_CTAS(0)|SPI_PUSHR_CONT(0)|SPI_PUSHR_EOQ(1);
+
+   // Wait until End of Idle Transmission
+   while ((spi->SR & SPI_SR_EOQF_MASK)==0) {
+   }
+   SwdDataBuffer::off();
+   spi->SR = SPI_SR_TCF_MASK|SPI_SR_EOQF_MASK;
+
+   // Discard data and idle Rx
+   (void)(spi->POPR);
+   (void)(spi->POPR);
+   (void)(spi->POPR);
+
+   spi->CTAR[1] = AckCtar;
+}
+
+/**
+ * Complete the data phase of a write transaction that received a WAIT or FAULT response
+ * while DP.CTRL/STAT.ORUNDETECT is set
+ *
+ * @note The data is ignored by the target
+ */
+static void txOverrunDataPhase() {
+   spi->CTAR[1] = TxCtar;
+
+   // Transmit 3x11 bits = Data(0-10), Data(11-21), Data(22-31),parity of zero value
+   SwdDataBuffer::on();
+   spi->PUSHR = 0|SPI_PUSHR_CTAS(1)|SPI_PUSHR_CONT(1)|SPI_PUSHR_EOQ(0);
+   spi->PUSHR = 0|SPI_PUSHR_CTAS(1)|SPI_PUSHR_CONT(1)|SPI_PUSHR_EOQ(0);
+   spi->PUSHR = 0|SPI_PUSHR_CTAS(1)|SPI_PUSHR_CONT(0)|SPI_PUSHR_EOQ(0);
+   // Transmit 8 bits idle
+   spi->PUSHR = 0b00000000|SPI_PUSHR_CTAS(0)|SPI_PUSHR_CONT(0)|SPI_PUSHR_EOQ(1);
+
+   // Wait until End of Transmission
+   while ((spi->SR & SPI_SR_EOQF_MASK)==0) {
+   }
+   spi->SR = SPI_SR_TCF_MASK|SPI_SR_EOQF_MASK;
+   SwdDataBuffer::off();
+
+   (void)(spi->POPR);
+   (void)(spi->POPR);
+   (void)(spi->POPR);
+   (void)(spi->POPR);
+
+   spi->CTAR[1] = AckCtar;
+}
+
+/**
+ * Clear STICKYORUN set by a WAIT response so the transaction may be retried
+ *
+ * @note ABORT writes are always accepted by the target
+ */
+static void clearOverrunAfterWait() {
+   (void)writeReg(SwdWrite_DP_ABORT, SWD_DP_ABORT_CLEAR_STICKY_ORUN);
+   spi->CTAR[0] = PreambleCtar;
+   spi->CTAR[1] = AckCtar;
+   spi->SR = SPI_SR_TCF_MASK|SPI_SR_EOQF_MASK;
+}
+
 /**
  *  Read ARM-SWD DP & AP register
  *
@@ -672,8 +1858,9 @@ USBDM_ErrorCode readReg(const SwdRead swdRead, uint32_t &data) {
 
    spi->SR = SPI_SR_TCF_MASK|SPI_SR_EOQF_MASK;
 
-   unsigned        retry = 2000;
-   USBDM_ErrorCode rc    = BDM_RC_OK;
+   unsigned        retry     = 0;
+   uint32_t        waitStart = 0;
+   USBDM_ErrorCode rc        = BDM_RC_OK;
 
    do {
       // Write SWD command
@@ -723,8 +1910,13 @@ USBDM_ErrorCode readReg(const SwdRead swdRead, uint32_t &data) {
          uint8_t receivedParity = temp>>15;
          uint8_t calculatedparity = calcParity(data);
          if (receivedParity != calculatedparity) {
+            statistics.parityErrors++;
+            linkErrorCount++;
             rc = BDM_RC_ARM_PARITY_ERROR;
          }
+         else {
+            countDrwReadData(swdRead);
+         }
          // Wait until End of Idle Transmission
          while ((spi->SR & SPI_SR_EOQF_MASK)==0) {
          }
@@ -733,17 +1925,32 @@ USBDM_ErrorCode readReg(const SwdRead swdRead, uint32_t &data) {
 
          // Discard idle Rx
          (void)(spi->POPR);
+
+         updateDapShadowOnRead(swdRead);
+         if (swdRead == SwdRead_DP_STATUS) {
+            dpControl      = data&SWD_DP_CONTROL_RW_MASK;
+            dpControlValid = true;
+         }
       }
       else if (ack == SWD_ACK_WAIT) {
-         if (retry-->0) {
+         if (isOverrunDetectEnabled()) {
+            rxOverrunDataPhase();
+            clearOverrunAfterWait();
+         }
+         if (retryAfterWait(retry, waitStart)) {
             continue;
          }
          rc = BDM_RC_ACK_TIMEOUT;
       }
       else if (ack == SWD_ACK_FAULT) {
+         if (isOverrunDetectEnabled()) {
+            rxOverrunDataPhase();
+         }
+         statistics.faults++;
          rc = BDM_RC_ARM_FAULT_ERROR;
       }
       else {
+         recordInvalidAck(ack);
          rc = BDM_RC_NO_CONNECTION;
       }
       break;
@@ -751,6 +1958,13 @@ USBDM_ErrorCode readReg(const SwdRead swdRead, uint32_t &data) {
 
 //   spi->MCR |= SPI_MCR_HALT_MASK;
 
+   if (rc == BDM_RC_OK) {
+      linkTransferCount++;
+   }
+   else {
+      drwReadPending = false;
+      invalidateDapShadow();
+   }
    return rc;
 }
 
@@ -778,8 +1992,9 @@ USBDM_ErrorCode writeReg(const SwdWrite swdWrite, const uint32_t data) {
 
 //   spi->MCR &= ~SPI_MCR_HALT_MASK;
 
-   unsigned        retry = 2000;
-   USBDM_ErrorCode rc    = BDM_RC_OK;
+   unsigned        retry     = 0;
+   uint32_t        waitStart = 0;
+   USBDM_ErrorCode rc        = BDM_RC_OK;
 
    spi->SR = SPI_SR_TCF_MASK|SPI_SR_EOQF_MASK;
 
@@ -826,17 +2041,30 @@ USBDM_ErrorCode writeReg(const SwdWrite swdWrite, const uint32_t data) {
          (void)(spi->POPR);
          (void)(spi->POPR);
          (void)(spi->POPR);
+
+         if (swdWrite == SwdWrite_AHB_DRW) {
+            statistics.drwWords++;
+         }
       }
       else if (ack == SWD_ACK_WAIT) {
-         if (retry-->0) {
+         if (isOverrunDetectEnabled()) {
+            txOverrunDataPhase();
+            clearOverrunAfterWait();
+         }
+         if (retryAfterWait(retry, waitStart)) {
             continue;
          }
          rc = BDM_RC_ACK_TIMEOUT;
       }
       else if (ack == SWD_ACK_FAULT) {
+         if (isOverrunDetectEnabled()) {
+            txOverrunDataPhase();
+         }
+         statistics.faults++;
          rc = BDM_RC_ARM_FAULT_ERROR;
       }
       else {
+         recordInvalidAck(ack);
          rc = BDM_RC_NO_CONNECTION;
       }
       break;
@@ -846,6 +2074,21 @@ USBDM_ErrorCode writeReg(const SwdWrite swdWrite, const uint32_t data) {
 
 //   spi->MCR |= SPI_MCR_HALT_MASK;
 
+   if (rc == BDM_RC_OK) {
+      linkTransferCount++;
+      updateDapShadowOnWrite(swdWrite, data);
+      if (swdWrite == SwdWrite_DP_CONTROL) {
+         dpControl      = data&SWD_DP_CONTROL_RW_MASK;
+         dpControlValid = true;
+      }
+   }
+   else {
+      invalidateDapShadow();
+      if (swdWrite == SwdWrite_DP_CONTROL) {
+         // Write may or may not have been done
+         dpControlValid = false;
+      }
+   }
    return rc;
 }
 
@@ -869,7 +2112,7 @@ USBDM_ErrorCode readAPReg(const uint32_t address, uint32_t &buff) {
    uint32_t selectData = address&0xFF0000F0;
 
    // Set up SELECT register for AP access
-   rc = writeReg(SwdWrite_DP_SELECT, selectData);
+   rc = writeSelect(selectData);
    if (rc != BDM_RC_OK) {
       return rc;
    }
@@ -902,7 +2145,7 @@ USBDM_ErrorCode writeAPReg(const uint32_t address, const uint32_t data) {
    uint32_t selectData = address&0xFF0000F0;
 
    // Set up SELECT register for AP access
-   rc = writeReg(SwdWrite_DP_SELECT, selectData);
+   rc = writeSelect(selectData);
    if (rc != BDM_RC_OK) {
       return rc;
    }
@@ -911,26 +2154,192 @@ USBDM_ErrorCode writeAPReg(const uint32_t address, const uint32_t data) {
    if (rc != BDM_RC_OK) {
       return rc;
    }
-   // Read from READBUFF register to allow stall/status response
-   return readReg(SwdRead_DP_RDBUFF, selectData);
+   // Read from READBUFF register to allow stall/status response
+   return readReg(SwdRead_DP_RDBUFF, selectData);
+}
+
+/**
+ *  Clear all sticky bits in status register
+ *
+ *  @return error code
+ */
+USBDM_ErrorCode clearStickyBits(void) {
+   return writeReg(SwdWrite_DP_ABORT, SWD_DP_ABORT_CLEAR_STICKY_ERRORS);
+}
+
+/**
+ * Clear sticky bits and abort AP transactions
+ *
+ *  @return error code
+ */
+USBDM_ErrorCode abortAP(void) {
+   invalidateDapShadow();
+   return writeReg(SwdWrite_DP_ABORT, SWD_DP_ABORT_CLEAR_STICKY_ERRORS|SWD_DP_ABORT_ABORT_AP);
+}
+
+/**
+ * Select the MEM-AP used for memory and core register accesses
+ *
+ * @param apNum AP # (0..SWD_MAX_APS-1)
+ *
+ * @return BDM_RC_OK => success
+ * @return BDM_RC_ILLEGAL_PARAMS => AP # out of range, AP not present or not a MEM-AP (e.g. Kinetis MDM-AP)
+ * @return Other => error reading AP.IDR
+ *
+ * @note Core register cache is invalidated when the AP changes
+ */
+USBDM_ErrorCode selectAp(unsigned apNum) {
+   if (apNum >= SWD_MAX_APS) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   if ((apNum<<24) == ahbApBank0) {
+      return BDM_RC_OK;
+   }
+   uint32_t idr;
+   USBDM_ErrorCode rc = readAPReg((apNum<<24)|AP_IDR, idr);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   if ((idr == 0) || ((idr&AP_IDR_MEM_AP) == 0)) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   ahbApBank0               = apNum<<24;
+   ahb_ap_csw_defaultValue  = apCswInfo[apNum].cswDefaultValue;
+   packedTransfersSupported = apCswInfo[apNum].packedSupported;
+
+   // CSW/TAR shadows belong to the previous AP
+   dapShadow.cswValid = false;
+   dapShadow.tarValid = false;
+
+   // Registers belong to a different core
+   invalidateCoreRegisterCache();
+
+   if (ahb_ap_csw_defaultValue == 0) {
+      // First use of this AP since connect
+      probeMemAp();
+   }
+   return BDM_RC_OK;
+}
+
+/**
+ * Get the MEM-AP used for memory and core register accesses
+ *
+ * @return AP #
+ */
+unsigned getSelectedAp() {
+   return ahbApBank0>>24;
+}
+
+/**
+ * Read word from memory through a given MEM-AP.
+ * Uses explicit AP register accesses so the selected MEM-AP and DAP shadows are unaffected.
+ *
+ * @param apNum    AP #
+ * @param cswValue Value for AP.CSW (word size, no increment)
+ * @param address  Address in target memory
+ * @param data     Data value read
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode readApMemoryWord(unsigned apNum, uint32_t cswValue, uint32_t address, uint32_t &data) {
+   USBDM_ErrorCode rc = writeAPReg((apNum<<24)|AP_CSW, cswValue);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   rc = writeAPReg((apNum<<24)|AP_TAR, address);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   return readAPReg((apNum<<24)|AP_DRW, data);
+}
+
+/**
+ * Scan the ROM table of a MEM-AP for a Cortex-M System Control Space
+ * and read the CPUID of the core
+ *
+ * @param apNum  AP #
+ * @param base   Value of AP.BASE
+ * @param cpuid  CPUID of core (0 if none found)
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode findCoreCpuid(unsigned apNum, uint32_t base, uint32_t &cpuid) {
+   cpuid = 0;
+   if ((base == AP_BASE_LEGACY_NONE) || ((base&AP_BASE_FORMAT) && !(base&AP_BASE_PRESENT))) {
+      // No debug entry
+      return BDM_RC_OK;
+   }
+   // Word access without auto-increment, preserving device dependent bits
+   uint32_t cswValue;
+   USBDM_ErrorCode rc = readAPReg((apNum<<24)|AP_CSW, cswValue);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   cswValue = (cswValue & 0xFF000000)|0x00000040|AHB_AP_CSW_INC_OFF|AHB_AP_CSW_SIZE_WORD;
+
+   uint32_t romTable = base&AP_BASE_ADDR_MASK;
+   for (unsigned index=0; index<ROM_TABLE_MAX_ENTRIES; index++) {
+      uint32_t entry;
+      rc = readApMemoryWord(apNum, cswValue, romTable+4*index, entry);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      if (entry == 0) {
+         // End of table
+         break;
+      }
+      if ((entry&ROM_ENTRY_PRESENT) == 0) {
+         continue;
+      }
+      // Entry is a signed offset from the ROM table
+      if ((romTable+(entry&ROM_ENTRY_OFFSET_MASK)) == SCS_BASE_ADDR) {
+         return readApMemoryWord(apNum, cswValue, CPUID_ADDR, cpuid);
+      }
+   }
+   return BDM_RC_OK;
 }
 
 /**
- *  Clear all sticky bits in status register
+ * Enumerate Access Ports.
+ * The ROM table of each MEM-AP is scanned for a Cortex-M System Control Space
+ * and the CPUID of the core is read.  The APs are accessed directly so the
+ * selected MEM-AP is unchanged.
  *
- *  @return error code
- */
-USBDM_ErrorCode clearStickyBits(void) {
-   return writeReg(SwdWrite_DP_ABORT, SWD_DP_ABORT_CLEAR_STICKY_ERRORS);
-}
-
-/**
- * Clear sticky bits and abort AP transactions
+ * @param aps    Description of each AP found
+ * @param count  Number of APs found
  *
- *  @return error code
+ * @return BDM_RC_OK => success, error otherwise
  */
-USBDM_ErrorCode abortAP(void) {
-   return writeReg(SwdWrite_DP_ABORT, SWD_DP_ABORT_CLEAR_STICKY_ERRORS|SWD_DP_ABORT_ABORT_AP);
+USBDM_ErrorCode enumerateAps(ApDescription aps[SWD_MAX_APS], unsigned &count) {
+   USBDM_ErrorCode rc = BDM_RC_OK;
+
+   count = 0;
+   for (unsigned apNum=0; apNum<SWD_MAX_APS; apNum++) {
+      ApDescription &ap = aps[apNum];
+      ap = {0, 0, 0};
+      rc = readAPReg((apNum<<24)|AP_IDR, ap.idr);
+      if (rc != BDM_RC_OK) {
+         break;
+      }
+      if (ap.idr == 0) {
+         // APs are numbered contiguously
+         break;
+      }
+      count++;
+      if ((ap.idr&AP_IDR_MEM_AP) == 0) {
+         continue;
+      }
+      rc = readAPReg((apNum<<24)|AP_BASE, ap.base);
+      if (rc != BDM_RC_OK) {
+         break;
+      }
+      if (findCoreCpuid(apNum, ap.base, ap.cpuid) != BDM_RC_OK) {
+         // Core may be powered down or held in reset - not an enumeration failure
+         ap.cpuid = 0;
+         (void)clearStickyBits();
+      }
+   }
+   return rc;
 }
 
 static constexpr uint32_t  MDM_AP_STATUS                     = 0x01000000;
@@ -1028,6 +2437,103 @@ USBDM_ErrorCode kinetisMassErase(void) {
    return (successCount>=ERASE_MULTIPLE)?BDM_RC_OK:BDM_RC_FAIL;
 }
 
+//==========================================================================
+// Core register cache
+//
+// Core registers are read in blocks on first access after the target halts and
+// later reads are served from the cache. The cache is invalidated by any write to
+// the System Control Block or debug registers (GO, STEP, HALT, reset via AIRCR etc.)
+// other than the register transfer registers themselves, on connection and by
+// invalidateCoreRegisterCache().
+//
+
+/** Start of System Control Block & debug registers - writes here invalidate the register cache */
+static constexpr uint32_t SCB_START = 0xE000ED00U;
+
+/** End of System Control Block & debug registers */
+static constexpr uint32_t SCB_END   = 0xE000EE00U;
+
+/** Number of cache entries for core registers (R0-R15, xPSR, MSP, PSP, (unused), MISC) */
+static constexpr unsigned REG_CACHE_CORE_SIZE = ARM_RegMISC+1;
+
+/** Number of cache entries for floating point registers (FPSCR, FPS0-FPS31) */
+static constexpr unsigned REG_CACHE_FP_SIZE   = 1+32;
+
+/** Core register cache */
+struct CoreRegisterCache {
+   uint32_t values[REG_CACHE_CORE_SIZE+REG_CACHE_FP_SIZE];  //!< Register values
+   uint64_t valid;                                          //!< Bit-mask of valid entries
+};
+
+static CoreRegisterCache regCache = {};
+
+/**
+ * Invalidate core register cache
+ */
+void invalidateCoreRegisterCache() {
+   regCache.valid = 0;
+}
+
+/**
+ * Get index of register in register cache
+ *
+ * @param regNo Register number (DCRSR.REGSEL)
+ *
+ * @return Index in regCache.values or -1 if not cached
+ */
+static int regCacheIndex(uint32_t regNo) {
+   if ((regNo < REG_CACHE_CORE_SIZE) && (regNo != ARM_RegMISC-1)) {
+      return regNo;
+   }
+   if (regNo == ARM_RegFPSCR) {
+      return REG_CACHE_CORE_SIZE;
+   }
+   if ((regNo >= ARM_RegFPS0) && (regNo < ARM_RegFPS0+REG_CACHE_FP_SIZE-1)) {
+      return REG_CACHE_CORE_SIZE+1+(regNo-ARM_RegFPS0);
+   }
+   return -1;
+}
+
+/**
+ * Invalidate register cache entries affected by writing a core register.
+ * SP is an alias of MSP or PSP as selected by CONTROL.SPSEL (part of MISC).
+ *
+ * @param regNo Register number (DCRSR.REGSEL)
+ */
+static void invalidateRegisterCacheEntry(uint32_t regNo) {
+   int index = regCacheIndex(regNo);
+   if (index >= 0) {
+      regCache.valid &= ~(1ULL<<index);
+   }
+   switch(regNo) {
+      case ARM_RegSP:
+      case ARM_RegMSP:
+      case ARM_RegPSP:
+      case ARM_RegMISC:
+         regCache.valid &= ~((1ULL<<ARM_RegSP)|(1ULL<<ARM_RegMSP)|(1ULL<<ARM_RegPSP)|(1ULL<<ARM_RegMISC));
+         break;
+      default:
+         break;
+   }
+}
+
+/**
+ * Invalidate core register cache if memory range includes System Control Block registers
+ * other than the register transfer registers (DCRSR/DCRDR)
+ *
+ * @param address Start of range
+ * @param size    Size of range in bytes
+ */
+static void checkRegisterCacheWrite(uint32_t address, uint32_t size) {
+   if ((address >= SCB_END) || ((address+size) <= SCB_START) || (size == 0)) {
+      return;
+   }
+   if ((address >= DCRSR_ADDR) && ((address+size) <= (DCRDR_ADDR+4))) {
+      return;
+   }
+   invalidateCoreRegisterCache();
+}
+
 /** Write 32-bit value to ARM-SWD Memory
  *
  *  @param address 32-bit memory address
@@ -1037,6 +2543,8 @@ USBDM_ErrorCode kinetisMassErase(void) {
  */
 USBDM_ErrorCode writeMemoryWord(const uint32_t address, const uint32_t data) {
    USBDM_ErrorCode  rc;
+
+   checkRegisterCacheWrite(address, sizeof(uint32_t));
    /* Steps
     *  - Set up to access AHB-AP register bank 0 (CSW,TAR,DRW)
     *  - Write AP-CSW value (auto-increment etc)
@@ -1044,7 +2552,7 @@ USBDM_ErrorCode writeMemoryWord(const uint32_t address, const uint32_t data) {
     *  - Write value to DRW (data value to target memory)
     */
    // Select AHB-AP memory bank - subsequent AHB-AP register accesses are all in the same bank
-   rc = writeReg(SwdWrite_DP_SELECT, ARM_AHB_AP_BANK0);
+   rc = writeSelect(ahbApBank0);
    if (rc != BDM_RC_OK) {
       return rc;
    }
@@ -1053,12 +2561,12 @@ USBDM_ErrorCode writeMemoryWord(const uint32_t address, const uint32_t data) {
       return rc;
    }
    // Write CSW (word access etc)
-   rc = writeReg(SwdWrite_AHB_CSW, ahb_ap_csw_defaultValue|AHB_AP_CSW_SIZE_WORD);
+   rc = writeCsw(ahb_ap_csw_defaultValue|AHB_AP_CSW_SIZE_WORD);
    if (rc != BDM_RC_OK) {
       return rc;
    }
    // Write TAR (target address)
-   rc = writeReg(SwdWrite_AHB_TAR, address);
+   rc = writeTar(address);
    if (rc != BDM_RC_OK) {
       return rc;
    }
@@ -1072,16 +2580,20 @@ USBDM_ErrorCode writeMemoryWord(const uint32_t address, const uint32_t data) {
    return readReg(SwdRead_DP_RDBUFF, tt);
 }
 
-/**  Write ARM-SWD Memory
+/**  Write ARM-SWD Memory using given CSW settings
  *
- *  @param elementSize  Size of the data elements
+ *  @param cswValue     AHB-AP.CSW size and increment settings
+ *  @param elementSize  Size of the data elements on each DRW transfer (1, 2 or 4 bytes)
  *  @param count        Number of data bytes
  *  @param addr         LSB of Address in target memory
  *  @param data_ptr     Where in buffer to write the data
  *
  *  @return BDM_RC_OK => success, error otherwise
+ *
+ *  @note The transfer must not cross a TAR_INCREMENT_BOUNDARY
  */
-USBDM_ErrorCode writeMemory(
+static USBDM_ErrorCode writeMemoryChunk(
+      uint32_t  cswValue,
       uint32_t  elementSize,
       uint32_t  count,
       uint32_t  addr,
@@ -1099,7 +2611,7 @@ USBDM_ErrorCode writeMemory(
     *    - Write value to DRW (data value to target memory)
     */
    // Select AHB-AP memory bank - subsequent AHB-AP register accesses are all in the same bank
-   rc = writeReg(SwdWrite_DP_SELECT, ARM_AHB_AP_BANK0);
+   rc = writeSelect(ahbApBank0);
    if (rc != BDM_RC_OK) {
       return rc;
    }
@@ -1108,15 +2620,33 @@ USBDM_ErrorCode writeMemory(
       return rc;
    }
    // Write CSW (auto-increment etc)
-   rc = writeReg(SwdWrite_AHB_CSW, ahb_ap_csw_defaultValue|getcswValue(elementSize));
+   rc = writeCsw(ahb_ap_csw_defaultValue|cswValue);
    if (rc != BDM_RC_OK) {
       return rc;
    }
    // Write TAR (target address)
-   rc = writeReg(SwdWrite_AHB_TAR, addr);
+   rc = writeTar(addr);
    if (rc != BDM_RC_OK) {
       return rc;
    }
+#if SWD_DMA_TRANSFERS
+   if ((count/elementSize) >= DMA_MIN_TRANSACTIONS) {
+      unsigned bytesDone;
+      rc = dmaWriteMemory(elementSize, count, addr, data_ptr, bytesDone);
+      if (rc == BDM_RC_OK) {
+         // Dummy read to obtain status from last write
+         return readReg(SwdRead_DP_RDBUFF, temp);
+      }
+      // Complete remainder of transfer without DMA
+      count    -= bytesDone;
+      addr     += bytesDone;
+      data_ptr += bytesDone;
+      rc = writeReg(SwdWrite_AHB_TAR, addr);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+   }
+#endif
    switch (elementSize) {
    case MS_Byte:
       while (count > 0) {
@@ -1163,29 +2693,417 @@ USBDM_ErrorCode writeMemory(
       }
       break;
    }
-   // Dummy read to obtain status from last write
-   return readReg(SwdRead_DP_RDBUFF, temp);
+   // Dummy read to obtain status from last write
+   return readReg(SwdRead_DP_RDBUFF, temp);
+}
+
+/**
+ * Get size of next chunk of a transfer that does not cross a TAR_INCREMENT_BOUNDARY
+ *
+ * @param addr   Address of start of chunk
+ * @param count  Number of bytes remaining in transfer
+ *
+ * @return Number of bytes in chunk
+ */
+static inline uint32_t tarChunkSize(uint32_t addr, uint32_t count) {
+   uint32_t chunkSize = TAR_INCREMENT_BOUNDARY-(addr&(TAR_INCREMENT_BOUNDARY-1));
+   return (chunkSize<count)?chunkSize:count;
+}
+
+/**  Write ARM-SWD Memory using given CSW settings
+ *
+ *  The transfer is split at TAR_INCREMENT_BOUNDARY and TAR re-written for each chunk.
+ *
+ *  @param cswValue     AHB-AP.CSW size and increment settings
+ *  @param elementSize  Size of the data elements on each DRW transfer (1, 2 or 4 bytes)
+ *  @param count        Number of data bytes
+ *  @param addr         LSB of Address in target memory
+ *  @param data_ptr     Where in buffer to write the data
+ *
+ *  @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode writeMemoryBlock(
+      uint32_t  cswValue,
+      uint32_t  elementSize,
+      uint32_t  count,
+      uint32_t  addr,
+      uint8_t   *data_ptr
+) {
+   while (count > 0) {
+      uint32_t chunkSize = tarChunkSize(addr, count);
+      USBDM_ErrorCode rc = writeMemoryChunk(cswValue, elementSize, chunkSize, addr, data_ptr);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      count    -= chunkSize;
+      addr     += chunkSize;
+      data_ptr += chunkSize;
+   }
+   return BDM_RC_OK;
+}
+
+/**  Write ARM-SWD Memory
+ *
+ *  @param elementSize  Size of the data elements
+ *  @param count        Number of data bytes
+ *  @param addr         LSB of Address in target memory
+ *  @param data_ptr     Where in buffer to write the data
+ *
+ *  @return BDM_RC_OK => success, error otherwise
+ *
+ *  @note Byte and halfword blocks use packed transfers for the word-aligned portion where supported
+ *  @note The block may cross TAR_INCREMENT_BOUNDARY - TAR is re-written for each portion
+ */
+USBDM_ErrorCode writeMemory(
+      uint32_t  elementSize,
+      uint32_t  count,
+      uint32_t  addr,
+      uint8_t   *data_ptr
+) {
+   USBDM_ErrorCode rc;
+
+   checkRegisterCacheWrite(addr, count);
+
+   rc = update_ahb_ap_csw_defaultValue();
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   uint32_t head, body, tail;
+   if (!splitPackedTransfer(elementSize, count, addr, head, body, tail)) {
+      return writeMemoryBlock(getcswValue(elementSize), elementSize, count, addr, data_ptr);
+   }
+   if (head > 0) {
+      rc = writeMemoryBlock(getcswValue(elementSize), elementSize, head, addr, data_ptr);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+   }
+   rc = writeMemoryBlock(getPackedcswValue(elementSize), MS_Long, body, addr+head, data_ptr+head);
+   if ((rc != BDM_RC_OK) || (tail == 0)) {
+      return rc;
+   }
+   return writeMemoryBlock(getcswValue(elementSize), elementSize, tail, addr+head+body, data_ptr+head+body);
+}
+
+/** Minimum run of erased bytes worth skipping (i.e. costs more than re-seeding TAR) */
+static constexpr unsigned SKIP_ERASED_MIN_BYTES = 8;
+
+/** Value of erased Flash word */
+static constexpr uint32_t ERASED_WORD = 0xFFFFFFFF;
+
+/**
+ * Check if word in buffer is in erased state
+ *
+ * @param data Pointer to word (need not be aligned)
+ */
+static inline bool isErasedWord(const uint8_t *data) {
+   uint32_t value;
+   memcpy(&value, data, sizeof(value));
+   return value == ERASED_WORD;
+}
+
+/**  Write ARM-SWD Memory skipping runs of erased (0xFF) data
+ *
+ *  The data is scanned a word at a time. Aligned runs of erased words are not written
+ *  and TAR is re-seeded where data resumes.
+ *
+ *  @param elementSize  Size of the data writes
+ *  @param count        # of bytes
+ *  @param addr         Address in target memory
+ *  @param data_ptr     Where the data is
+ *
+ *  @return BDM_RC_OK => success, error otherwise
+ *
+ *  @note Only valid for a destination known to be in the erased state e.g. erased Flash
+ */
+USBDM_ErrorCode writeMemorySkipErased(
+      uint32_t  elementSize,
+      uint32_t  count,
+      uint32_t  addr,
+      uint8_t   *data_ptr
+) {
+   USBDM_ErrorCode rc;
+
+   // Start of data not yet written
+   uint32_t start = 0;
+   // Scan from first word aligned target address
+   uint32_t index = (-addr)&3;
+   while ((index+sizeof(uint32_t)) <= count) {
+      if (!isErasedWord(data_ptr+index)) {
+         index += sizeof(uint32_t);
+         continue;
+      }
+      uint32_t runEnd = index+sizeof(uint32_t);
+      while (((runEnd+sizeof(uint32_t)) <= count) && isErasedWord(data_ptr+runEnd)) {
+         runEnd += sizeof(uint32_t);
+      }
+      if ((runEnd-index) >= SKIP_ERASED_MIN_BYTES) {
+         if (index > start) {
+            rc = writeMemory(elementSize, index-start, addr+start, data_ptr+start);
+            if (rc != BDM_RC_OK) {
+               return rc;
+            }
+         }
+         start = runEnd;
+      }
+      index = runEnd;
+   }
+   if (count > start) {
+      return writeMemory(elementSize, count-start, addr+start, data_ptr+start);
+   }
+   return BDM_RC_OK;
+}
+
+/** Size of history kept for LZ matches when decompressing (maximum match offset) */
+static constexpr unsigned DECOMPRESS_WINDOW = 256;
+
+/** Size of decompressed data written to target in each block (blocks are aligned to this size) */
+static constexpr unsigned DECOMPRESS_CHUNK  = 256;
+
+static_assert((TAR_INCREMENT_BOUNDARY%DECOMPRESS_CHUNK) == 0, "DECOMPRESS_CHUNK must divide TAR_INCREMENT_BOUNDARY");
+
+/** State of decompressed write stream */
+struct DecompressState {
+   uint8_t  buffer[DECOMPRESS_WINDOW+DECOMPRESS_CHUNK]; //!< History followed by data pending write
+   unsigned history;      //!< Number of history bytes at start of buffer
+   unsigned outIndex;     //!< Next free location in buffer
+   uint32_t elementSize;  //!< Size of the data writes
+   uint32_t address;      //!< Target address for pending data
+   bool     skipErased;   //!< Destination is erased Flash, see writeMemorySkipErased()
+};
+
+static DecompressState decompressState;
+
+/**
+ * Write pending decompressed data to target memory
+ *
+ * @param keepHistory Retain window of data for following LZ matches
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode flushDecompressed(bool keepHistory) {
+   DecompressState &ds = decompressState;
+   unsigned pending = ds.outIndex-ds.history;
+   if (pending > 0) {
+      if ((pending&(ds.elementSize-1)) != 0) {
+         return BDM_RC_ILLEGAL_PARAMS;
+      }
+      USBDM_ErrorCode rc;
+      if (ds.skipErased) {
+         rc = writeMemorySkipErased(ds.elementSize, pending, ds.address, ds.buffer+ds.history);
+      }
+      else {
+         rc = writeMemory(ds.elementSize, pending, ds.address, ds.buffer+ds.history);
+      }
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      ds.address += pending;
+   }
+   if (keepHistory) {
+      // The first (partial) block may be shorter than the window
+      unsigned history = (ds.outIndex<DECOMPRESS_WINDOW)?ds.outIndex:DECOMPRESS_WINDOW;
+      memmove(ds.buffer, ds.buffer+ds.outIndex-history, history);
+      ds.history  = history;
+      ds.outIndex = history;
+   }
+   return BDM_RC_OK;
+}
+
+/**  Write compressed data to ARM-SWD Memory
+ *
+ *  The data is decoded directly into the memory write stream, see \ref CompressionToken_t for format.
+ *
+ *  @param elementSize  Size of the data writes (+MS_SkipErased => destination is erased Flash)
+ *  @param addr         Address in target memory
+ *  @param data         Compressed data
+ *  @param size         Size of compressed data
+ *  @param decodedSize  Number of bytes written to target
+ *
+ *  @return BDM_RC_OK => success, error otherwise
+ *
+ *  @note Decoded data size must be a multiple of elementSize
+ */
+USBDM_ErrorCode writeMemoryCompressed(
+      uint32_t       elementSize,
+      uint32_t       addr,
+      const uint8_t *data,
+      unsigned       size,
+      uint32_t      &decodedSize
+) {
+   DecompressState &ds = decompressState;
+   ds.history     = 0;
+   ds.outIndex    = 0;
+   ds.elementSize = elementSize&MS_SIZE;
+   ds.skipErased  = (elementSize&MS_SkipErased) != 0;
+   ds.address     = addr;
+   if ((ds.elementSize != MS_Byte) && (ds.elementSize != MS_Word) && (ds.elementSize != MS_Long)) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   const uint8_t *end = data+size;
+   while (data < end) {
+      uint8_t  token  = *data++;
+      unsigned length = (token&CT_LENGTH_MASK)+CT_MIN_LENGTH;
+      unsigned offset = 0;
+      uint8_t  value  = 0;
+      switch (token&CT_TYPE_MASK) {
+         case CT_RUN:
+            if ((token&CT_LENGTH_MASK) == CT_LENGTH_MASK) {
+               // Long run
+               if ((end-data) < 2) {
+                  return BDM_RC_ILLEGAL_PARAMS;
+               }
+               length = pack16BE(data);
+               data += 2;
+            }
+            if (data >= end) {
+               return BDM_RC_ILLEGAL_PARAMS;
+            }
+            value = *data++;
+            break;
+         case CT_MATCH:
+            if (data >= end) {
+               return BDM_RC_ILLEGAL_PARAMS;
+            }
+            offset = *data++ + 1;
+            if (offset > ds.outIndex) {
+               return BDM_RC_ILLEGAL_PARAMS;
+            }
+            break;
+         default:
+            // Literal
+            length = token+1;
+            if ((unsigned)(end-data) < length) {
+               return BDM_RC_ILLEGAL_PARAMS;
+            }
+            break;
+      }
+      while (length-- > 0) {
+         // Write each block when it reaches a DECOMPRESS_CHUNK boundary in target memory
+         // so blocks never cross the TAR auto-increment boundary
+         if ((ds.outIndex-ds.history) == (DECOMPRESS_CHUNK-(ds.address&(DECOMPRESS_CHUNK-1)))) {
+            USBDM_ErrorCode rc = flushDecompressed(true);
+            if (rc != BDM_RC_OK) {
+               return rc;
+            }
+         }
+         switch (token&CT_TYPE_MASK) {
+            case CT_RUN:   ds.buffer[ds.outIndex] = value;                         break;
+            case CT_MATCH: ds.buffer[ds.outIndex] = ds.buffer[ds.outIndex-offset]; break;
+            default:       ds.buffer[ds.outIndex] = *data++;                       break;
+         }
+         ds.outIndex++;
+      }
+   }
+   USBDM_ErrorCode rc = flushDecompressed(false);
+   decodedSize = ds.address-addr;
+   return rc;
+}
+
+/** Read 32-bit value from ARM-SWD Memory
+ *
+ *  @param address 32-bit memory address
+ *  @param data    32-bit data value from _last_ read in BIG-ENDIAN order!
+ *
+ *  @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode readMemoryWord(const uint32_t address, uint32_t &data) {
+   USBDM_ErrorCode  rc;
+
+   /* Steps
+    *  - Set up to DP_SELECT to access AHB-AP register bank 0 (CSW,TAR,DRW)
+    *  - Write AP-CSW value (auto-increment etc)
+    *  - Write AP-TAR value (starting target memory address)
+    *  - Initiate read by reading from DRW (dummy value)
+    *  - Read data value from DP-READBUFF
+    */
+   // Select AHB-AP memory bank - subsequent AHB-AP register accesses are all in the same bank
+   rc = writeSelect(ahbApBank0);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   rc = update_ahb_ap_csw_defaultValue();
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   // Write memory access control to CSW
+   rc = writeCsw(ahb_ap_csw_defaultValue|AHB_AP_CSW_SIZE_WORD);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   // Write TAR (target address)
+   rc = writeTar(address);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   uint32_t tt;
+   // Initial read of DRW (dummy data)
+   rc = readReg(SwdRead_AHB_DRW, tt);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   // Read memory data
+   return readReg(SwdRead_DP_RDBUFF, data);
+}
+
+/** DHCSR sticky status bits cleared by probe reads of DHCSR that have not yet been seen by the host */
+static uint32_t dhcsrStickyBits = 0;
+
+/**
+ *  Read DHCSR on behalf of the probe (rather than the host).
+ *  Reading DHCSR clears the sticky S_RESET_ST and S_RETIRE_ST bits so these are latched
+ *  and returned with the next host read of DHCSR, see mergeDhcsrStickyBits().
+ *
+ *  @param dhcsr  DHCSR value
+ *
+ *  @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode readDhcsr(uint32_t &dhcsr) {
+   USBDM_ErrorCode rc = readMemoryWord(DHCSR_ADDR, dhcsr);
+   if (rc == BDM_RC_OK) {
+      dhcsrStickyBits |= dhcsr&(DHCSR_S_RESET_ST|DHCSR_S_RETIRE_ST);
+   }
+   return rc;
 }
 
-/** Read 32-bit value from ARM-SWD Memory
+/**
+ *  Merge DHCSR sticky bits latched by readDhcsr() into target memory read by the host.
+ *  The latched bits are cleared once returned.
  *
- *  @param address 32-bit memory address
- *  @param data    32-bit data value from _last_ read in BIG-ENDIAN order!
+ *  @param address  Start address of data read
+ *  @param count    Number of bytes read
+ *  @param data     Data read (target memory order)
+ */
+void mergeDhcsrStickyBits(uint32_t address, uint32_t count, uint8_t *data) {
+   // Sticky bits are in the most significant byte of DHCSR
+   constexpr uint32_t stickyByteAddress = DHCSR_ADDR+3;
+
+   if ((dhcsrStickyBits == 0) || (address > stickyByteAddress) || ((stickyByteAddress-address) >= count)) {
+      return;
+   }
+   data[stickyByteAddress-address] |= (uint8_t)(dhcsrStickyBits>>24);
+   dhcsrStickyBits = 0;
+}
+
+/**
+ *  Repeatedly sample a single target memory word e.g. a sampling register.
+ *  Reads are pipelined so each sample costs a single AHB-AP.DRW access.
+ *
+ *  @param address  Address of word in target memory (word aligned)
+ *  @param count    Number of samples to take
+ *  @param data     Where to place samples (native order)
+ *  @param pace     Called before each sample is taken e.g. to wait for a timer (may be nullptr)
  *
  *  @return BDM_RC_OK => success, error otherwise
  */
-USBDM_ErrorCode readMemoryWord(const uint32_t address, uint32_t &data) {
+USBDM_ErrorCode sampleMemoryWord(uint32_t address, unsigned count, uint32_t data[], void (*pace)()) {
    USBDM_ErrorCode  rc;
 
-   /* Steps
-    *  - Set up to DP_SELECT to access AHB-AP register bank 0 (CSW,TAR,DRW)
-    *  - Write AP-CSW value (auto-increment etc)
-    *  - Write AP-TAR value (starting target memory address)
-    *  - Initiate read by reading from DRW (dummy value)
-    *  - Read data value from DP-READBUFF
-    */
-   // Select AHB-AP memory bank - subsequent AHB-AP register accesses are all in the same bank
-   rc = writeReg(SwdWrite_DP_SELECT, ARM_AHB_AP_BANK0);
+   if (count == 0) {
+      return BDM_RC_OK;
+   }
+   // Same set-up as readMemoryWord() - CSW has no auto-increment so TAR is unchanged by DRW reads
+   rc = writeSelect(ahbApBank0);
    if (rc != BDM_RC_OK) {
       return rc;
    }
@@ -1193,36 +3111,141 @@ USBDM_ErrorCode readMemoryWord(const uint32_t address, uint32_t &data) {
    if (rc != BDM_RC_OK) {
       return rc;
    }
-   // Write memory access control to CSW
-   rc = writeReg(SwdWrite_AHB_CSW, ahb_ap_csw_defaultValue|AHB_AP_CSW_SIZE_WORD);
+   rc = writeCsw(ahb_ap_csw_defaultValue|AHB_AP_CSW_SIZE_WORD);
    if (rc != BDM_RC_OK) {
       return rc;
    }
-   // Write TAR (target address)
-   rc = writeReg(SwdWrite_AHB_TAR, address);
+   rc = writeTar(address);
    if (rc != BDM_RC_OK) {
       return rc;
    }
-   uint32_t tt;
-   // Initial read of DRW (dummy data)
-   rc = readReg(SwdRead_AHB_DRW, tt);
+   // Each DRW read starts a new sample and returns the previous one
+   for (unsigned sample=0; sample<=count; sample++) {
+      if (sample == count) {
+         // Collect final sample
+         return readReg(SwdRead_DP_RDBUFF, data[sample-1]);
+      }
+      if (pace != nullptr) {
+         pace();
+      }
+      uint32_t value;
+      rc = readReg(SwdRead_AHB_DRW, value);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      if (sample > 0) {
+         data[sample-1] = value;
+      }
+   }
+   return BDM_RC_OK;
+}
+
+/**
+ *  Save value read from AHB-AP.DRW for a memory location
+ *
+ *  @param location Location read
+ *  @param value    Value from DRW (data is on byte lanes selected by address)
+ *  @param data     Where to place data (target memory order)
+ */
+static void saveLocation(const MemoryLocation &location, uint32_t value, uint8_t *data) {
+   value >>= 8*(location.address&3);
+   for (unsigned index=0; index<location.size; index++) {
+      *data++ = (uint8_t)value;
+      value >>= 8;
+   }
+}
+
+/**
+ *  Read a list of target memory locations in a single pipelined sequence.
+ *  Each AHB-AP.DRW read returns the value of the previous location.
+ *  CSW and TAR are only written when the size changes or the address does not follow on
+ *  from the previous location (the pipeline is drained through DP.RDBUFF first).
+ *
+ *  @param count     Number of locations
+ *  @param locations Locations to read
+ *  @param data      Where to place data (target memory order, sizes packed back-to-back)
+ *
+ *  @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode readMemoryList(unsigned count, const MemoryLocation locations[], uint8_t *data) {
+   USBDM_ErrorCode rc;
+
+   rc = writeSelect(ahbApBank0);
    if (rc != BDM_RC_OK) {
       return rc;
    }
-   // Read memory data
-   return readReg(SwdRead_DP_RDBUFF, data);
+   rc = update_ahb_ap_csw_defaultValue();
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   const MemoryLocation *pending     = nullptr;  // Location with read in progress
+   uint8_t              *pendingData = nullptr;
+   uint32_t              value;
+
+   for (unsigned index=0; index<count; index++) {
+      const MemoryLocation &location = locations[index];
+      uint32_t cswValue = ahb_ap_csw_defaultValue|AHB_AP_CSW_INC_SINGLE;
+      switch(location.size) {
+         case MS_Byte: cswValue |= AHB_AP_CSW_SIZE_BYTE;     break;
+         case MS_Word: cswValue |= AHB_AP_CSW_SIZE_HALFWORD; break;
+         case MS_Long: cswValue |= AHB_AP_CSW_SIZE_WORD;     break;
+         default:      return BDM_RC_ILLEGAL_PARAMS;
+      }
+      bool follows = dapShadow.cswValid && (dapShadow.csw == cswValue) &&
+                     dapShadow.tarValid && (dapShadow.tar == location.address);
+      if ((pending != nullptr) && !follows) {
+         // AP writes can't be inserted between a DRW read and its result
+         rc = readReg(SwdRead_DP_RDBUFF, value);
+         if (rc != BDM_RC_OK) {
+            return rc;
+         }
+         saveLocation(*pending, value, pendingData);
+         pending = nullptr;
+      }
+      rc = writeCsw(cswValue);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      rc = writeTar(location.address);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      // Start read of this location and collect previous one
+      rc = readReg(SwdRead_AHB_DRW, value);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      if (pending != nullptr) {
+         saveLocation(*pending, value, pendingData);
+      }
+      pending     = &location;
+      pendingData = data;
+      data       += location.size;
+   }
+   if (pending != nullptr) {
+      // Collect final location
+      rc = readReg(SwdRead_DP_RDBUFF, value);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      saveLocation(*pending, value, pendingData);
+   }
+   return BDM_RC_OK;
 }
 
-/**  Read ARM-SWD Memory
+/**  Read ARM-SWD Memory using given CSW settings
  *
- *  @param elementSize  Size of the data elements
+ *  @param cswValue     AHB-AP.CSW size and increment settings
+ *  @param elementSize  Size of the data elements on each DRW transfer (1, 2 or 4 bytes)
  *  @param count        Number of data bytes
  *  @param addr         LSB of Address in target memory
  *  @param data_ptr     Where in buffer to write the data
  *
  *  @return BDM_RC_OK => success, error otherwise
+ *
+ *  @note The transfer must not cross a TAR_INCREMENT_BOUNDARY
  */
-USBDM_ErrorCode readMemory(uint32_t elementSize, int count, uint32_t addr, uint8_t *data_ptr) {
+static USBDM_ErrorCode readMemoryChunk(uint32_t cswValue, uint32_t elementSize, int count, uint32_t addr, uint8_t *data_ptr) {
    USBDM_ErrorCode  rc;
    uint8_t  temp[4];
 
@@ -1236,19 +3259,8 @@ USBDM_ErrorCode readMemory(uint32_t elementSize, int count, uint32_t addr, uint8
     *      Note: Last value is read from DP-READBUFF
     *    - Copy to buffer adjusting byte order
     */
-   if (count>MAX_COMMAND_SIZE-1) {
-      return BDM_RC_ILLEGAL_PARAMS;  // requested block+status is too long to fit into the buffer
-   }
-#ifdef HACK
-   {
-      uint32_t address = (commandBuffer[4]<<24)+(commandBuffer[5]<<16)+(commandBuffer[6]<<8)+commandBuffer[7];
-      memcpy(data_ptr, (void*)address, count);
-      returnSize = count+1;
-      return BDM_RC_OK;
-   }
-#else
    // Select AHB-AP memory bank - subsequent AHB-AP register accesses are all in the same bank
-   rc = writeReg(SwdWrite_DP_SELECT, ARM_AHB_AP_BANK0);
+   rc = writeSelect(ahbApBank0);
    if (rc != BDM_RC_OK) {
       return rc;
    }
@@ -1257,15 +3269,32 @@ USBDM_ErrorCode readMemory(uint32_t elementSize, int count, uint32_t addr, uint8
       return rc;
    }
    // Write CSW (auto-increment etc)
-   rc = writeReg(SwdWrite_AHB_CSW, ahb_ap_csw_defaultValue|getcswValue(elementSize));
+   rc = writeCsw(ahb_ap_csw_defaultValue|cswValue);
    if (rc != BDM_RC_OK) {
       return rc;
    }
    // Write TAR (target address)
-   rc = writeReg(SwdWrite_AHB_TAR, addr);
+   rc = writeTar(addr);
    if (rc != BDM_RC_OK) {
       return rc;
    }
+#if SWD_DMA_TRANSFERS
+   if ((count/elementSize) >= DMA_MIN_TRANSACTIONS) {
+      unsigned bytesDone;
+      rc = dmaReadMemory(elementSize, count, addr, data_ptr, bytesDone);
+      if ((rc == BDM_RC_OK) || (bytesDone == (unsigned)count)) {
+         return rc;
+      }
+      // Complete remainder of transfer without DMA
+      count    -= bytesDone;
+      addr     += bytesDone;
+      data_ptr += bytesDone;
+      rc = writeReg(SwdWrite_AHB_TAR, addr);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+   }
+#endif
 
    // Initial read of DRW (dummy data)
    rc = readReg(SwdRead_AHB_DRW, temp);
@@ -1349,6 +3378,79 @@ USBDM_ErrorCode readMemory(uint32_t elementSize, int count, uint32_t addr, uint8
       break;
    }
    return rc;
+}
+
+/**  Read ARM-SWD Memory using given CSW settings
+ *
+ *  The transfer is split at TAR_INCREMENT_BOUNDARY and TAR re-written for each chunk.
+ *
+ *  @param cswValue     AHB-AP.CSW size and increment settings
+ *  @param elementSize  Size of the data elements on each DRW transfer (1, 2 or 4 bytes)
+ *  @param count        Number of data bytes
+ *  @param addr         LSB of Address in target memory
+ *  @param data_ptr     Where in buffer to write the data
+ *
+ *  @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode readMemoryBlock(uint32_t cswValue, uint32_t elementSize, uint32_t count, uint32_t addr, uint8_t *data_ptr) {
+   while (count > 0) {
+      uint32_t chunkSize = tarChunkSize(addr, count);
+      USBDM_ErrorCode rc = readMemoryChunk(cswValue, elementSize, chunkSize, addr, data_ptr);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      count    -= chunkSize;
+      addr     += chunkSize;
+      data_ptr += chunkSize;
+   }
+   return BDM_RC_OK;
+}
+
+/**  Read ARM-SWD Memory
+ *
+ *  @param elementSize  Size of the data elements
+ *  @param count        Number of data bytes
+ *  @param addr         LSB of Address in target memory
+ *  @param data_ptr     Where in buffer to write the data
+ *
+ *  @return BDM_RC_OK => success, error otherwise
+ *
+ *  @note Byte and halfword blocks use packed transfers for the word-aligned portion where supported
+ *  @note The block may cross TAR_INCREMENT_BOUNDARY - TAR is re-written for each portion
+ */
+USBDM_ErrorCode readMemory(uint32_t elementSize, int count, uint32_t addr, uint8_t *data_ptr) {
+   USBDM_ErrorCode  rc;
+
+   if (count>EXTENDED_COMMAND_SIZE-1) {
+      return BDM_RC_ILLEGAL_PARAMS;  // requested block+status is too long to fit into the buffer
+   }
+#ifdef HACK
+   {
+      uint32_t address = (commandBuffer[4]<<24)+(commandBuffer[5]<<16)+(commandBuffer[6]<<8)+commandBuffer[7];
+      memcpy(data_ptr, (void*)address, count);
+      returnSize = count+1;
+      return BDM_RC_OK;
+   }
+#else
+   rc = update_ahb_ap_csw_defaultValue();
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   uint32_t head, body, tail;
+   if (!splitPackedTransfer(elementSize, count, addr, head, body, tail)) {
+      return readMemoryBlock(getcswValue(elementSize), elementSize, count, addr, data_ptr);
+   }
+   if (head > 0) {
+      rc = readMemoryBlock(getcswValue(elementSize), elementSize, head, addr, data_ptr);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+   }
+   rc = readMemoryBlock(getPackedcswValue(elementSize), MS_Long, body, addr+head, data_ptr+head);
+   if ((rc != BDM_RC_OK) || (tail == 0)) {
+      return rc;
+   }
+   return readMemoryBlock(getcswValue(elementSize), elementSize, tail, addr+head+body, data_ptr+head+body);
 #endif
 }
 
@@ -1378,7 +3480,7 @@ static USBDM_ErrorCode coreRegisterOperation(uint32_t dcrsrValue) {
          return BDM_RC_ARM_ACCESS_ERROR;
       }
       // Check complete (use dcrsrValue as scratch)
-      rc = readMemoryWord(DHCSR_ADDR, dhcsrValue);
+      rc = readDhcsr(dhcsrValue);
       if (rc != BDM_RC_OK) {
          return rc;
       }
@@ -1391,24 +3493,121 @@ static USBDM_ErrorCode coreRegisterOperation(uint32_t dcrsrValue) {
 }
 
 /**
- *  Read target register
+ *  Read target register from target (bypasses cache)
  *
  *  @param regNo    Number of register to read
- *  @param data     Register value as 32-bit data value in BIG-ENDIAN order
+ *  @param value    Register value
  *
  *  @return BDM_RC_OK               Success
  *  @return BDM_RC_TARGET_BUSY      Register is inaccessible as processor is not in debug mode
  *  @return BDM_RC_ARM_ACCESS_ERROR Failed access
  */
-USBDM_ErrorCode readCoreRegister(uint8_t regNo, uint8_t data[4]) {
+static USBDM_ErrorCode readCoreRegisterUncached(uint32_t regNo, uint32_t &value) {
    USBDM_ErrorCode rc;
    // Execute register transfer command
    rc = coreRegisterOperation(DCRSR_READ|regNo);
    if (rc != BDM_RC_OK) {
       return rc;
    }
-   // Read register value from DCRDR holding register (Big-endian)
-   return readMemoryWord(DCRDR_ADDR, data);
+   // Read register value from DCRDR holding register
+   return readMemoryWord(DCRDR_ADDR, value);
+}
+
+/**
+ *  Load block of registers into register cache
+ *
+ *  @param firstReg  First register number
+ *  @param lastReg   Last register number
+ *
+ *  @return BDM_RC_OK => success, error from first register otherwise
+ *
+ *  @note Registers that cannot be read are not cached
+ */
+static USBDM_ErrorCode loadRegisterCache(uint32_t firstReg, uint32_t lastReg) {
+   USBDM_ErrorCode firstRc = BDM_RC_OK;
+   for (uint32_t regNo=firstReg; regNo<=lastReg; regNo++) {
+      int index = regCacheIndex(regNo);
+      if ((index < 0) || (regCache.valid & (1ULL<<index))) {
+         continue;
+      }
+      USBDM_ErrorCode rc = readCoreRegisterUncached(regNo, regCache.values[index]);
+      if (rc == BDM_RC_OK) {
+         regCache.valid |= (1ULL<<index);
+      }
+      else if (regNo == firstReg) {
+         firstRc = rc;
+         if ((rc == BDM_RC_TARGET_BUSY) || (rc == BDM_RC_ARM_ACCESS_ERROR)) {
+            // Target not halted or registers not present
+            break;
+         }
+      }
+   }
+   return firstRc;
+}
+
+/**
+ *  Snapshot core registers (R0-R15, xPSR, MSP, PSP, MISC) into the register cache.
+ *  Used when the target is known to have halted so later reads are served from the cache.
+ *
+ *  @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode snapshotCoreRegisters() {
+   return loadRegisterCache(ARM_RegR0, ARM_RegMISC);
+}
+
+/**
+ *  Get core register value from register cache
+ *
+ *  @param regNo    Number of register
+ *  @param value    Register value
+ *
+ *  @return true if register is present in cache
+ */
+bool getCachedCoreRegister(uint32_t regNo, uint32_t &value) {
+   int index = regCacheIndex(regNo);
+   if ((index < 0) || !(regCache.valid & (1ULL<<index))) {
+      return false;
+   }
+   value = regCache.values[index];
+   return true;
+}
+
+/**
+ *  Read target register
+ *
+ *  @param regNo    Number of register to read
+ *  @param data     Register value as 32-bit data value in BIG-ENDIAN order
+ *
+ *  @return BDM_RC_OK               Success
+ *  @return BDM_RC_TARGET_BUSY      Register is inaccessible as processor is not in debug mode
+ *  @return BDM_RC_ARM_ACCESS_ERROR Failed access
+ *
+ *  @note Values are served from the register cache when available.
+ *        On a miss the block of core or floating point registers containing regNo is loaded.
+ */
+USBDM_ErrorCode readCoreRegister(uint8_t regNo, uint8_t data[4]) {
+   uint32_t value;
+   if (!getCachedCoreRegister(regNo, value)) {
+      int index = regCacheIndex(regNo);
+      USBDM_ErrorCode rc;
+      if (index < 0) {
+         rc = readCoreRegisterUncached(regNo, value);
+      }
+      else {
+         if ((unsigned)index < REG_CACHE_CORE_SIZE) {
+            rc = loadRegisterCache(regNo, ARM_RegMISC);
+         }
+         else {
+            rc = loadRegisterCache(regNo, ARM_RegFPS0+REG_CACHE_FP_SIZE-2);
+         }
+         value = regCache.values[index];
+      }
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+   }
+   unpack32BE(value, data);
+   return BDM_RC_OK;
 }
 
 /**
@@ -1424,6 +3623,10 @@ USBDM_ErrorCode readCoreRegister(uint8_t regNo, uint8_t data[4]) {
 USBDM_ErrorCode writeCoreReg(uint32_t regNo, uint8_t data[4]) {
    USBDM_ErrorCode rc;
 
+   // The value written is not cached as the core may mask it (e.g. SP[1:0], xPSR reserved bits).
+   // The next read will re-load the register.
+   invalidateRegisterCacheEntry(regNo);
+
    // Write data value to DCRDR holding register
    rc = writeMemoryWord(DCRDR_ADDR, data);
    if (rc != BDM_RC_OK) {
@@ -1444,7 +3647,7 @@ USBDM_ErrorCode writeCoreReg(uint32_t regNo, uint8_t data[4]) {
  */
 USBDM_ErrorCode modifyDHCSR(uint8_t preserveBits, uint8_t setBits) {
    uint32_t debugStepValue;
-   USBDM_ErrorCode rc = readMemoryWord(DHCSR_ADDR, debugStepValue);
+   USBDM_ErrorCode rc = readDhcsr(debugStepValue);
    if (rc != BDM_RC_OK) {
       return rc;
    }
@@ -1452,4 +3655,91 @@ USBDM_ErrorCode modifyDHCSR(uint8_t preserveBits, uint8_t setBits) {
    return writeMemoryWord(DHCSR_ADDR, debugStepValue);
 }
 
+/**
+ *  ARM-SWD -  Single-step target until PC leaves address range [start, end)
+ *
+ *  @param start     Start of address range
+ *  @param end       End of address range (exclusive)
+ *  @param maxSteps  Maximum number of steps to execute
+ *  @param pc        Final PC value
+ *  @param steps     Number of steps executed
+ *  @param reason    Reason stepping stopped, see \ref RangeStepReason_t
+ *
+ *  @return
+ *     == \ref BDM_RC_OK => success       \n
+ *     != \ref BDM_RC_OK => error         \n
+ *
+ *  @note At least one step is executed even if PC is initially outside the range.\n
+ *        The value of DHCSR.C_MASKINTS is preserved.
+ */
+USBDM_ErrorCode rangeStep(
+      uint32_t           start,
+      uint32_t           end,
+      uint32_t           maxSteps,
+      uint32_t          &pc,
+      uint32_t          &steps,
+      RangeStepReason_t &reason) {
+
+   steps  = 0;
+   reason = RS_MAX_STEPS;
+
+   uint32_t dhcsrValue;
+   USBDM_ErrorCode rc = readDhcsr(dhcsrValue);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   if ((dhcsrValue&DHCSR_S_HALT) == 0) {
+      // Must start from debug mode
+      return BDM_RC_TARGET_BUSY;
+   }
+   // Step value is the same each time so calculate once
+   const uint32_t stepValue = (dhcsrValue&DHCSR_C_MASKINTS)|DHCSR_DBGKEY|DHCSR_C_STEP|DHCSR_C_DEBUGEN;
+
+   // Clear sticky halt reasons so breakpoints can be detected
+   rc = writeMemoryWord(DFSR_ADDR, DFSR_ALL);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   while (steps < maxSteps) {
+      rc = writeMemoryWord(DHCSR_ADDR, stepValue);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      steps++;
+
+      // Wait for step to complete
+      int retryCount = 40;
+      do {
+         if (retryCount-- == 0) {
+            // Target didn't re-enter debug mode e.g. stalled bus access or sleeping
+            return BDM_RC_TARGET_BUSY;
+         }
+         rc = readDhcsr(dhcsrValue);
+         if (rc != BDM_RC_OK) {
+            return rc;
+         }
+      } while ((dhcsrValue&DHCSR_S_HALT) == 0);
+
+      rc = readCoreRegisterUncached(ARM_RegPC, pc);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      uint32_t dfsrValue;
+      rc = readMemoryWord(DFSR_ADDR, dfsrValue);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      if (dfsrValue&(DFSR_BKPT|DFSR_DWTTRAP|DFSR_VCATCH|DFSR_EXTERNAL)) {
+         reason = RS_BREAKPOINT;
+         break;
+      }
+      if ((pc < start) || (pc >= end)) {
+         reason = RS_LEFT_RANGE;
+         break;
+      }
+   }
+   // Leave the halt reasons visible to the host
+   return BDM_RC_OK;
+}
+
 }; // End namespace Swd
@@ -120,10 +120,46 @@ enum SwdWrite {
    SwdWrite_AHB_DRW = SwdWrite_AP_REG3, // Write AHB-DRW
 };
 
+/** AHB-AP TAR auto-increment is only guaranteed within this boundary */
+static constexpr uint32_t TAR_INCREMENT_BOUNDARY = 0x400;
+
+/** Maximum number of Access Ports supported (AP # is DP.SELECT[31:24]) */
+static constexpr unsigned SWD_MAX_APS = 8;
+
+/**
+ * Description of an Access Port found by enumerateAps()
+ */
+struct ApDescription {
+   uint32_t idr;     //!< AP.IDR
+   uint32_t base;    //!< AP.BASE (MEM-AP only, otherwise 0)
+   uint32_t cpuid;   //!< CPUID of Cortex-M core found in ROM table (0 if none)
+};
+
+/**
+ * Target memory location for readMemoryList()
+ */
+struct MemoryLocation {
+   uint32_t address;  //!< Address in target memory (aligned to size)
+   uint8_t  size;     //!< Size in bytes (1, 2 or 4)
+};
+
+/**
+ * SWD link statistics
+ */
+struct SwdStatistics {
+   uint32_t waitRetries;   //!< WAIT responses (each causes a retry)
+   uint32_t faults;        //!< FAULT responses
+   uint32_t parityErrors;  //!< Parity errors on read data
+   uint32_t noAcks;        //!< Missing or invalid ACKs
+   uint32_t reconnects;    //!< Re-connections done to recover from a failed command
+   uint32_t drwWords;      //!< AHB-AP.DRW data words transferred (excludes dummy posted reads)
+};
+
 // Memory addresses of debug/core registers
 static constexpr uint32_t  DHCSR_ADDR              = 0xE000EDF0U; // RW Debug Halting Control and Status Register
 static constexpr uint32_t  DCRSR_ADDR              = 0xE000EDF4U; // WO Debug Core Selector Register
 static constexpr uint32_t  DCRDR_ADDR              = 0xE000EDF8U; // RW Debug Core Data Register
+static constexpr uint32_t  DFSR_ADDR               = 0xE000ED30U; // RW Debug Fault Status Register
 
 static constexpr uint32_t  DCRSR_WRITE             = (1<<16);
 static constexpr uint32_t  DCRSR_READ              = (0);
@@ -142,6 +178,13 @@ static constexpr uint32_t  DHCSR_C_STEP            = (1<<2);
 static constexpr uint32_t  DHCSR_C_HALT            = (1<<1);
 static constexpr uint32_t  DHCSR_C_DEBUGEN         = (1<<0);
 
+static constexpr uint32_t  DFSR_EXTERNAL           = (1<<4);
+static constexpr uint32_t  DFSR_VCATCH             = (1<<3);
+static constexpr uint32_t  DFSR_DWTTRAP            = (1<<2);
+static constexpr uint32_t  DFSR_BKPT               = (1<<1);
+static constexpr uint32_t  DFSR_HALTED             = (1<<0);
+static constexpr uint32_t  DFSR_ALL                = DFSR_EXTERNAL|DFSR_VCATCH|DFSR_DWTTRAP|DFSR_BKPT|DFSR_HALTED;
+
 /**
  * Pack 2 bytes into a 32-bit value for ARM addresses
  *
@@ -187,6 +230,71 @@ USBDM_ErrorCode setSpeed(uint32_t frequency);
  */
 uint32_t getSpeed();
 
+/**
+ * Gets speed that would be used for a requested SWD frequency
+ *
+ * @param frequency Frequency in Hz
+ *
+ * @return Achievable frequency in Hz (highest speed that is not greater than frequency)
+ */
+uint32_t getAchievableSpeed(uint32_t frequency);
+
+/**
+ * Gets count of SWD transfers that failed due to link errors
+ * i.e. parity errors or corrupted ACKs (not WAIT, FAULT or no response)
+ *
+ * @return Error count (wraps)
+ */
+uint32_t getLinkErrorCount();
+
+/**
+ * Gets count of successful SWD transfers
+ *
+ * @return Transfer count (wraps)
+ */
+uint32_t getLinkTransferCount();
+
+/**
+ * Get SWD link statistics
+ *
+ * @param stats Where to return statistics
+ */
+void getStatistics(SwdStatistics &stats);
+
+/**
+ * Clear SWD link statistics
+ */
+void clearStatistics();
+
+/**
+ * Re-connect to target to recover from a failed command.
+ * This is counted in the link statistics.
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode reconnect();
+
+/**
+ * Set handling of WAIT responses to DP/AP register accesses
+ *
+ * @param retries     Maximum number of retries after WAIT (0 => limited by timeout only)
+ * @param idleCycles  Idle cycles inserted before each retry (rounded up to a multiple of 8)
+ * @param timeoutUs   Maximum time to retry in microseconds (0 => limited by retries only)
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode setWaitPolicy(unsigned retries, unsigned idleCycles, uint32_t timeoutUs);
+
+/**
+ * Enable streaming block writes.
+ * When enabled, DMA block writes are transferred as a continuous run without checking
+ * individual ACKs. DP.CTRL/STAT is checked once at the end of the run and on an overrun
+ * the write resumes with checked transfers from the first element not written (from AHB-AP.TAR).
+ *
+ * @param enable True to enable streaming writes
+ */
+void setStreamingWrites(bool enable);
+
 /**
  * Initialise interface\n
  * Does not communicate with target
@@ -433,6 +541,39 @@ USBDM_ErrorCode clearStickyBits(void);
  */
 USBDM_ErrorCode abortAP(void);
 
+/**
+ * Select the MEM-AP used for memory and core register accesses
+ *
+ * @param apNum AP # (0..SWD_MAX_APS-1)
+ *
+ * @return BDM_RC_OK => success
+ * @return BDM_RC_ILLEGAL_PARAMS => AP # out of range, AP not present or not a MEM-AP (e.g. Kinetis MDM-AP)
+ * @return Other => error reading AP.IDR
+ *
+ * @note Core register cache is invalidated when the AP changes
+ */
+USBDM_ErrorCode selectAp(unsigned apNum);
+
+/**
+ * Get the MEM-AP used for memory and core register accesses
+ *
+ * @return AP #
+ */
+unsigned getSelectedAp();
+
+/**
+ * Enumerate Access Ports.
+ * The ROM table of each MEM-AP is scanned for a Cortex-M System Control Space
+ * and the CPUID of the core is read.  The APs are accessed directly so the
+ * selected MEM-AP is unchanged.
+ *
+ * @param aps    Description of each AP found
+ * @param count  Number of APs found
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode enumerateAps(ApDescription aps[SWD_MAX_APS], unsigned &count);
+
 /**
  * Mass erase target
  *
@@ -485,6 +626,50 @@ USBDM_ErrorCode writeMemory(
       uint8_t   *data_ptr     // Where the data is
 );
 
+/**  Write ARM-SWD Memory skipping runs of erased (0xFF) data
+ *
+ *  @param elementSize  Size of the data writes
+ *  @param count        # of bytes
+ *  @param addr         Address in target memory
+ *  @param data_ptr     Where the data is
+ *
+ *  @return
+ *   == \ref BDM_RC_OK => success         \n
+ *   != \ref BDM_RC_OK => various errors
+ *
+ *  @note Only valid for a destination known to be in the erased state e.g. erased Flash
+ */
+USBDM_ErrorCode writeMemorySkipErased(
+      uint32_t  elementSize,
+      uint32_t  count,
+      uint32_t  addr,
+      uint8_t   *data_ptr
+);
+
+/**  Write compressed data to ARM-SWD Memory
+ *
+ *  The data is decoded directly into the memory write stream, see \ref CompressionToken_t for format.
+ *
+ *  @param elementSize  Size of the data writes (+MS_SkipErased => destination is erased Flash)
+ *  @param addr         Address in target memory
+ *  @param data         Compressed data
+ *  @param size         Size of compressed data
+ *  @param decodedSize  Number of bytes written to target
+ *
+ *  @return
+ *   == \ref BDM_RC_OK => success         \n
+ *   != \ref BDM_RC_OK => various errors
+ *
+ *  @note Decoded data size must be a multiple of elementSize
+ */
+USBDM_ErrorCode writeMemoryCompressed(
+      uint32_t       elementSize,
+      uint32_t       addr,
+      const uint8_t *data,
+      unsigned       size,
+      uint32_t      &decodedSize
+);
+
 /** Read 32-bit value from ARM-SWD Memory
  *
  *  @param address 32-bit memory address
@@ -513,6 +698,29 @@ USBDM_ErrorCode readMemoryWord(const uint32_t address, uint8_t data[4]) {
    return rc;
 }
 
+/**
+ *  Read DHCSR on behalf of the probe (rather than the host).
+ *  Reading DHCSR clears the sticky S_RESET_ST and S_RETIRE_ST bits so these are latched
+ *  and returned with the next host read of DHCSR, see mergeDhcsrStickyBits().
+ *
+ *  @param dhcsr  DHCSR value
+ *
+ *  @return
+ *   == \ref BDM_RC_OK => success         \n
+ *   != \ref BDM_RC_OK => various errors
+ */
+USBDM_ErrorCode readDhcsr(uint32_t &dhcsr);
+
+/**
+ *  Merge DHCSR sticky bits latched by readDhcsr() into target memory read by the host.
+ *  The latched bits are cleared once returned.
+ *
+ *  @param address  Start address of data read
+ *  @param count    Number of bytes read
+ *  @param data     Data read (target memory order)
+ */
+void mergeDhcsrStickyBits(uint32_t address, uint32_t count, uint8_t *data);
+
 /**  Read ARM-SWD Memory
  *
  *  @note
@@ -535,6 +743,35 @@ USBDM_ErrorCode readMemory(
       uint8_t   *data_ptr      // Where in buffer to write the data
 );
 
+/**
+ *  Repeatedly sample a single target memory word e.g. a sampling register.
+ *  Reads are pipelined so each sample costs a single AHB-AP.DRW access.
+ *
+ *  @param address  Address of word in target memory (word aligned)
+ *  @param count    Number of samples to take
+ *  @param data     Where to place samples (native order)
+ *  @param pace     Called before each sample is taken e.g. to wait for a timer (may be nullptr)
+ *
+ *  @return
+ *   == \ref BDM_RC_OK => success
+ */
+USBDM_ErrorCode sampleMemoryWord(uint32_t address, unsigned count, uint32_t data[], void (*pace)());
+
+/**
+ *  Read a list of target memory locations in a single pipelined sequence.
+ *  Each AHB-AP.DRW read returns the value of the previous location.
+ *  CSW and TAR are only written when the size changes or the address does not follow on
+ *  from the previous location (the pipeline is drained through DP.RDBUFF first).
+ *
+ *  @param count     Number of locations
+ *  @param locations Locations to read
+ *  @param data      Where to place data (target memory order, sizes packed back-to-back)
+ *
+ *  @return
+ *   == \ref BDM_RC_OK => success
+ */
+USBDM_ErrorCode readMemoryList(unsigned count, const MemoryLocation locations[], uint8_t *data);
+
 /**
  *  Read target register
  *
@@ -558,6 +795,32 @@ USBDM_ErrorCode readCoreRegister(uint8_t regNo, uint8_t *data);
  */
 USBDM_ErrorCode writeCoreReg(uint32_t regNo, uint8_t *data);
 
+/**
+ *  Invalidate core register cache.
+ *  Required after any action that may change core registers outside of writeCoreReg()
+ *  e.g. target reset or raw AP accesses.
+ */
+void invalidateCoreRegisterCache();
+
+/**
+ *  Snapshot core registers (R0-R15, xPSR, MSP, PSP, MISC) into the register cache.
+ *  Used when the target is known to have halted so later reads are served from the cache.
+ *
+ *  @return
+ *   == \ref BDM_RC_OK => success
+ */
+USBDM_ErrorCode snapshotCoreRegisters();
+
+/**
+ *  Get core register value from register cache
+ *
+ *  @param regNo    Number of register
+ *  @param value    Register value
+ *
+ *  @return true if register is present in cache
+ */
+bool getCachedCoreRegister(uint32_t regNo, uint32_t &value);
+
 /**
  *  ARM-SWD -  Modifies value in LSB of DHCSR
  *  DHCSR.lsb = (DHCSR&preserveBits)|setBits
@@ -571,6 +834,31 @@ USBDM_ErrorCode writeCoreReg(uint32_t regNo, uint8_t *data);
  */
 USBDM_ErrorCode modifyDHCSR(uint8_t preserveBits, uint8_t setBits);
 
+/**
+ *  ARM-SWD -  Single-step target until PC leaves address range [start, end)
+ *
+ *  @param start     Start of address range
+ *  @param end       End of address range (exclusive)
+ *  @param maxSteps  Maximum number of steps to execute
+ *  @param pc        Final PC value
+ *  @param steps     Number of steps executed
+ *  @param reason    Reason stepping stopped, see \ref RangeStepReason_t
+ *
+ *  @return
+ *     == \ref BDM_RC_OK => success       \n
+ *     != \ref BDM_RC_OK => error         \n
+ *
+ *  @note At least one step is executed even if PC is initially outside the range.\n
+ *        The value of DHCSR.C_MASKINTS is preserved.
+ */
+USBDM_ErrorCode rangeStep(
+      uint32_t           start,
+      uint32_t           end,
+      uint32_t           maxSteps,
+      uint32_t          &pc,
+      uint32_t          &steps,
+      RangeStepReason_t &reason);
+
 }; // End namespace Swd
 
 #endif /* INCLUDE_SWD_H_ */
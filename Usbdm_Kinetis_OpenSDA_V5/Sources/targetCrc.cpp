@@ -0,0 +1,152 @@
+/** \file
+    \brief CRC of target memory using the probe CRC hardware
+
+   \verbatim
+
+   USBDM
+   Copyright (C) 2016  Peter O'Donoghue
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   \endverbatim
+ */
+#include "configure.h"
+#include "crc.h"
+#include "commands.h"
+#include "swd.h"
+#include "targetCrc.h"
+
+using namespace USBDM;
+
+namespace TargetCrc {
+
+/** Probe CRC hardware */
+using Crc = CrcBase_T<Crc0Info>;
+
+/**
+ * Size of chunks read from target.
+ * Chunks are aligned so only a leading partial chunk uses byte accesses.
+ */
+static constexpr unsigned CHUNK_SIZE = 256;
+
+static_assert((Swd::TAR_INCREMENT_BOUNDARY%CHUNK_SIZE) == 0, "CHUNK_SIZE must divide TAR_INCREMENT_BOUNDARY");
+
+/** CRC hardware configuration */
+struct CrcConfiguration {
+   uint32_t ctrl;         //!< CRC.CTRL value (width, transposition and complement)
+   uint32_t polynomial;   //!< CRC.GPOLY value
+   uint32_t seed;         //!< Seed written to CRC.DATA before each calculation
+};
+
+/**
+ * Transposition for data and result.
+ * Data is always written as words in target memory (little-endian) order so bytes
+ * are transposed to process the first byte first.
+ */
+static constexpr uint32_t CTRL_NORMAL    = CrcWriteTranspose_BytesTransposed|CrcReadTranspose_NoTransposition;
+static constexpr uint32_t CTRL_REFLECTED = CrcWriteTranspose_BitsAndBytesTransposed|CrcReadTranspose_BitsAndBytesTransposed;
+
+/** Configurations for each CrcPreset_t - see http://reveng.sourceforge.net/crc-catalogue/ */
+static const CrcConfiguration presets[] = {
+      /* CRC_PRESET_CRC32              */ {CrcWidth_32BitCrc|CTRL_REFLECTED|CrcReadComplement_Inverted, 0x04C11DB7, 0xFFFFFFFF},
+      /* CRC_PRESET_CRC32_MPEG2        */ {CrcWidth_32BitCrc|CTRL_NORMAL   |CrcReadComplement_Normal,   0x04C11DB7, 0xFFFFFFFF},
+      /* CRC_PRESET_CRC16_CCITT_FALSE  */ {CrcWidth_16BitCrc|CTRL_NORMAL   |CrcReadComplement_Normal,   0x1021,     0xFFFF},
+      /* CRC_PRESET_CRC16_ARC          */ {CrcWidth_16BitCrc|CTRL_REFLECTED|CrcReadComplement_Normal,   0x8005,     0x0000},
+};
+
+/** Current configuration */
+static CrcConfiguration currentConfiguration = presets[CRC_PRESET_CRC32];
+
+/**
+ * Configure CRC hardware for a preset CRC
+ *
+ * @param preset  CRC to use, see \ref CrcPreset_t
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode configure(CrcPreset_t preset) {
+   if ((unsigned)preset >= sizeofArray(presets)) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   currentConfiguration = presets[preset];
+   return BDM_RC_OK;
+}
+
+/**
+ * Configure CRC hardware for a custom CRC
+ *
+ * @param options    Options, see \ref CrcOptions_t
+ * @param polynomial CRC polynomial
+ * @param seed       CRC seed
+ */
+void configure(unsigned options, uint32_t polynomial, uint32_t seed) {
+   currentConfiguration.ctrl =
+         ((options&CRC_OPTION_32BIT)?CrcWidth_32BitCrc:CrcWidth_16BitCrc)|
+         ((options&CRC_OPTION_REFLECT)?CTRL_REFLECTED:CTRL_NORMAL)|
+         ((options&CRC_OPTION_COMPLEMENT)?CrcReadComplement_Inverted:CrcReadComplement_Normal);
+   currentConfiguration.polynomial = polynomial;
+   currentConfiguration.seed       = seed;
+}
+
+/**
+ * Calculate CRC over a range of target memory
+ *
+ * @param address  Start address in target memory
+ * @param size     Size of range in bytes
+ * @param crc      Calculated CRC
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note CRC hardware must be configured by configure() before use. The CRC is re-seeded for each range.
+ */
+USBDM_ErrorCode calculateCrc(uint32_t address, uint32_t size, uint32_t &crc) {
+   uint32_t buffer[CHUNK_SIZE/sizeof(uint32_t)];
+
+   Crc::enable();
+   Crc::crc->CTRL = currentConfiguration.ctrl;
+   Crc::writePolynomial(currentConfiguration.polynomial);
+   Crc::writeSeed(currentConfiguration.seed);
+
+   while (size > 0) {
+      // Chunk is aligned so doesn't cross TAR auto-increment boundary
+      uint32_t chunkSize = CHUNK_SIZE-(address&(CHUNK_SIZE-1));
+      if (chunkSize > size) {
+         chunkSize = size;
+      }
+      // Word accesses where possible (DMA block transfer), packed byte accesses otherwise.
+      // The CRC is fed by the CPU - the SPI frames received by DMA carry ACK and parity bits
+      // so the data words only exist once unpacked into the buffer.
+      uint32_t elementSize = (((address|chunkSize)&3) == 0)?MS_Long:MS_Byte;
+      USBDM_ErrorCode rc = Swd::readMemory(elementSize, chunkSize, address, (uint8_t *)buffer);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      const uint32_t *wordPtr = buffer;
+      unsigned        count   = chunkSize;
+      while (count >= sizeof(uint32_t)) {
+         Crc::writeData32(*wordPtr++);
+         count -= sizeof(uint32_t);
+      }
+      const uint8_t *bytePtr = (const uint8_t *)wordPtr;
+      while (count-- > 0) {
+         Crc::writeData8(*bytePtr++);
+      }
+      address += chunkSize;
+      size    -= chunkSize;
+   }
+   crc = Crc::getCalculatedCrc();
+   return BDM_RC_OK;
+}
+
+}; // End namespace TargetCrc
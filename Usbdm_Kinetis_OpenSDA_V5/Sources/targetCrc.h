@@ -0,0 +1,72 @@
+/** \file
+    \brief CRC of target memory using the probe CRC hardware
+
+   \verbatim
+
+   USBDM
+   Copyright (C) 2016  Peter O'Donoghue
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   \endverbatim
+ */
+
+#ifndef SOURCES_TARGETCRC_H_
+#define SOURCES_TARGETCRC_H_
+
+#include <stdint.h>
+#include "commands.h"
+
+/**
+ * Calculation of CRCs over target memory.
+ *
+ * Target memory is read over ARM-SWD using the block read path and fed to the
+ * probe CRC hardware so that only the result needs to be returned to the host.
+ */
+namespace TargetCrc {
+
+/**
+ * Configure CRC hardware for a preset CRC
+ *
+ * @param preset  CRC to use, see \ref CrcPreset_t
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode configure(CrcPreset_t preset);
+
+/**
+ * Configure CRC hardware for a custom CRC
+ *
+ * @param options    Options, see \ref CrcOptions_t
+ * @param polynomial CRC polynomial
+ * @param seed       CRC seed
+ */
+void configure(unsigned options, uint32_t polynomial, uint32_t seed);
+
+/**
+ * Calculate CRC over a range of target memory
+ *
+ * @param address  Start address in target memory
+ * @param size     Size of range in bytes
+ * @param crc      Calculated CRC
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note CRC hardware must be configured by configure() before use. The CRC is re-seeded for each range.
+ */
+USBDM_ErrorCode calculateCrc(uint32_t address, uint32_t size, uint32_t &crc);
+
+}; // End namespace TargetCrc
+
+#endif /* SOURCES_TARGETCRC_H_ */
@@ -0,0 +1,566 @@
+/** \file
+    \brief Kinetis target Flash programming over ARM-SWD
+
+   \verbatim
+
+   USBDM
+   Copyright (C) 2016  Peter O'Donoghue
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   \endverbatim
+ */
+#include <string.h>
+#include "configure.h"
+#include "delay.h"
+#include "commands.h"
+#include "swd.h"
+#include "targetCrc.h"
+#include "targetFlash.h"
+
+using namespace USBDM;
+
+namespace TargetFlash {
+
+//==========================================================================
+// Target Flash controller registers (same location for FTFL/FTFA/FTFE)
+//
+static constexpr uint32_t FTFL_FSTAT       = 0x40020000; //!< FSTAT (byte)
+static constexpr uint32_t FTFL_FCCOB3_0    = 0x40020004; //!< FCCOB3..FCCOB0 as word (FCCOB0 in MSB)
+static constexpr uint32_t FTFL_FCCOB7_4    = 0x40020008; //!< FCCOB7..FCCOB4 as word (FCCOB4 in MSB)
+static constexpr uint32_t FTFL_FCCOBB_8    = 0x4002000C; //!< FCCOBB..FCCOB8 as word (FCCOB8 in MSB)
+
+static constexpr uint8_t  FTFL_FSTAT_CCIF     = (1<<7);
+static constexpr uint8_t  FTFL_FSTAT_RDCOLERR = (1<<6);
+static constexpr uint8_t  FTFL_FSTAT_ACCERR   = (1<<5);
+static constexpr uint8_t  FTFL_FSTAT_FPVIOL   = (1<<4);
+static constexpr uint8_t  FTFL_FSTAT_MGSTAT0  = (1<<0);
+
+// Flash commands
+static constexpr uint8_t  F_PGM4           = 0x06;
+static constexpr uint8_t  F_PGM8           = 0x07;
+static constexpr uint8_t  F_ERSSCR         = 0x09;
+static constexpr uint8_t  F_PGMSEC         = 0x0B;
+
+/** Flag in Flash command address indicating Data Flash (FlexNVM) */
+static constexpr uint32_t DATA_ADDRESS_FLAG = 0x00800000;
+
+/** Start of Data Flash (FlexNVM) in target memory map */
+static constexpr uint32_t DATA_FLASH_START  = 0x10000000;
+
+/** Polling interval for command completion */
+static constexpr unsigned POLL_INTERVAL_US  = 20;
+
+/** Time-out for program phrase command */
+static constexpr unsigned PROGRAM_TIMEOUT_US = 10000;
+
+/** Time-out for erase sector or program section command */
+static constexpr unsigned ERASE_TIMEOUT_US   = 500000;
+
+/** Programming state */
+struct ProgramState {
+   uint32_t address;             //!< Next address to program
+   uint32_t erasedLimit;         //!< End of sectors erased so far
+   uint32_t sectorSize;          //!< Target sector size
+   uint32_t sectionRamAddress;   //!< Target programming acceleration RAM address
+   uint16_t sectionRamSize;      //!< Target programming acceleration RAM size
+   uint8_t  phraseSize;          //!< Target phrase size (4 or 8)
+   uint8_t  options;             //!< TargetFlashOptions_t
+   uint8_t  partialCount;        //!< Bytes held in partial phrase
+   uint8_t  partial[8];          //!< Incomplete phrase
+   bool     active;              //!< Programming has been started
+};
+
+static ProgramState programState = {};
+
+/** Result of last compareSectors() used by TF_OPTION_DELTA */
+struct DeltaState {
+   uint32_t address;                         //!< Address of first sector compared
+   uint32_t sectorSize;                      //!< Sector size used for comparison
+   unsigned sectorCount;                     //!< Number of sectors compared
+   uint8_t  changed[DELTA_MAX_SECTORS/8];    //!< Bitmap of changed sectors
+};
+
+static DeltaState deltaState = {};
+
+/** Indicates FSTAT error flags may be set and need clearing before next command */
+static bool errorsPending = true;
+
+/**
+ * Convert target memory address to Flash command address
+ *
+ * @param address Target memory address
+ *
+ * @return Address for FCCOB1..3
+ */
+static uint32_t toFlashAddress(uint32_t address) {
+   if (address >= DATA_FLASH_START) {
+      return (address&(DATA_ADDRESS_FLAG-1))|DATA_ADDRESS_FLAG;
+   }
+   return address&(DATA_ADDRESS_FLAG-1);
+}
+
+/**
+ * Check if sector needs programming according to last compareSectors()
+ *
+ * @param address Address within sector
+ *
+ * @return true if sector has changed or lies outside the compared range
+ */
+static bool isSectorChanged(uint32_t address) {
+   if ((deltaState.sectorCount == 0) || (address < deltaState.address)) {
+      return true;
+   }
+   uint32_t sector = (address-deltaState.address)/deltaState.sectorSize;
+   if (sector >= deltaState.sectorCount) {
+      return true;
+   }
+   return (deltaState.changed[sector/8]&(1<<(sector%8))) != 0;
+}
+
+/**
+ * Write target FSTAT register
+ *
+ * @param value Value to write
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode writeFstat(uint8_t value) {
+   return Swd::writeMemory(MS_Byte, 1, FTFL_FSTAT, &value);
+}
+
+/**
+ * Wait for target Flash command to complete and check status
+ *
+ * @param timeoutUs Time to wait for command completion
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode waitForCommandComplete(unsigned timeoutUs) {
+   uint32_t fstat;
+   for(;;) {
+      USBDM_ErrorCode rc = Swd::readMemoryWord(FTFL_FSTAT, fstat);
+      if (rc != BDM_RC_OK) {
+         errorsPending = true;
+         return rc;
+      }
+      if ((fstat&FTFL_FSTAT_CCIF) != 0) {
+         break;
+      }
+      if (timeoutUs < POLL_INTERVAL_US) {
+         errorsPending = true;
+         return BDM_RC_FLASH_NOT_READY;
+      }
+      timeoutUs -= POLL_INTERVAL_US;
+      waitUS(POLL_INTERVAL_US);
+   }
+   if ((fstat&(FTFL_FSTAT_ACCERR|FTFL_FSTAT_FPVIOL|FTFL_FSTAT_RDCOLERR)) != 0) {
+      errorsPending = true;
+      return PROGRAMMING_RC_ERROR_FAILED_FLASH_COMMAND;
+   }
+   if ((fstat&FTFL_FSTAT_MGSTAT0) != 0) {
+      return PROGRAMMING_RC_ERROR_FAILED_VERIFY;
+   }
+   return BDM_RC_OK;
+}
+
+/**
+ * Check if error is reported by the target Flash controller rather than the SWD interface
+ *
+ * @param rc Error code from waitForCommandComplete()
+ */
+static bool isFlashCommandError(USBDM_ErrorCode rc) {
+   return (rc == PROGRAMMING_RC_ERROR_FAILED_FLASH_COMMAND) || (rc == PROGRAMMING_RC_ERROR_FAILED_VERIFY);
+}
+
+/**
+ * Launch target Flash command & wait for completion
+ *
+ * @param fccob3_0    FCCOB0..3 as word (command in MSB)
+ * @param fccob7_4    FCCOB4..7 as word (FCCOB4 in MSB)
+ * @param fccobB_8    FCCOB8..B as word (FCCOB8 in MSB)
+ * @param fccobWords  Number of FCCOB words to write (1-3)
+ * @param timeoutUs   Time to wait for command completion
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode executeCommand(
+      uint32_t fccob3_0,
+      uint32_t fccob7_4,
+      uint32_t fccobB_8,
+      unsigned fccobWords,
+      unsigned timeoutUs) {
+
+   USBDM_ErrorCode rc;
+
+   if (errorsPending) {
+      // Controller must be idle with errors cleared before launching command
+      rc = waitForCommandComplete(timeoutUs);
+      if ((rc != BDM_RC_OK) && !isFlashCommandError(rc)) {
+         return rc;
+      }
+      rc = writeFstat(FTFL_FSTAT_ACCERR|FTFL_FSTAT_FPVIOL|FTFL_FSTAT_RDCOLERR);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      errorsPending = false;
+   }
+   rc = Swd::writeMemoryWord(FTFL_FCCOB3_0, fccob3_0);
+   if ((rc == BDM_RC_OK) && (fccobWords > 1)) {
+      rc = Swd::writeMemoryWord(FTFL_FCCOB7_4, fccob7_4);
+   }
+   if ((rc == BDM_RC_OK) && (fccobWords > 2)) {
+      rc = Swd::writeMemoryWord(FTFL_FCCOBB_8, fccobB_8);
+   }
+   if (rc == BDM_RC_OK) {
+      // Launch command
+      rc = writeFstat(FTFL_FSTAT_CCIF);
+   }
+   if (rc != BDM_RC_OK) {
+      errorsPending = true;
+      return rc;
+   }
+   return waitForCommandComplete(timeoutUs);
+}
+
+/**
+ * Erase target Flash sector
+ *
+ * @param address Address within sector
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode eraseSector(uint32_t address) {
+   return executeCommand((F_ERSSCR<<24)|toFlashAddress(address), 0, 0, 1, ERASE_TIMEOUT_US);
+}
+
+/**
+ * Program target Flash phrase
+ *
+ * @param address Address of phrase - must be phrase aligned
+ * @param data    Phrase data
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode programPhrase(uint32_t address, const uint8_t *data) {
+   if (programState.phraseSize == 8) {
+      return executeCommand((F_PGM8<<24)|toFlashAddress(address), pack32LE(data), pack32LE(data+4), 3, PROGRAM_TIMEOUT_US);
+   }
+   return executeCommand((F_PGM4<<24)|toFlashAddress(address), pack32LE(data), 0, 2, PROGRAM_TIMEOUT_US);
+}
+
+/**
+ * Check if phrase is in erased state (all 0xFF)
+ *
+ * @param data Phrase data
+ */
+static bool isErasedPhrase(const uint8_t *data) {
+   for (unsigned index=0; index<programState.phraseSize; index++) {
+      if (data[index] != 0xFF) {
+         return false;
+      }
+   }
+   return true;
+}
+
+/**
+ * Program target Flash section using programming acceleration RAM
+ *
+ * @param address Address to program - must be phrase aligned
+ * @param data    Data to program
+ * @param size    Size of data - multiple of phrase size and not larger than acceleration RAM
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note The acceleration RAM may be larger than the TAR auto-increment boundary.
+ *       Swd::writeMemory() re-writes TAR at each TAR_INCREMENT_BOUNDARY so the section is loaded in one call.
+ */
+static USBDM_ErrorCode programSection(uint32_t address, const uint8_t *data, unsigned size) {
+   // Load acceleration RAM
+   USBDM_ErrorCode rc = Swd::writeMemory(MS_Long, size, programState.sectionRamAddress, const_cast<uint8_t *>(data));
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   unsigned count = size/programState.phraseSize;
+   return executeCommand((F_PGMSEC<<24)|toFlashAddress(address), count<<16, 0, 2, ERASE_TIMEOUT_US);
+}
+
+/**
+ * Program whole phrases at current address erasing sectors as needed
+ *
+ * @param data  Data to program
+ * @param size  Size of data - multiple of phrase size
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode programPhrases(const uint8_t *data, unsigned size) {
+   while (size > 0) {
+      uint32_t address   = programState.address;
+      uint32_t sectorEnd = (address|(programState.sectorSize-1))+1;
+      if ((programState.options&TF_OPTION_DELTA) && !isSectorChanged(address)) {
+         // Sector is unchanged - discard data without erasing or programming
+         unsigned skipSize = size;
+         if (skipSize > (sectorEnd-address)) {
+            skipSize = sectorEnd-address;
+         }
+         programState.address += skipSize;
+         data                 += skipSize;
+         size                 -= skipSize;
+         continue;
+      }
+      if ((programState.options&TF_OPTION_ERASE) && (address >= programState.erasedLimit)) {
+         USBDM_ErrorCode rc = eraseSector(address);
+         if (rc != BDM_RC_OK) {
+            return rc;
+         }
+         programState.erasedLimit = sectorEnd;
+      }
+      // Program up to end of sector
+      unsigned blockSize = size;
+      if (blockSize > (sectorEnd-address)) {
+         blockSize = sectorEnd-address;
+      }
+      if (programState.options&TF_OPTION_SECTION) {
+         if (blockSize > programState.sectionRamSize) {
+            blockSize = programState.sectionRamSize;
+         }
+         USBDM_ErrorCode rc = programSection(address, data, blockSize);
+         if (rc != BDM_RC_OK) {
+            return rc;
+         }
+      }
+      else {
+         for (unsigned offset=0; offset<blockSize; offset+=programState.phraseSize) {
+            if ((programState.options&TF_OPTION_ERASE) && isErasedPhrase(data+offset)) {
+               // Sector was erased by this sequence - no need to program erased value
+               continue;
+            }
+            USBDM_ErrorCode rc = programPhrase(address+offset, data+offset);
+            if (rc != BDM_RC_OK) {
+               return rc;
+            }
+         }
+      }
+      programState.address += blockSize;
+      data                 += blockSize;
+      size                 -= blockSize;
+   }
+   return BDM_RC_OK;
+}
+
+/**
+ * Start programming of target Flash
+ *
+ * @param address           Target Flash address to start programming at - must be phrase aligned
+ * @param sectorSize        Target Flash sector size in bytes - power of 2
+ * @param phraseSize        Target Flash phrase size in bytes (4 => PGM4, 8 => PGM8)
+ * @param options           Options, see \ref TargetFlashOptions_t
+ * @param sectionRamAddress Address of target programming acceleration RAM (TF_OPTION_SECTION only)
+ * @param sectionRamSize    Size of target programming acceleration RAM (TF_OPTION_SECTION only)
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note If TF_OPTION_ERASE is used, the entire sector containing address is erased.
+ */
+USBDM_ErrorCode startProgramming(
+      uint32_t address,
+      uint32_t sectorSize,
+      unsigned phraseSize,
+      unsigned options,
+      uint32_t sectionRamAddress,
+      unsigned sectionRamSize) {
+
+   programState.active = false;
+   if (((phraseSize != 4) && (phraseSize != 8)) ||
+       (sectorSize < phraseSize) || ((sectorSize&(sectorSize-1)) != 0) ||
+       ((address&(phraseSize-1)) != 0)) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   if ((options&TF_OPTION_DELTA) && (deltaState.sectorSize != sectorSize)) {
+      // Delta must have been calculated with the same sectors
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   if (options&TF_OPTION_SECTION) {
+      // Round down to whole phrases
+      sectionRamSize &= ~(phraseSize-1);
+      if ((sectionRamSize == 0) || (sectionRamSize > 0xFFFF) || ((sectionRamAddress&3) != 0)) {
+         return BDM_RC_ILLEGAL_PARAMS;
+      }
+   }
+   programState.address           = address;
+   programState.erasedLimit       = address;
+   programState.sectorSize        = sectorSize;
+   programState.phraseSize        = phraseSize;
+   programState.options           = options;
+   programState.sectionRamAddress = sectionRamAddress;
+   programState.sectionRamSize    = sectionRamSize;
+   programState.partialCount      = 0;
+
+   // Check Flash controller is idle and clear any errors from previous operations
+   USBDM_ErrorCode rc = waitForCommandComplete(ERASE_TIMEOUT_US);
+   if ((rc != BDM_RC_OK) && !isFlashCommandError(rc)) {
+      return rc;
+   }
+   errorsPending       = true;
+   programState.active = true;
+   return BDM_RC_OK;
+}
+
+/**
+ * Program data to target Flash at current address
+ *
+ * @param data  Data to program
+ * @param size  Number of bytes - need not be a multiple of phrase size
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note Incomplete phrases are held until more data is provided or endProgramming() is called
+ */
+USBDM_ErrorCode programData(const uint8_t *data, unsigned size) {
+   if (!programState.active) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   USBDM_ErrorCode rc = BDM_RC_OK;
+   if (programState.partialCount > 0) {
+      // Complete partial phrase
+      while ((size > 0) && (programState.partialCount < programState.phraseSize)) {
+         programState.partial[programState.partialCount++] = *data++;
+         size--;
+      }
+      if (programState.partialCount < programState.phraseSize) {
+         return BDM_RC_OK;
+      }
+      programState.partialCount = 0;
+      rc = programPhrases(programState.partial, programState.phraseSize);
+   }
+   unsigned wholePhrases = size&~(programState.phraseSize-1);
+   if ((rc == BDM_RC_OK) && (wholePhrases > 0)) {
+      rc = programPhrases(data, wholePhrases);
+   }
+   if (rc != BDM_RC_OK) {
+      programState.active = false;
+      return rc;
+   }
+   // Hold incomplete phrase
+   memcpy(programState.partial, data+wholePhrases, size-wholePhrases);
+   programState.partialCount = size-wholePhrases;
+   return BDM_RC_OK;
+}
+
+/**
+ * Complete programming of target Flash.
+ * Any incomplete phrase is padded with 0xFF and programmed.
+ *
+ * @param nextAddress Address following last byte programmed
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode endProgramming(uint32_t &nextAddress) {
+   if (!programState.active) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   programState.active = false;
+   USBDM_ErrorCode rc = BDM_RC_OK;
+   unsigned partialCount = programState.partialCount;
+   if (partialCount > 0) {
+      memset(programState.partial+partialCount, 0xFF, programState.phraseSize-partialCount);
+      programState.partialCount = 0;
+      rc = programPhrases(programState.partial, programState.phraseSize);
+      programState.address -= programState.phraseSize-partialCount;
+   }
+   nextAddress = programState.address;
+   return rc;
+}
+
+/**
+ * Erase range of target Flash sectors
+ *
+ * @param address    Address of first sector - must be sector aligned
+ * @param size       Size of range - must be multiple of sector size
+ * @param sectorSize Target Flash sector size in bytes - power of 2
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode eraseRange(uint32_t address, uint32_t size, uint32_t sectorSize) {
+   if ((sectorSize == 0) || ((sectorSize&(sectorSize-1)) != 0) ||
+       (((address|size)&(sectorSize-1)) != 0)) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   while (size > 0) {
+      USBDM_ErrorCode rc = eraseSector(address);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      address += sectorSize;
+      size    -= sectorSize;
+   }
+   return BDM_RC_OK;
+}
+
+/**
+ * Compare CRCs of target Flash sectors with expected values to determine which sectors need programming
+ *
+ * @param address      Address of first sector - must be sector aligned
+ * @param sectorSize   Target Flash sector size in bytes - power of 2
+ * @param preset       CRC to use, see \ref CrcPreset_t
+ * @param expected     Expected 32-bit CRC of each sector in BIG-ENDIAN order
+ * @param sectorCount  Number of sectors (limited to DELTA_MAX_SECTORS)
+ * @param changed      Bitmap of changed sectors, bit n%8 of byte n/8 set => sector n needs programming
+ * @param changedCount Number of changed sectors
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note The result is retained for use by a following programming sequence started with TF_OPTION_DELTA
+ */
+USBDM_ErrorCode compareSectors(
+      uint32_t       address,
+      uint32_t       sectorSize,
+      CrcPreset_t    preset,
+      const uint8_t *expected,
+      unsigned       sectorCount,
+      uint8_t       *changed,
+      unsigned      &changedCount) {
+
+   deltaState.sectorSize  = 0;
+   deltaState.sectorCount = 0;
+   if ((sectorSize == 0) || ((sectorSize&(sectorSize-1)) != 0) ||
+       ((address&(sectorSize-1)) != 0) || (sectorCount > DELTA_MAX_SECTORS)) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   USBDM_ErrorCode rc = TargetCrc::configure(preset);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   memset(deltaState.changed, 0, sizeof(deltaState.changed));
+   changedCount = 0;
+   for (unsigned sector=0; sector<sectorCount; sector++) {
+      uint32_t crc;
+      rc = TargetCrc::calculateCrc(address+sector*sectorSize, sectorSize, crc);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      if (crc != pack32BE(expected+4*sector)) {
+         deltaState.changed[sector/8] |= (1<<(sector%8));
+         changedCount++;
+      }
+   }
+   // Expected values may share buffer with result so only written at end
+   memcpy(changed, deltaState.changed, (sectorCount+7)/8);
+   deltaState.address     = address;
+   deltaState.sectorSize  = sectorSize;
+   deltaState.sectorCount = sectorCount;
+   return BDM_RC_OK;
+}
+
+}; // End namespace TargetFlash
@@ -0,0 +1,122 @@
+/** \file
+    \brief Kinetis target Flash programming over ARM-SWD
+
+   \verbatim
+
+   USBDM
+   Copyright (C) 2016  Peter O'Donoghue
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   \endverbatim
+ */
+
+#ifndef SOURCES_TARGETFLASH_H_
+#define SOURCES_TARGETFLASH_H_
+
+#include <stdint.h>
+#include "commands.h"
+
+/**
+ * Programming of target Kinetis Flash (FTFL/FTFA/FTFE) by driving the
+ * target Flash controller registers over ARM-SWD.
+ *
+ * Programming is done as a stream i.e. a start address followed by data.
+ * Sectors are optionally erased as the stream enters them.
+ * Unchanged sectors may be skipped using a sector CRC comparison (delta programming).
+ */
+namespace TargetFlash {
+
+/**
+ * Start programming of target Flash
+ *
+ * @param address           Target Flash address to start programming at - must be phrase aligned
+ * @param sectorSize        Target Flash sector size in bytes - power of 2
+ * @param phraseSize        Target Flash phrase size in bytes (4 => PGM4, 8 => PGM8)
+ * @param options           Options, see \ref TargetFlashOptions_t
+ * @param sectionRamAddress Address of target programming acceleration RAM (TF_OPTION_SECTION only)
+ * @param sectionRamSize    Size of target programming acceleration RAM (TF_OPTION_SECTION only)
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note If TF_OPTION_ERASE is used, the entire sector containing address is erased.
+ */
+USBDM_ErrorCode startProgramming(
+      uint32_t address,
+      uint32_t sectorSize,
+      unsigned phraseSize,
+      unsigned options,
+      uint32_t sectionRamAddress,
+      unsigned sectionRamSize);
+
+/**
+ * Program data to target Flash at current address
+ *
+ * @param data  Data to program
+ * @param size  Number of bytes - need not be a multiple of phrase size
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note Incomplete phrases are held until more data is provided or endProgramming() is called
+ */
+USBDM_ErrorCode programData(const uint8_t *data, unsigned size);
+
+/**
+ * Complete programming of target Flash.
+ * Any incomplete phrase is padded with 0xFF and programmed.
+ *
+ * @param nextAddress Address following last byte programmed
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode endProgramming(uint32_t &nextAddress);
+
+/**
+ * Erase range of target Flash sectors
+ *
+ * @param address    Address of first sector - must be sector aligned
+ * @param size       Size of range - must be multiple of sector size
+ * @param sectorSize Target Flash sector size in bytes - power of 2
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode eraseRange(uint32_t address, uint32_t size, uint32_t sectorSize);
+
+/**
+ * Compare CRCs of target Flash sectors with expected values to determine which sectors need programming
+ *
+ * @param address      Address of first sector - must be sector aligned
+ * @param sectorSize   Target Flash sector size in bytes - power of 2
+ * @param preset       CRC to use, see \ref CrcPreset_t
+ * @param expected     Expected 32-bit CRC of each sector in BIG-ENDIAN order
+ * @param sectorCount  Number of sectors (limited to DELTA_MAX_SECTORS)
+ * @param changed      Bitmap of changed sectors, bit n%8 of byte n/8 set => sector n needs programming
+ * @param changedCount Number of changed sectors
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ *
+ * @note The result is retained for use by a following programming sequence started with TF_OPTION_DELTA
+ */
+USBDM_ErrorCode compareSectors(
+      uint32_t       address,
+      uint32_t       sectorSize,
+      CrcPreset_t    preset,
+      const uint8_t *expected,
+      unsigned       sectorCount,
+      uint8_t       *changed,
+      unsigned      &changedCount);
+
+}; // End namespace TargetFlash
+
+#endif /* SOURCES_TARGETFLASH_H_ */
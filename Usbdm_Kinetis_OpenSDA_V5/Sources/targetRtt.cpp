@@ -0,0 +1,376 @@
+/** \file
+    \brief Streaming of target RAM ring buffers (RTT) over CDC
+
+   \verbatim
+
+   USBDM
+   Copyright (C) 2016  Peter O'Donoghue
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   \endverbatim
+ */
+#include <string.h>
+#include "configure.h"
+#include "commands.h"
+#include "usb.h"
+#include "swd.h"
+#include "memoryCache.h"
+#include "targetRtt.h"
+
+using namespace USBDM;
+
+namespace TargetRtt {
+
+/** Control block signature (including terminator) */
+static constexpr char     RTT_SIGNATURE[]     = "SEGGER RTT";
+static constexpr unsigned RTT_SIGNATURE_SIZE  = sizeof(RTT_SIGNATURE);
+
+/** Control block layout */
+static constexpr uint32_t CB_MAX_UP_OFFSET    = 16;  //!< Number of up-buffers
+static constexpr uint32_t CB_MAX_DOWN_OFFSET  = 20;  //!< Number of down-buffers
+static constexpr uint32_t CB_BUFFERS_OFFSET   = 24;  //!< Up-buffer descriptors then down-buffer descriptors
+
+/** Buffer descriptor layout */
+static constexpr uint32_t BD_SIZE             = 24;  //!< Size of descriptor
+static constexpr uint32_t BD_BUFFER_OFFSET    = 4;   //!< Address of buffer
+static constexpr uint32_t BD_LENGTH_OFFSET    = 8;   //!< Size of buffer
+static constexpr uint32_t BD_WRITE_OFFSET     = 12;  //!< Write offset
+static constexpr uint32_t BD_READ_OFFSET      = 16;  //!< Read offset
+
+/** Size of chunks read when searching for control block */
+static constexpr unsigned SEARCH_CHUNK        = 256;
+
+/** Maximum bytes transferred in each direction on each poll */
+static constexpr unsigned MAX_TRANSFER        = 64;
+
+/** Sanity limit on number of buffers in control block */
+static constexpr uint32_t MAX_BUFFERS         = 32;
+
+static constexpr uint16_t FRAME_NUMBER_MASK   = 0x7FF;
+
+/** Target ring buffer */
+struct RingBuffer {
+   uint32_t descriptor;  //!< Address of descriptor in target memory (0 => unused)
+   uint32_t buffer;      //!< Address of buffer in target memory
+   uint32_t size;        //!< Size of buffer
+};
+
+static bool       active        = false;
+static uint32_t   controlBlock  = 0;
+static RingBuffer upBuffer;
+static RingBuffer downBuffer;
+static uint16_t   interval      = 1;
+static uint16_t   lastPollFrame = 0;
+
+static uint32_t   upCount       = 0;
+static uint32_t   downCount     = 0;
+static uint32_t   errorCount    = 0;
+
+/**
+ * Search target memory for control block signature
+ *
+ * @param address  Start of region to search
+ * @param size     Size of region
+ * @param found    Address of control block
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode findControlBlock(uint32_t address, uint32_t size, uint32_t &found) {
+   // Chunks overlap so signatures crossing a chunk boundary are found
+   // Overlap and region are kept word aligned for efficient reads
+   constexpr unsigned overlap = (RTT_SIGNATURE_SIZE-1+3)&~3;
+   size     = (size+(address&3)+3)&~3;
+   address &= ~3;
+
+   uint8_t buffer[SEARCH_CHUNK];
+   while (size >= RTT_SIGNATURE_SIZE) {
+      unsigned blockSize = (size<SEARCH_CHUNK)?size:SEARCH_CHUNK;
+      USBDM_ErrorCode rc = Swd::readMemory(MS_Long, blockSize, address, buffer);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+      for (unsigned offset=0; offset<=(blockSize-RTT_SIGNATURE_SIZE); offset++) {
+         if (memcmp(buffer+offset, RTT_SIGNATURE, RTT_SIGNATURE_SIZE) == 0) {
+            found = address+offset;
+            return BDM_RC_OK;
+         }
+      }
+      if (blockSize == size) {
+         break;
+      }
+      blockSize -= overlap;
+      address   += blockSize;
+      size      -= blockSize;
+   }
+   return BDM_RC_ILLEGAL_PARAMS;
+}
+
+/**
+ * Read ring buffer descriptor from target
+ *
+ * @param descriptor Address of descriptor in target memory
+ * @param ringBuffer Ring buffer to initialise
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode readDescriptor(uint32_t descriptor, RingBuffer &ringBuffer) {
+   USBDM_ErrorCode rc = Swd::readMemoryWord(descriptor+BD_BUFFER_OFFSET, ringBuffer.buffer);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   rc = Swd::readMemoryWord(descriptor+BD_LENGTH_OFFSET, ringBuffer.size);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   if (ringBuffer.size == 0) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   ringBuffer.descriptor = descriptor;
+   return BDM_RC_OK;
+}
+
+/**
+ * Read write and read offsets of ring buffer from target
+ *
+ * @param ringBuffer  Ring buffer
+ * @param writeOffset Write offset
+ * @param readOffset  Read offset
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode readOffsets(const RingBuffer &ringBuffer, uint32_t &writeOffset, uint32_t &readOffset) {
+   USBDM_ErrorCode rc = Swd::readMemoryWord(ringBuffer.descriptor+BD_WRITE_OFFSET, writeOffset);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   rc = Swd::readMemoryWord(ringBuffer.descriptor+BD_READ_OFFSET, readOffset);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   if ((writeOffset >= ringBuffer.size) || (readOffset >= ringBuffer.size)) {
+      // Corrupt or re-initialised control block
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   return BDM_RC_OK;
+}
+
+/**
+ * Locate control block and start streaming
+ *
+ * @param address     Address of control block or start of region to search
+ * @param searchSize  Size of region to search (0 => control block is at address)
+ * @param upChannel   Up-buffer to stream to CDC IN
+ * @param downChannel Down-buffer to receive CDC OUT data (RTT_NO_CHANNEL => none)
+ * @param intervalMs  Polling interval in ms
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode start(uint32_t address, uint32_t searchSize, unsigned upChannel, unsigned downChannel, unsigned intervalMs) {
+   stop();
+   if (intervalMs == 0) {
+      intervalMs = 1;
+   }
+   if (intervalMs > FRAME_NUMBER_MASK) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   USBDM_ErrorCode rc;
+   if (searchSize != 0) {
+      rc = findControlBlock(address, searchSize, address);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+   }
+   uint32_t maxUp, maxDown;
+   rc = Swd::readMemoryWord(address+CB_MAX_UP_OFFSET, maxUp);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   rc = Swd::readMemoryWord(address+CB_MAX_DOWN_OFFSET, maxDown);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   if ((maxUp > MAX_BUFFERS) || (maxDown > MAX_BUFFERS) || (upChannel >= maxUp) ||
+       ((downChannel != RTT_NO_CHANNEL) && (downChannel >= maxDown))) {
+      return BDM_RC_ILLEGAL_PARAMS;
+   }
+   rc = readDescriptor(address+CB_BUFFERS_OFFSET+upChannel*BD_SIZE, upBuffer);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   downBuffer.descriptor = 0;
+   if (downChannel != RTT_NO_CHANNEL) {
+      rc = readDescriptor(address+CB_BUFFERS_OFFSET+(maxUp+downChannel)*BD_SIZE, downBuffer);
+      if (rc != BDM_RC_OK) {
+         return rc;
+      }
+   }
+   controlBlock  = address;
+   interval      = intervalMs;
+   lastPollFrame = UsbImplementation::getFrameNumber();
+   upCount       = 0;
+   downCount     = 0;
+   errorCount    = 0;
+   UsbImplementation::setCdcTargetMode(true);
+   active        = true;
+   return BDM_RC_OK;
+}
+
+/**
+ * Stop streaming and return CDC to the UART
+ */
+void stop() {
+   if (active) {
+      UsbImplementation::setCdcTargetMode(false);
+   }
+   active = false;
+}
+
+/**
+ * Drain up-buffer to CDC IN
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode pollUp() {
+   uint32_t writeOffset, readOffset;
+   USBDM_ErrorCode rc = readOffsets(upBuffer, writeOffset, readOffset);
+   if ((rc != BDM_RC_OK) || (writeOffset == readOffset)) {
+      return rc;
+   }
+   // Contiguous data available
+   unsigned count = ((writeOffset>readOffset)?writeOffset:upBuffer.size)-readOffset;
+   unsigned space = UsbImplementation::getCdcInCapacity();
+   if (count > space) {
+      count = space;
+   }
+   if (count > MAX_TRANSFER) {
+      count = MAX_TRANSFER;
+   }
+   if (count == 0) {
+      return BDM_RC_OK;
+   }
+   uint8_t buffer[MAX_TRANSFER];
+   rc = Swd::readMemory(MS_Byte, count, upBuffer.buffer+readOffset, buffer);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   readOffset += count;
+   if (readOffset >= upBuffer.size) {
+      readOffset = 0;
+   }
+   // Release space to target before forwarding
+   rc = Swd::writeMemoryWord(upBuffer.descriptor+BD_READ_OFFSET, readOffset);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   for (unsigned index=0; index<count; index++) {
+      UsbImplementation::putCdcChar(buffer[index]);
+   }
+   upCount += count;
+   return BDM_RC_OK;
+}
+
+/**
+ * Transfer pending CDC OUT data to down-buffer
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+static USBDM_ErrorCode pollDown() {
+   if (downBuffer.descriptor == 0) {
+      return BDM_RC_OK;
+   }
+   uint32_t writeOffset, readOffset;
+   USBDM_ErrorCode rc = readOffsets(downBuffer, writeOffset, readOffset);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   // Contiguous space available (one byte is always left free)
+   unsigned space;
+   if (readOffset > writeOffset) {
+      space = readOffset-writeOffset-1;
+   }
+   else {
+      space = downBuffer.size-writeOffset-((readOffset==0)?1:0);
+   }
+   if (space > MAX_TRANSFER) {
+      space = MAX_TRANSFER;
+   }
+   uint8_t  buffer[MAX_TRANSFER];
+   unsigned count = 0;
+   while ((count < space) && UsbImplementation::getCdcOutChar(buffer[count])) {
+      count++;
+   }
+   if (count == 0) {
+      return BDM_RC_OK;
+   }
+   rc = Swd::writeMemory(MS_Byte, count, downBuffer.buffer+writeOffset, buffer);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   writeOffset += count;
+   if (writeOffset >= downBuffer.size) {
+      writeOffset = 0;
+   }
+   rc = Swd::writeMemoryWord(downBuffer.descriptor+BD_WRITE_OFFSET, writeOffset);
+   if (rc != BDM_RC_OK) {
+      return rc;
+   }
+   downCount += count;
+   return BDM_RC_OK;
+}
+
+/**
+ * Transfer any pending data.
+ * Called from the command loop while waiting for a command.
+ */
+void poll() {
+   if (!active) {
+      return;
+   }
+   uint16_t frame = UsbImplementation::getFrameNumber();
+   if (((frame-lastPollFrame)&FRAME_NUMBER_MASK) < interval) {
+      return;
+   }
+   lastPollFrame = frame;
+
+   // Target memory is modified
+   MemoryCache::invalidate();
+
+   USBDM_ErrorCode rc = pollUp();
+   if (rc == BDM_RC_OK) {
+      rc = pollDown();
+   }
+   if (rc != BDM_RC_OK) {
+      errorCount++;
+   }
+}
+
+/**
+ * Get streaming status
+ *
+ * @param active        Streaming is active
+ * @param controlBlock  Address of control block
+ * @param upCount       Number of bytes transferred target -> host
+ * @param downCount     Number of bytes transferred host -> target
+ * @param errorCount    Number of failed polls
+ */
+void getStatus(bool &active, uint32_t &controlBlock, uint32_t &upCount, uint32_t &downCount, uint32_t &errorCount) {
+   active       = TargetRtt::active;
+   controlBlock = TargetRtt::controlBlock;
+   upCount      = TargetRtt::upCount;
+   downCount    = TargetRtt::downCount;
+   errorCount   = TargetRtt::errorCount;
+}
+
+}; // End namespace TargetRtt
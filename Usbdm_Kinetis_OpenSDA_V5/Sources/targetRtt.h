@@ -0,0 +1,78 @@
+/** \file
+    \brief Streaming of target RAM ring buffers (RTT) over CDC
+
+   \verbatim
+
+   USBDM
+   Copyright (C) 2016  Peter O'Donoghue
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   \endverbatim
+ */
+
+#ifndef SOURCES_TARGETRTT_H_
+#define SOURCES_TARGETRTT_H_
+
+#include <stdint.h>
+#include "commands.h"
+
+/**
+ * Streaming of target ring buffers using the SEGGER RTT control block layout.
+ *
+ * The control block is located in target RAM either at a given address or by
+ * scanning for its signature. While active, the up-buffer is drained to the
+ * CDC IN endpoint and CDC OUT data is written to the down-buffer.
+ * Polling is done while the command loop is idle.
+ */
+namespace TargetRtt {
+
+/**
+ * Locate control block and start streaming
+ *
+ * @param address     Address of control block or start of region to search
+ * @param searchSize  Size of region to search (0 => control block is at address)
+ * @param upChannel   Up-buffer to stream to CDC IN
+ * @param downChannel Down-buffer to receive CDC OUT data (RTT_NO_CHANNEL => none)
+ * @param intervalMs  Polling interval in ms
+ *
+ * @return BDM_RC_OK => success, error otherwise
+ */
+USBDM_ErrorCode start(uint32_t address, uint32_t searchSize, unsigned upChannel, unsigned downChannel, unsigned intervalMs);
+
+/**
+ * Stop streaming and return CDC to the UART
+ */
+void stop();
+
+/**
+ * Transfer any pending data.
+ * Called from the command loop while waiting for a command.
+ */
+void poll();
+
+/**
+ * Get streaming status
+ *
+ * @param active        Streaming is active
+ * @param controlBlock  Address of control block
+ * @param upCount       Number of bytes transferred target -> host
+ * @param downCount     Number of bytes transferred host -> target
+ * @param errorCount    Number of failed polls
+ */
+void getStatus(bool &active, uint32_t &controlBlock, uint32_t &upCount, uint32_t &downCount, uint32_t &errorCount);
+
+}; // End namespace TargetRtt
+
+#endif /* SOURCES_TARGETRTT_H_ */
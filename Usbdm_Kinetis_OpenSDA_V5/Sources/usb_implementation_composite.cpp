@@ -33,12 +33,18 @@ enum InterfaceNumbers {
    NUMBER_OF_INTERFACES,
 };
 
+/** Frame number from last SOF token */
+volatile uint16_t Usb0::fFrameNumber = 0;
+
 /** Force command handler to exit and restart */
 bool Usb0::forceCommandHandlerInitialise = false;
 
 /** Set to discard Rx characters when garbage is expected e.g. when programming target */
 bool Usb0::discardCharacters = false;
 
+/** CDC data is connected to the target rather than the UART */
+bool Usb0::cdcTargetMode = false;
+
 /*
  * String descriptors
  */
@@ -112,14 +118,14 @@ const Usb0::Descriptors Usb0::otherDescriptors = {
             /* bMaxPower               */ (uint8_t) USBMilliamps(500)
       },
       /**
-       * Bulk interface, 2 endpoints
+       * Bulk interface, 4 endpoints
        */
       { // bulk_interface
             /* bLength                 */ (uint8_t) sizeof(InterfaceDescriptor),
             /* bDescriptorType         */ (uint8_t) DT_INTERFACE,
             /* bInterfaceNumber        */ (uint8_t) BULK_INTF_ID,
             /* bAlternateSetting       */ (uint8_t) 0,
-            /* bNumEndpoints           */ (uint8_t) 2,
+            /* bNumEndpoints           */ (uint8_t) 4,
             /* bInterfaceClass         */ (uint8_t) 0xFF,                         // (Vendor specific)
             /* bInterfaceSubClass      */ (uint8_t) 0xFF,                         // (Vendor specific)
             /* bInterfaceProtocol      */ (uint8_t) 0xFF,                         // (Vendor specific)
@@ -141,6 +147,22 @@ const Usb0::Descriptors Usb0::otherDescriptors = {
             /* wMaxPacketSize          */ (uint16_t)nativeToLe16(BULK_IN_EP_MAXSIZE),
             /* bInterval               */ (uint8_t) USBMilliseconds(1)
       },
+      { // event_in_endpoint - IN, Interrupt
+            /* bLength                 */ (uint8_t) sizeof(EndpointDescriptor),
+            /* bDescriptorType         */ (uint8_t) DT_ENDPOINT,
+            /* bEndpointAddress        */ (uint8_t) EP_IN|EVENT_IN_ENDPOINT,
+            /* bmAttributes            */ (uint8_t) ATTR_INTERRUPT,
+            /* wMaxPacketSize          */ (uint16_t)nativeToLe16(EVENT_IN_EP_MAXSIZE),
+            /* bInterval               */ (uint8_t) USBMilliseconds(1)
+      },
+      { // watch_in_endpoint - IN, Bulk
+            /* bLength                 */ (uint8_t) sizeof(EndpointDescriptor),
+            /* bDescriptorType         */ (uint8_t) DT_ENDPOINT,
+            /* bEndpointAddress        */ (uint8_t) EP_IN|WATCH_IN_ENDPOINT,
+            /* bmAttributes            */ (uint8_t) ATTR_BULK,
+            /* wMaxPacketSize          */ (uint16_t)nativeToLe16(WATCH_IN_EP_MAXSIZE),
+            /* bInterval               */ (uint8_t) USBMilliseconds(1)
+      },
       { // interfaceAssociationDescriptorCDC
             /* bLength                 */ (uint8_t) sizeof(InterfaceAssociationDescriptor),
             /* bDescriptorType         */ (uint8_t) DT_INTERFACEASSOCIATION,
@@ -248,6 +270,12 @@ OutEndpoint <Usb0Info, Usb0::CDC_DATA_OUT_ENDPOINT,     CDC_DATA_OUT_EP_MAXSIZE>
 
 /** In endpoint for CDC data in */
 InEndpoint  <Usb0Info, Usb0::CDC_DATA_IN_ENDPOINT,      CDC_DATA_IN_EP_MAXSIZE>       Usb0::epCdcDataIn(EndPointType_Interrupt);
+
+/** In endpoint for target event notifications */
+InEndpoint  <Usb0Info, Usb0::EVENT_IN_ENDPOINT,         EVENT_IN_EP_MAXSIZE>          Usb0::epEventIn(EndPointType_Interrupt);
+
+/** In endpoint for live watch records */
+InEndpoint  <Usb0Info, Usb0::WATCH_IN_ENDPOINT,         WATCH_IN_EP_MAXSIZE>          Usb0::epWatchIn(EndPointType_Bulk);
 /*
  * TODO Add additional endpoints here
  */
@@ -260,6 +288,8 @@ InEndpoint  <Usb0Info, Usb0::CDC_DATA_IN_ENDPOINT,      CDC_DATA_IN_EP_MAXSIZE>
  * @return  E_NO_ERROR on success
  */
 ErrorCode Usb0::sofCallback(uint16_t frameNumber) {
+   fFrameNumber = frameNumber;
+
    // Activity LED
    // Off                     - no USB activity, not connected
    // On                      - no USB activity, connected
@@ -289,7 +319,7 @@ ErrorCode Usb0::sofCallback(uint16_t frameNumber) {
    epCdcSendNotification();
 
    if ((epCdcDataOut.getState() == EPBusy) &&
-       (Uart::getRemaingCapacity()>epCdcDataOut.BUFFER_SIZE)) {
+       (getCdcOutCapacity()>epCdcDataOut.BUFFER_SIZE)) {
       // Now there is sufficient space for another CDC out transfer
       // Set up for next transfer
       console.writeln("Restart");
@@ -352,6 +382,21 @@ void Usb0::epCdcSendNotification() {
    epCdcNotification.startTxTransfer(EPDataIn, sizeof(cdcNotification));
 }
 
+/* Output queue HOST -> TARGET OUT transfers (CDC target mode) */
+static UartQueue<uint8_t, 2*CDC_DATA_OUT_EP_MAXSIZE> outQueue;
+
+/**
+ * Get space available for CDC OUT data in the current destination
+ *
+ * @return Space available in bytes
+ */
+unsigned Usb0::getCdcOutCapacity() {
+   if (cdcTargetMode) {
+      return outQueue.getRemainingCapacity();
+   }
+   return Uart::getRemaingCapacity();
+}
+
 /**
  * Call-back handling CDC-OUT transaction complete\n
  * Data received is passed to the cdcInterface
@@ -368,12 +413,19 @@ EndpointState Usb0::cdcOutTransactionCallback(EndpointState state) {
    volatile const uint8_t *buff = epCdcDataOut.getRxBuffer();
    unsigned size = epCdcDataOut.getDataTransferredSize();
    for (int i=size; i>0; i--) {
-      if (!Uart::putChar(*buff++)) {
+      bool accepted;
+      if (cdcTargetMode) {
+         accepted = outQueue.enQueueDiscardOnFull(*buff++);
+      }
+      else {
+         accepted = Uart::putChar(*buff++);
+      }
+      if (!accepted) {
          // Discard further data from this transfer - should not happen!
          break;
       }
    }
-   if (Uart::getRemaingCapacity()>=epCdcDataOut.BUFFER_SIZE) {
+   if (getCdcOutCapacity()>=epCdcDataOut.BUFFER_SIZE) {
       // Sufficient space for another CDC out transfer
       // Set up for next transfer
       console.writeln("OK - ", size);
@@ -458,6 +510,62 @@ bool Usb0::putCdcChar(uint8_t ch) {
    return rc;
 }
 
+/**
+ * Handle character received by UART
+ *
+ * @param[in] ch Character received
+ *
+ * @return true  Character accepted or discarded
+ * @return false Overrun, character not accepted
+ */
+bool Usb0::uartInCallback(uint8_t ch) {
+   if (cdcTargetMode) {
+      // CDC is in use by target - discard
+      return true;
+   }
+   return putCdcChar(ch);
+}
+
+/**
+ * Connect CDC data to the target (RTT) instead of the UART.
+ * While enabled, UART Rx characters are discarded and CDC OUT data is
+ * held for collection by getCdcOutChar().
+ *
+ * @param[in] enable True to connect CDC data to the target
+ */
+void Usb0::setCdcTargetMode(bool enable) {
+   if (cdcTargetMode == enable) {
+      return;
+   }
+   outQueue.clear();
+   cdcTargetMode = enable;
+}
+
+/**
+ * Get space available for CDC IN characters
+ *
+ * @return Number of characters that may be passed to putCdcChar() without overrun
+ */
+unsigned Usb0::getCdcInCapacity() {
+   return inQueue.getRemainingCapacity();
+}
+
+/**
+ * Get character received on CDC OUT (CDC target mode only)
+ *
+ * @param[out] ch Character received
+ *
+ * @return true  Character available
+ * @return false No character available
+ */
+bool Usb0::getCdcOutChar(uint8_t &ch) {
+   if (outQueue.isEmpty()) {
+      return false;
+   }
+   ch = outQueue.deQueue();
+   return true;
+}
+
 //_______ Bulk Call-backs ________________________________________________________________
 
 /**
@@ -503,7 +611,7 @@ void Usb0::initialise() {
 
    setUserCallback(userCallbackFunction);
 
-   Uart::setInCallback(putCdcChar);
+   Uart::setInCallback(uartInCallback);
    Uart::initialise();
 
    UsbBase_T::initialise();
@@ -521,9 +629,38 @@ void Usb0::initialise() {
  *
  *   @note Doesn't return until command has been received.
  */
-int Usb0::receiveBulkData(uint8_t maxSize, uint8_t *buffer) {
+int Usb0::receiveBulkData(uint16_t maxSize, uint8_t *buffer) {
+   startBulkReceive(maxSize, buffer);
+   return waitBulkReceive();
+}
+
+/**
+ *  Start reception of data over bulk OUT endpoint
+ *
+ *   @param[in] maxSize  Maximum # of bytes to receive
+ *   @param[in] buffer   Pointer to buffer for bytes received
+ *
+ *   @note Returns immediately. Use waitBulkReceive() to obtain the data.
+ */
+void Usb0::startBulkReceive(uint16_t maxSize, uint8_t *buffer) {
    epBulkOut.startRxTransfer(EPDataOut, maxSize, buffer);
+}
+
+/**
+ *  Wait for completion of reception started by startBulkReceive()
+ *
+ *   @param[in] idleCallback Called each time the processor wakes while waiting (may be nullptr)
+ *
+ *   @return Number of bytes received
+ */
+int Usb0::waitBulkReceive(void (*idleCallback)()) {
    while(epBulkOut.getState() != EPIdle) {
+      if (idleCallback != nullptr) {
+         idleCallback();
+         if (epBulkOut.getState() == EPIdle) {
+            break;
+         }
+      }
       __enable_irq();
       Smc::enterWaitMode();
    }
@@ -531,25 +668,78 @@ int Usb0::receiveBulkData(uint8_t maxSize, uint8_t *buffer) {
    return epBulkOut.getDataTransferredSize();
 }
 
+/**
+ *  Wait for completion of transmission started by sendBulkData()
+ */
+void Usb0::waitBulkTransmit() {
+   while (epBulkIn.getState() != EPIdle) {
+      Smc::enterWaitMode();
+   }
+}
+
 /**
  *  Blocking transmission of data over bulk IN endpoint
  *
- *  @param[in] size   Number of bytes to send
- *  @param[in] buffer Pointer to bytes to send
+ *  @param[in] size    Number of bytes to send
+ *  @param[in] buffer  Pointer to bytes to send
+ *  @param[in] needZLP Terminate transfer with ZLP if size is a multiple of the endpoint size
  *
  *   @note : Waits for idle BEFORE transmission but\n
  *   returns before data has been transmitted
  *
  */
-void Usb0::sendBulkData(uint8_t size, const uint8_t *buffer) {
+void Usb0::sendBulkData(uint16_t size, const uint8_t *buffer, bool needZLP) {
 //   commandBusyFlag = false;
    //   enableUSBIrq();
-   while (epBulkIn.getState() != EPIdle) {
-      Smc::enterWaitMode();
+   waitBulkTransmit();
+   if (needZLP) {
+      epBulkIn.setNeedZLP();
    }
    epBulkIn.startTxTransfer(EPDataIn, size, buffer);
 }
 
+/**
+ *  Non-blocking transmission of a target event record over event IN endpoint
+ *
+ *  @param[in] size    Number of bytes to send (<= EVENT_IN_EP_MAXSIZE)
+ *  @param[in] buffer  Pointer to bytes to send
+ *
+ *  @return true  Transmission started
+ *  @return false Not configured or busy with previous event
+ */
+bool Usb0::sendEventData(uint16_t size, const uint8_t *buffer) {
+   usbdm_assert(size <= epEventIn.BUFFER_SIZE, "Event too large");
+
+   CriticalSection cs;
+   if ((fConnectionState != USBconfigured) || (epEventIn.getState() != EPIdle)) {
+      return false;
+   }
+   Endpoint::safeCopy(epEventIn.getTxBuffer(), buffer, size);
+   epEventIn.startTxTransfer(EPDataIn, size);
+   return true;
+}
+
+/**
+ *  Non-blocking transmission of a live watch record over watch IN endpoint
+ *
+ *  @param[in] size    Number of bytes to send (<= WATCH_IN_EP_MAXSIZE)
+ *  @param[in] buffer  Pointer to bytes to send
+ *
+ *  @return true  Transmission started
+ *  @return false Not configured or busy with previous record
+ */
+bool Usb0::sendWatchData(uint16_t size, const uint8_t *buffer) {
+   usbdm_assert(size <= epWatchIn.BUFFER_SIZE, "Record too large");
+
+   CriticalSection cs;
+   if ((fConnectionState != USBconfigured) || (epWatchIn.getState() != EPIdle)) {
+      return false;
+   }
+   Endpoint::safeCopy(epWatchIn.getTxBuffer(), buffer, size);
+   epWatchIn.startTxTransfer(EPDataIn, size);
+   return true;
+}
+
 /**
  * CDC Set line coding handler
  */
@@ -74,6 +74,8 @@ static constexpr unsigned  CONTROL_EP_MAXSIZE           = 64; //!< Control in/ou
  */
 static constexpr unsigned  BULK_OUT_EP_MAXSIZE          = 64; //!< Bulk out
 static constexpr unsigned  BULK_IN_EP_MAXSIZE           = 64; //!< Bulk in
+static constexpr unsigned  EVENT_IN_EP_MAXSIZE          = 16; //!< Event notification in (interrupt)
+static constexpr unsigned  WATCH_IN_EP_MAXSIZE          = 64; //!< Live watch records in (bulk)
 
 static constexpr unsigned  CDC_NOTIFICATION_EP_MAXSIZE  = 16; //!< CDC notification
 static constexpr unsigned  CDC_DATA_OUT_EP_MAXSIZE      = 16; //!< CDC data out
@@ -142,6 +144,12 @@ public:
       /** CDC Data in endpoint number */
       CDC_DATA_IN_ENDPOINT,
 
+      /** Target event notification in endpoint number (BDM interface) */
+      EVENT_IN_ENDPOINT,
+
+      /** Live watch record in endpoint number (BDM interface) */
+      WATCH_IN_ENDPOINT,
+
       /** Total number of endpoints */
       NUMBER_OF_ENDPOINTS,
    };
@@ -177,6 +185,8 @@ public:
       InterfaceDescriptor                      bulk_interface;
       EndpointDescriptor                       bulk_out_endpoint;
       EndpointDescriptor                       bulk_in_endpoint;
+      EndpointDescriptor                       event_in_endpoint;
+      EndpointDescriptor                       watch_in_endpoint;
 
       InterfaceAssociationDescriptor           interfaceAssociationDescriptorCDC;
       InterfaceDescriptor                      cdc_CCI_Interface;
@@ -207,6 +217,8 @@ public:
       epCdcNotification.clearPinPongToggle();
       epCdcDataOut.clearPinPongToggle();
       epCdcDataIn.clearPinPongToggle();
+      epEventIn.clearPinPongToggle();
+      epWatchIn.clearPinPongToggle();
    }
 
    /**
@@ -237,6 +249,12 @@ public:
       addEndpoint(&epCdcDataIn);
       epCdcDataIn.setCallback(cdcInTransactionCallback);
 
+      epEventIn.initialise(clearToggles);
+      addEndpoint(&epEventIn);
+
+      epWatchIn.initialise(clearToggles);
+      addEndpoint(&epWatchIn);
+
       // Start CDC status transmission
       epCdcSendNotification();
    }
@@ -244,13 +262,14 @@ public:
    /**
     *  Blocking transmission of data over bulk IN endpoint
     *
-    *  @param[in] size   Number of bytes to send
-    *  @param[in] buffer Pointer to bytes to send
+    *  @param[in] size    Number of bytes to send
+    *  @param[in] buffer  Pointer to bytes to send
+    *  @param[in] needZLP Terminate transfer with ZLP if size is a multiple of the endpoint size
     *
     *  @note : Waits for idle BEFORE transmission but\n
     *          returns before data has been transmitted
     */
-   static void sendBulkData(const uint8_t size, const uint8_t *buffer);
+   static void sendBulkData(const uint16_t size, const uint8_t *buffer, bool needZLP=false);
 
    /**
     *  Blocking reception of data over bulk OUT endpoint
@@ -262,7 +281,98 @@ public:
     *
     *   @note Doesn't return until command has been received.
     */
-   static int receiveBulkData(uint8_t maxSize, uint8_t *buffer);
+   static int receiveBulkData(uint16_t maxSize, uint8_t *buffer);
+
+   /**
+    *  Start reception of data over bulk OUT endpoint
+    *
+    *   @param[in] maxSize Maximum number of bytes to receive
+    *   @param[in] buffer  Pointer to buffer for bytes received
+    *
+    *   @note Returns immediately. Use waitBulkReceive() to obtain the data.
+    */
+   static void startBulkReceive(uint16_t maxSize, uint8_t *buffer);
+
+   /**
+    *  Wait for completion of reception started by startBulkReceive()
+    *
+    *   @param[in] idleCallback Called each time the processor wakes while waiting (may be nullptr)
+    *
+    *   @return Number of bytes received
+    */
+   static int waitBulkReceive(void (*idleCallback)() = nullptr);
+
+   /**
+    *  Wait for completion of transmission started by sendBulkData()
+    */
+   static void waitBulkTransmit();
+
+   /**
+    *  Non-blocking transmission of a target event record over event IN endpoint
+    *
+    *  @param[in] size    Number of bytes to send (<= EVENT_IN_EP_MAXSIZE)
+    *  @param[in] buffer  Pointer to bytes to send
+    *
+    *  @return true  Transmission started
+    *  @return false Not configured or busy with previous event
+    */
+   static bool sendEventData(const uint16_t size, const uint8_t *buffer);
+
+   /**
+    *  Non-blocking transmission of a live watch record over watch IN endpoint
+    *
+    *  @param[in] size    Number of bytes to send (<= WATCH_IN_EP_MAXSIZE)
+    *  @param[in] buffer  Pointer to bytes to send
+    *
+    *  @return true  Transmission started
+    *  @return false Not configured or busy with previous record
+    */
+   static bool sendWatchData(const uint16_t size, const uint8_t *buffer);
+
+   /**
+    * Get frame number from last SOF token (~1ms interval)
+    *
+    * @return Frame number (11 bits)
+    */
+   static uint16_t getFrameNumber() {
+      return fFrameNumber;
+   }
+
+   /**
+    * Add character to CDC IN queue.
+    *
+    * @param[in] ch Character to send
+    *
+    * @return true  Character accepted or discarded (see discardCharacters)
+    * @return false Overrun, character not accepted
+    */
+   static bool putCdcChar(uint8_t ch);
+
+   /**
+    * Connect CDC data to the target (RTT) instead of the UART.
+    * While enabled, UART Rx characters are discarded and CDC OUT data is
+    * held for collection by getCdcOutChar().
+    *
+    * @param[in] enable True to connect CDC data to the target
+    */
+   static void setCdcTargetMode(bool enable);
+
+   /**
+    * Get space available for CDC IN characters
+    *
+    * @return Number of characters that may be passed to putCdcChar() without overrun
+    */
+   static unsigned getCdcInCapacity();
+
+   /**
+    * Get character received on CDC OUT (CDC target mode only)
+    *
+    * @param[out] ch Character received
+    *
+    * @return true  Character available
+    * @return false No character available
+    */
+   static bool getCdcOutChar(uint8_t &ch);
 
    /**
     * Initialise the USB0 interface
@@ -297,10 +407,19 @@ protected:
 
    /** In endpoint for CDC data in */
    static InEndpoint  <Usb0Info, Usb0::CDC_DATA_IN_ENDPOINT,      CDC_DATA_IN_EP_MAXSIZE>       epCdcDataIn;
+
+   /** In endpoint for target event notifications */
+   static InEndpoint  <Usb0Info, Usb0::EVENT_IN_ENDPOINT,         EVENT_IN_EP_MAXSIZE>          epEventIn;
+
+   /** In endpoint for live watch records */
+   static InEndpoint  <Usb0Info, Usb0::WATCH_IN_ENDPOINT,         WATCH_IN_EP_MAXSIZE>          epWatchIn;
    /*
     * TODO Add additional End-points here
     */
     
+   /** Frame number from last SOF token */
+   static volatile uint16_t fFrameNumber;
+
    static bool forceCommandHandlerInitialise;
 
    /// Set to discard Rx characters when garbage is expected e.g. when programming target
@@ -324,9 +443,26 @@ protected:
     */
    static int receiveCdcData(uint8_t *data, unsigned maxSize);
 
-   static bool putCdcChar(uint8_t ch);
-
 protected:
+   /// CDC data is connected to the target rather than the UART
+   static bool cdcTargetMode;
+
+   /**
+    * Handle character received by UART
+    *
+    * @param[in] ch Character received
+    *
+    * @return true  Character accepted or discarded
+    * @return false Overrun, character not accepted
+    */
+   static bool uartInCallback(uint8_t ch);
+
+   /**
+    * Get space available for CDC OUT data in the current destination
+    *
+    * @return Space available in bytes
+    */
+   static unsigned getCdcOutCapacity();
 
    /**
     * Callback for SOF tokens